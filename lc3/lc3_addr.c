@@ -0,0 +1,147 @@
+#include "lc3_addr.h"
+#include <string.h>
+
+#define WORD_COUNT (LC3_ADDRESS_SPACE_SIZE / 64)
+
+
+vaAllocFunction(LC3_OverlapArray, LC3_Overlap, LC3_NewOverlapArray,,)
+vaAppendFunction(LC3_OverlapArray, const LC3_Overlap, addOverlap,,)
+
+
+LC3_AddressSpace *LC3_CreateAddressSpace() {
+    LC3_AddressSpace *space = vaMalloc("LC3_AddressSpace", sizeof(LC3_AddressSpace));
+    memset(space->used, 0, sizeof(space->used));
+    return space;
+}
+
+
+// Bits [first, last] of a 64-bit word
+static uint64_t rangeMask(unsigned first, unsigned last) {
+    uint64_t upper = (last == 63) ? ~0ULL : ((1ULL << (last + 1)) - 1);
+    return upper & (~0ULL << first);
+}
+
+
+// Adds address to the overlap list, extending the previous range if possible
+static void addOverlapAddress(LC3_OverlapArray *overlaps, uint32_t addr, uint32_t owner, uint32_t claimant) {
+    if (overlaps->sz > 0) {
+        LC3_Overlap *last = &overlaps->ptr[overlaps->sz - 1];
+
+        if (last->claimant == claimant && last->owner == owner && last->end + 1 == addr) {
+            last->end = addr;
+            return;
+        }
+    }
+
+    LC3_Overlap overlap = {addr, addr, owner, claimant};
+    addOverlap(overlaps, overlap);
+}
+
+
+// Claims range [start, end] (no wrapping)
+static void claimRange(LC3_AddressSpace *space, uint32_t start, uint32_t end, uint32_t owner, LC3_OverlapArray *overlaps) {
+    for (uint32_t word = start / 64; word <= end / 64; word++) {
+        unsigned first = (word == start / 64) ? start % 64 : 0;
+        unsigned last  = (word == end / 64) ? end % 64 : 63;
+        uint64_t mask  = rangeMask(first, last);
+
+        // Check all 64 words at once
+        uint64_t taken = space->used[word] & mask;
+        uint64_t fresh = mask & ~space->used[word];
+
+        for (; taken != 0; taken &= taken - 1) {
+            uint32_t addr = word * 64 + __builtin_ctzll(taken);
+            addOverlapAddress(overlaps, addr, space->owner[addr], owner);
+        }
+
+        for (; fresh != 0; fresh &= fresh - 1) {
+            space->owner[word * 64 + __builtin_ctzll(fresh)] = owner;
+        }
+
+        space->used[word] |= mask;
+    }
+}
+
+
+void LC3_ClaimAddresses(LC3_AddressSpace *space, uint16_t start, size_t size, uint32_t owner, LC3_OverlapArray *overlaps) {
+    if (size == 0) {
+        return;
+    }
+
+    if (size > LC3_ADDRESS_SPACE_SIZE) {
+        size = LC3_ADDRESS_SPACE_SIZE;
+    }
+
+    uint32_t end = (uint32_t)start + size - 1;
+
+    // Sections can wrap around the end of memory
+    if (end >= LC3_ADDRESS_SPACE_SIZE) {
+        claimRange(space, start, LC3_ADDRESS_SPACE_SIZE - 1, owner, overlaps);
+        claimRange(space, 0, end - LC3_ADDRESS_SPACE_SIZE, owner, overlaps);
+    } else {
+        claimRange(space, start, end, owner, overlaps);
+    }
+}
+
+
+bool LC3_AddressUsed(const LC3_AddressSpace *space, uint16_t addr) {
+    return (space->used[addr / 64] >> (addr % 64)) & 1;
+}
+
+
+// Finds first address at or after from for which the used bit equals used, or LC3_ADDRESS_SPACE_SIZE
+static size_t findBit(const LC3_AddressSpace *space, size_t from, bool used) {
+    if (from >= LC3_ADDRESS_SPACE_SIZE) {
+        return LC3_ADDRESS_SPACE_SIZE;
+    }
+
+    size_t word = from / 64;
+    uint64_t bits = (used ? space->used[word] : ~space->used[word]) & (~0ULL << (from % 64));
+
+    while (bits == 0) {
+        if (++word == WORD_COUNT) {
+            return LC3_ADDRESS_SPACE_SIZE;
+        }
+
+        bits = used ? space->used[word] : ~space->used[word];
+    }
+
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+
+bool LC3_NextFreeRegion(const LC3_AddressSpace *space, size_t from, uint16_t *start, size_t *size) {
+    size_t first = findBit(space, from, false);
+
+    if (first == LC3_ADDRESS_SPACE_SIZE) {
+        return false;
+    }
+
+    (*start) = first;
+    (*size) = findBit(space, first, true) - first;
+    return true;
+}
+
+
+bool LC3_FindFreeRegion(const LC3_AddressSpace *space, size_t size, uint16_t *start) {
+    size_t found = 0;
+
+    for (size_t from = 0; LC3_NextFreeRegion(space, from, start, &found); from = *start + found) {
+        if (found >= size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+size_t LC3_UsedWords(const LC3_AddressSpace *space) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < WORD_COUNT; i++) {
+        count += __builtin_popcountll(space->used[i]);
+    }
+
+    return count;
+}
@@ -0,0 +1,48 @@
+/* 
+ * Description: 
+ * Tracks which parts of the LC3 address space are in use, and by what
+ */
+
+#pragma once
+#include "lib/va_template.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Amount of words in the LC3 address space
+#define LC3_ADDRESS_SPACE_SIZE (0x10000)
+
+
+// Occupancy bitmap (8 KB), with the owner of every used word
+typedef struct LC3_AddressSpace {
+    uint64_t used[LC3_ADDRESS_SPACE_SIZE / 64];
+    uint32_t owner[LC3_ADDRESS_SPACE_SIZE]; // Only valid for used words
+} LC3_AddressSpace;
+
+
+// Range [start, end] claimed by claimant while already in use by owner
+typedef struct LC3_Overlap {
+    uint16_t start, end;
+    uint32_t owner, claimant;
+} LC3_Overlap;
+
+vaTypedef(LC3_Overlap, LC3_OverlapArray);
+vaAllocFunctionDefine(LC3_OverlapArray, LC3_NewOverlapArray);
+
+
+// Allocates an empty address space, free using vaFree
+LC3_AddressSpace *LC3_CreateAddressSpace();
+
+// Marks size words starting at start (wrapping around) as used by owner, overlaps with earlier claims are added to overlaps
+void LC3_ClaimAddresses(LC3_AddressSpace *space, uint16_t start, size_t size, uint32_t owner, LC3_OverlapArray *overlaps);
+
+// Checks if a single address is in use
+bool LC3_AddressUsed(const LC3_AddressSpace *space, uint16_t addr);
+
+// Finds the first free region at or after from, returns false if there is none
+bool LC3_NextFreeRegion(const LC3_AddressSpace *space, size_t from, uint16_t *start, size_t *size);
+
+// Finds the first free region of at least size words, returns false if there is none
+bool LC3_FindFreeRegion(const LC3_AddressSpace *space, size_t size, uint16_t *start);
+
+// Amount of used words
+size_t LC3_UsedWords(const LC3_AddressSpace *space);
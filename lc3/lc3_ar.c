@@ -0,0 +1,349 @@
+#include "lc3_ar.h"
+#include "lc3_str.h"
+#include "lc3_err.h"
+#include "lib/va_alloc.h"
+#include <ctype.h>
+#include <string.h>
+
+
+// Labels are case insensitive, so names are hashed and compared in upper case
+static uint32_t hashName(const char *name, size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)toupper((unsigned char)name[i])) * 16777619u;
+    }
+
+    return hash;
+}
+
+
+static bool sameName(const char *n1, size_t len1, const char *n2, size_t len2) {
+    if (len1 != len2) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len1; i++) {
+        if (toupper((unsigned char)n1[i]) != toupper((unsigned char)n2[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static const char *symbolName(const Symbol *symbol) {
+    return symbol->loc.unit->buf.ptr[symbol->loc.line].ptr + symbol->loc.tk.start;
+}
+
+
+bool LC3_IsArchive(const char *filename) {
+    char *ext = strrchr(filename, '.');
+
+    if (ext && strcmp(ext, ".lca") == 0) {
+        FILE *fp = fopen(filename, "rb");
+        char mgc[4] = {0};
+
+        if (fp == NULL) {
+            return false;
+        }
+
+        fread(&mgc, 1, 4, fp);
+        fclose(fp);
+        return (memcmp(mgc, LC3_ARCHIVE_MAGIC, 4) == 0);
+    }
+
+    return false;
+}
+
+
+// Appends name with its terminator, returns its offset
+static uint32_t addName(String *names, const char *name, size_t len) {
+    uint32_t offset = names->sz;
+
+    for (size_t i = 0; i < len; i++) {
+        addchar(names, name[i]);
+    }
+
+    addchar(names, '\0');
+    return offset;
+}
+
+
+bool LC3_WriteArchive(size_t unitCount, LC3_Unit *units, const char *filename) {
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+        return false;
+    }
+
+    size_t symbolCount = 0;
+
+    for (size_t i = 0; i < unitCount; i++) {
+        symbolCount += units[i].symb.sz;
+    }
+
+    // Index is kept at most half full
+    uint32_t memberCount = unitCount, slotCount = VA_BASE_CAP;
+
+    while (slotCount < 2 * symbolCount) {
+        slotCount *= 2;
+    }
+
+    LC3_ArchiveMember *members = vaMalloc("LC3_Archive", unitCount * sizeof(LC3_ArchiveMember));
+    uint32_t *slots = vaMalloc("LC3_Archive", 2 * slotCount * sizeof(uint32_t));
+    String names = newString();
+
+    memset(slots, 0, 2 * slotCount * sizeof(uint32_t));
+
+    for (size_t i = 0; i < unitCount; i++) {
+        members[i].name = addName(&names, units[i].filename, strlen(units[i].filename));
+
+        // The first member defining a symbol gets it
+        for (size_t s = 0; s < units[i].symb.sz; s++) {
+            const char *name = symbolName(&units[i].symb.ptr[s]);
+            size_t len = units[i].symb.ptr[s].loc.tk.sz;
+            uint32_t slot = hashName(name, len) & (slotCount - 1);
+
+            while (slots[2 * slot] != 0 && !sameName(names.ptr + slots[2 * slot] - 1, strlen(names.ptr + slots[2 * slot] - 1), name, len)) {
+                slot = (slot + 1) & (slotCount - 1);
+            }
+
+            if (slots[2 * slot] == 0) {
+                slots[2 * slot] = addName(&names, name, len) + 1;
+                slots[2 * slot + 1] = i;
+            }
+        }
+    }
+
+    uint32_t nameSize = names.sz;
+
+    fwrite(LC3_ARCHIVE_MAGIC, 1, 4, fp);
+    fwrite(&memberCount, 4, 1, fp);
+    fwrite(&slotCount, 4, 1, fp);
+    fwrite(&nameSize, 4, 1, fp);
+
+    // Member table is written again once the offsets are known
+    long table = ftell(fp);
+    fwrite(members, sizeof(LC3_ArchiveMember), unitCount, fp);
+    fwrite(slots, 4, 2 * slotCount, fp);
+    fwrite(names.ptr, 1, names.sz, fp);
+
+    for (size_t i = 0; i < unitCount; i++) {
+        members[i].offset = ftell(fp);
+        LC3_WriteObject(&units[i], fp, true);
+        members[i].size = ftell(fp) - members[i].offset;
+    }
+
+    fseek(fp, table, SEEK_SET);
+    fwrite(members, sizeof(LC3_ArchiveMember), unitCount, fp);
+    fclose(fp);
+
+    vaFree(names.ptr);
+    vaFree(slots);
+    vaFree(members);
+    return true;
+}
+
+
+LC3_Archive *LC3_OpenArchive(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    char mgc[4];
+    uint32_t header[3];
+
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    if (fread(mgc, 1, 4, fp) != 4 || memcmp(mgc, LC3_ARCHIVE_MAGIC, 4) != 0 || fread(header, 4, 3, fp) != 3 ||
+        header[1] == 0 || (header[1] & (header[1] - 1)) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    LC3_Archive *archive = vaMalloc("LC3_Archive", sizeof(LC3_Archive));
+
+    archive->filename    = filename;
+    archive->fp          = fp;
+    archive->memberCount = header[0];
+    archive->slotCount   = header[1];
+    archive->members     = vaMalloc("LC3_Archive", header[0] * sizeof(LC3_ArchiveMember));
+    archive->slots       = vaMalloc("LC3_Archive", 2 * header[1] * sizeof(uint32_t));
+    archive->labels      = vaMalloc("LC3_Archive", header[0] * sizeof(char *));
+    archive->names       = (String){vaMalloc("LC3_Archive", header[2] + 1), header[2], header[2] + 1};
+
+    memset(archive->labels, 0, header[0] * sizeof(char *));
+    archive->names.ptr[header[2]] = '\0';
+
+    bool valid = fread(archive->members, sizeof(LC3_ArchiveMember), header[0], fp) == header[0] &&
+        fread(archive->slots, 4, 2 * header[1], fp) == 2 * header[1] &&
+        fread(archive->names.ptr, 1, header[2], fp) == header[2];
+
+    for (uint32_t i = 0; valid && i < header[0]; i++) {
+        valid = (archive->members[i].name < header[2]);
+    }
+
+    for (uint32_t i = 0; valid && i < header[1]; i++) {
+        valid = (archive->slots[2 * i] <= header[2] && archive->slots[2 * i + 1] < header[0]);
+    }
+
+    if (!valid) {
+        LC3_CloseArchive(archive);
+        return NULL;
+    }
+
+    return archive;
+}
+
+
+void LC3_CloseArchive(LC3_Archive *archive) {
+    for (uint32_t i = 0; i < archive->memberCount; i++) {
+        vaFree(archive->labels[i]);
+    }
+
+    fclose(archive->fp);
+    vaFree(archive->labels);
+    vaFree(archive->names.ptr);
+    vaFree(archive->slots);
+    vaFree(archive->members);
+    vaFree(archive);
+}
+
+
+long LC3_FindArchiveSymbol(const LC3_Archive *archive, const char *name, size_t len) {
+    uint32_t mask = archive->slotCount - 1;
+    uint32_t slot = hashName(name, len) & mask;
+
+    for (uint32_t i = 0; i < archive->slotCount && archive->slots[2 * slot] != 0; i++) {
+        const char *current = archive->names.ptr + archive->slots[2 * slot] - 1;
+
+        if (sameName(current, strlen(current), name, len)) {
+            return archive->slots[2 * slot + 1];
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+
+// Names defined by the units loaded so far
+typedef struct DefinedSet {
+    const Symbol **slots;
+    size_t cap, count;
+} DefinedSet;
+
+
+static bool findDefined(const DefinedSet *set, const char *name, size_t len, size_t *slot) {
+    (*slot) = hashName(name, len) & (set->cap - 1);
+
+    while (set->slots[*slot] != NULL) {
+        if (sameName(symbolName(set->slots[*slot]), set->slots[*slot]->loc.tk.sz, name, len)) {
+            return true;
+        }
+
+        (*slot) = ((*slot) + 1) & (set->cap - 1);
+    }
+
+    return false;
+}
+
+
+static void addDefined(DefinedSet *set, const Symbol *symbol) {
+    size_t slot;
+
+    if (2 * (set->count + 1) > set->cap) {
+        DefinedSet grown = {vaMalloc("SymbolTable", 2 * set->cap * sizeof(Symbol *)), 2 * set->cap, 0};
+        memset(grown.slots, 0, grown.cap * sizeof(Symbol *));
+
+        for (size_t i = 0; i < set->cap; i++) {
+            if (set->slots[i] != NULL) {
+                addDefined(&grown, set->slots[i]);
+            }
+        }
+
+        vaFree(set->slots);
+        (*set) = grown;
+    }
+
+    if (!findDefined(set, symbolName(symbol), symbol->loc.tk.sz, &slot)) {
+        set->slots[slot] = symbol;
+        set->count++;
+    }
+}
+
+
+// Reads a member into a new unit, named after the archive and the member
+static void extractMember(LC3_Archive *archive, uint32_t member, LC3_Unit *unit, LC3_Context *ctx) {
+    const char *name = archive->names.ptr + archive->members[member].name;
+    size_t len = strlen(archive->filename) + strlen(name) + 3;
+
+    archive->labels[member] = vaMalloc("LC3_Archive", len);
+    snprintf(archive->labels[member], len, "%s(%s)", archive->filename, name);
+
+    (*unit) = LC3_CreateUnit(ctx, archive->labels[member]);
+    vaMemSetOwner(unit->filename);
+
+    fseek(archive->fp, archive->members[member].offset, SEEK_SET);
+    LC3_ReadObject(unit, archive->fp, archive->members[member].offset + archive->members[member].size);
+
+    vaMemSetOwner(NULL);
+
+    if (unit->error) {
+        LC3_SimpleError(unit, "\x1b[1m%s:\x1b[0m failed to read archive member\n", unit->filename);
+        LC3_FlushDiagnostics(unit);
+    }
+}
+
+
+size_t LC3_ExtractMembers(size_t archiveCount, LC3_Archive **archives, size_t unitCount, LC3_Unit *units, LC3_Context *ctx) {
+    DefinedSet defined = {vaMalloc("SymbolTable", VA_BASE_CAP * sizeof(Symbol *)), VA_BASE_CAP, 0};
+    memset(defined.slots, 0, defined.cap * sizeof(Symbol *));
+
+    for (size_t i = 0; i < unitCount; i++) {
+        for (size_t s = 0; s < units[i].symb.sz; s++) {
+            addDefined(&defined, &units[i].symb.ptr[s]);
+        }
+    }
+
+    // Extracted units are scanned like the others, so their references are resolved as well
+    for (size_t i = 0; i < unitCount && !ctx->error; i++) {
+        LC3_Unit *unit = &units[i];
+
+        for (size_t section = 0; section < unit->obj.sz; section++) {
+            for (size_t r = 0; r < unit->obj.ptr[section].reloc.sz; r++) {
+                BufferSegment label = unit->obj.ptr[section].reloc.ptr[r].label;
+                const char *name = unit->buf.ptr[label.line].ptr + label.tk.start;
+                size_t slot;
+
+                if (findDefined(&defined, name, label.tk.sz, &slot)) {
+                    continue;
+                }
+
+                // Archives are searched in command line order
+                for (size_t a = 0; a < archiveCount; a++) {
+                    long member = LC3_FindArchiveSymbol(archives[a], name, label.tk.sz);
+
+                    if (member < 0 || archives[a]->labels[member] != NULL) {
+                        continue;
+                    }
+
+                    LC3_Unit *extracted = &units[unitCount++];
+                    extractMember(archives[a], member, extracted, ctx);
+
+                    for (size_t s = 0; s < extracted->symb.sz; s++) {
+                        addDefined(&defined, &extracted->symb.ptr[s]);
+                    }
+
+                    break;
+                }
+            }
+        }
+    }
+
+    vaFree(defined.slots);
+    return unitCount;
+}
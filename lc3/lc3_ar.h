@@ -0,0 +1,45 @@
+/*
+ * Description:
+ * Static archives, bundles of object files with a symbol index so that only the members that are used get linked
+ */
+
+#pragma once
+#include "lc3_asm.h"
+
+#define LC3_ARCHIVE_MAGIC "LC3A"
+
+
+typedef struct LC3_ArchiveMember {
+    uint32_t offset, size; // Byte range of the object file in the archive
+    uint32_t name;         // Offset into the name table
+} LC3_ArchiveMember;
+
+
+typedef struct LC3_Archive {
+    const char *filename;
+    FILE *fp;
+    uint32_t memberCount;
+    uint32_t slotCount;
+    LC3_ArchiveMember *members;
+    uint32_t *slots;  // Name offset + 1 and member for every symbol, 0 if empty
+    String names;     // Null-separated member and symbol names
+    char **labels;    // Name of every extracted member as "archive(member)", NULL if not extracted
+} LC3_Archive;
+
+
+// Checks extension and magic number
+bool LC3_IsArchive(const char *filename);
+
+// Writes all units as members of a new archive, returns false if the file can not be opened
+bool LC3_WriteArchive(size_t unitCount, LC3_Unit *units, const char *filename);
+
+// Opens an archive and reads its index, returns NULL on failure
+LC3_Archive *LC3_OpenArchive(const char *filename);
+void LC3_CloseArchive(LC3_Archive *archive);
+
+// Member defining a symbol, or -1 if no member does
+long LC3_FindArchiveSymbol(const LC3_Archive *archive, const char *name, size_t len);
+
+// Adds members that define a symbol still unresolved by units, until every symbol the archives can provide is defined.
+// units must have room for every member of every archive, returns the new amount of units
+size_t LC3_ExtractMembers(size_t archiveCount, LC3_Archive **archives, size_t unitCount, LC3_Unit *units, LC3_Context *ctx);
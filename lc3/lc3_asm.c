@@ -1,8 +1,13 @@
 #include "lc3_str.h"
 #include "lc3_asm.h"
+#include "lc3_addr.h"
+#include "lc3_cache.h"
 #include "lc3_err.h"
 #include "lc3_instr.h"
 #include "lc3_tk.h"
+#include "lc3_pool.h"
+#include "lc3_state.h"
+#include "lib/va_alloc.h"
 #include <ctype.h>
 #include <string.h>
 #define LC3_DEBUG (false)
@@ -11,6 +16,7 @@
 // String functions
 vaAllocFunction(String, char, newString, ;, va.ptr[0] = '\0')
 vaClearFunction(String, clearString, ;, va->ptr[0] = '\0')
+vaReserveFunction(String, char, reserveString,,)
 
 vaAppendFunction(String, char, addchar,
     // Tomfoolery to make the null terminator exist
@@ -24,26 +30,191 @@ vaAppendFunction(String, char, addchar,
 // String array functions
 vaAllocFunction(StringArray, String, newStringArray, ;, ;)
 vaAppendFunction(StringArray, String, addString, ;, ;)
-vaFreeFunction(StringArray, String, freeStringArray, free(el.ptr), ;, ;)
+vaReserveFunction(StringArray, String, reserveStringArray,,)
+vaFreeFunction(StringArray, String, freeStringArray, vaFree(el.ptr), ;, ;)
 
 // Statement array functions
 vaAllocFunction(StatementArray, Statement, newStatementArray,,)
 vaAppendFunction(StatementArray, const Statement, addStatement,,)
 vaFreeFunction(StatementArray, Statement, freeStatementArray, ;, ;, ;)
 
-// Uhhh
-vaAllocFunction(ObjectSection, ObjectLine, newObjectSection,, va.origin = 0;)
-vaAppendFunction(ObjectSection, const ObjectLine, addObjectLine,,)
+// Object section functions
+vaAllocCapacityFunction(WordArray, uint16_t, newWordArray,,)
+vaAppendFunction(WordArray, uint16_t, addWord,,)
+
+vaAllocCapacityFunction(RelocationArray, Relocation, newRelocationArray,,)
+vaAppendFunction(RelocationArray, const Relocation, addRelocation,,)
+
+vaAllocCapacityFunction(DebugTable, DebugLine, newDebugTable,,)
+vaAppendFunction(DebugTable, const DebugLine, addDebugLine,,)
+vaReserveFunction(DebugTable, DebugLine, reserveDebugTable,,)
 
-// Object line array functions
 vaAllocFunction(ObjectSectionArray, ObjectSection, newObjectSectionArray,,)
 vaAppendFunction(ObjectSectionArray, const ObjectSection, addObjectSection,,)
-vaFreeFunction(ObjectSectionArray, ObjectSection, freeObjectSectionArray, free(el.ptr), ;, ;)
+vaReserveFunction(ObjectSectionArray, ObjectSection, reserveObjectSectionArray,,)
+vaFreeFunction(ObjectSectionArray, ObjectSection, freeObjectSectionArray, vaFree(el.words.ptr); vaFree(el.reloc.ptr); vaFree(el.debug.ptr), ;, ;)
+
+
+// Capacity hints can be 0, arrays need room to grow
+static size_t minCapacity(size_t cap) {
+    return (cap < VA_BASE_CAP) ? VA_BASE_CAP : cap;
+}
+
+
+ObjectSection newObjectSection(size_t words, size_t reloc, size_t debug) {
+    ObjectSection ret = {
+        .origin = 0,
+        .words  = newWordArray(minCapacity(words)),
+        .reloc  = newRelocationArray(minCapacity(reloc)),
+        .debug  = newDebugTable(minCapacity(debug)),
+    };
+
+    return ret;
+}
+
+
+// Allocates empty hash index
+uint32_t *newDebugSlots(size_t cap) {
+    uint32_t *slots = vaMalloc("DebugStrings", cap * sizeof(uint32_t));
+    memset(slots, 0, cap * sizeof(uint32_t));
+    return slots;
+}
+
+
+DebugStrings newDebugStrings() {
+    DebugStrings ret = {
+        .str     = {vaMalloc("DebugStrings", VA_BASE_CAP), 0, VA_BASE_CAP},
+        .slots   = newDebugSlots(VA_BASE_CAP),
+        .slotCap = VA_BASE_CAP,
+        .count   = 0,
+    };
+
+    ret.str.ptr[0] = '\0';
+    return ret;
+}
+
+
+void freeDebugStrings(DebugStrings strings) {
+    vaFree(strings.str.ptr);
+    vaFree(strings.slots);
+}
+
+
+// FNV-1a
+uint32_t hashString(const char *str, size_t len) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+// Appends len bytes (and a terminator) to the table in one copy
+void appendDebugBytes(String *table, const char *str, size_t len) {
+    if (table->sz + len + 1 > table->cap) {
+        while (table->sz + len + 1 > table->cap) {
+            table->cap *= 2;
+        }
+
+        table->ptr = vaRealloc("DebugStrings", table->ptr, table->cap);
+    }
+
+    memcpy(table->ptr + table->sz, str, len);
+    table->sz += len + 1;
+    table->ptr[table->sz - 1] = '\0';
+}
+
+
+// Finds slot that either contains the string or is empty
+uint32_t *findDebugSlot(DebugStrings *strings, const char *str, size_t len, uint32_t hash) {
+    for (size_t i = hash & (strings->slotCap - 1);; i = (i + 1) & (strings->slotCap - 1)) {
+        uint32_t *slot = &strings->slots[i];
+
+        if (*slot == 0) {
+            return slot;
+        }
+
+        const char *current = strings->str.ptr + (*slot - 1);
+
+        if (strncmp(current, str, len) == 0 && current[len] == '\0') {
+            return slot;
+        }
+    }
+}
+
+
+// Doubles the hash index, keeping the string table as is
+void growDebugSlots(DebugStrings *strings) {
+    uint32_t *old = strings->slots;
+    size_t oldCap = strings->slotCap;
+
+    strings->slotCap *= 2;
+    strings->slots = newDebugSlots(strings->slotCap);
+
+    for (size_t i = 0; i < oldCap; i++) {
+        if (old[i] != 0) {
+            const char *str = strings->str.ptr + (old[i] - 1);
+            size_t len = strlen(str);
+            *findDebugSlot(strings, str, len, hashString(str, len)) = old[i];
+        }
+    }
+
+    vaFree(old);
+}
+
+
+// Returns the offset of the string in the debug table, adding it if it was not present yet
+uint32_t internDebugString(DebugStrings *strings, const char *str, size_t len) {
+    if ((strings->count + 1) * 2 > strings->slotCap) {
+        growDebugSlots(strings);
+    }
+
+    uint32_t *slot = findDebugSlot(strings, str, len, hashString(str, len));
+
+    if (*slot == 0) {
+        *slot = strings->str.sz + 1;
+        strings->count++;
+        appendDebugBytes(&strings->str, str, len);
+    }
+
+    return *slot - 1;
+}
+
+
+// Splits line into the word array and (if needed) the relocation and debug tables
+void addObjectLine(LC3_Unit *unit, ObjectSection *section, const ObjectLine obj) {
+    uint16_t index = section->words.sz;
+    addWord(&section->words, obj.instr);
+
+    if (obj.label.tk.sz != 0) {
+        Relocation reloc = {
+            .index = index,
+            .kind  = getRelocationKind(obj.instr),
+            .label = obj.label,
+        };
+
+        addRelocation(&section->reloc, reloc);
+    }
+
+    if (obj.debug.tk.sz != 0) {
+        DebugLine debug = {
+            .index  = index,
+            .offset = internDebugString(&unit->debug, unit->buf.ptr[obj.debug.line].ptr + obj.debug.tk.start, obj.debug.tk.sz),
+        };
+
+        addDebugLine(&section->debug, debug);
+    }
+}
 
 // Symbol table functions
 vaAllocFunction(SymbolTable, Symbol, newSymbolTable,,)
 vaAllocCapacityFunction(SymbolTable, Symbol, newSymbolTableCapacity,,)
 vaAppendFunction(SymbolTable, Symbol, addSymbolHelper,,)
+vaReserveFunction(SymbolTable, Symbol, reserveSymbolTable,,)
 vaFreeFunction(SymbolTable, Symbol, freeSymbolTable,,,)
 
 // Used for interval checking
@@ -52,11 +223,16 @@ vaAllocCapacityFunction(IntervalArray, BufferSegment, newIntervalArray, ;, ;)
 vaAppendFunction(IntervalArray, BufferSegment, addInterval, ;, ;)
 vaFreeFunction(IntervalArray, BufferSegment, freeIntervalArray, ;, ;, ;)
 
-// For sorting the intervals
+// For sorting the intervals by unit (units are stored in a single array), then address
 int intvcmp(const void *iv1, const void *iv2) {
     BufferSegment *t1 = (BufferSegment *)iv1;
     BufferSegment *t2 = (BufferSegment *)iv2;
-    return (t1->tk.start - t2->tk.start != 0) ? t1->tk.start - t2->tk.start : t1->tk.sz - t2->tk.sz;
+
+    if (t1->unit != t2->unit) {
+        return (t1->unit < t2->unit) ? -1 : 1;
+    }
+
+    return (int)t1->tk.start - (int)t2->tk.start;
 }
 
 // Allocates new symbol based on inputs and adds to symbol table
@@ -86,21 +262,21 @@ int tokenCaseCmp(Token t1, Token t2, String s1, String s2) {
 }
 
 
-// Finds label in sorted symbol table. Returns NO_LABEL if not found
-OptInt findSymbol(LC3_Unit *unit, SymbolTable symbols, Token tk, String str) {
-    int low = 0, high = symbols.sz - 1, mid, res;
+// Finds label in sorted symbol table. Returns NULL if not found
+const Symbol *lookupSymbol(const SymbolTable *symbols, Token tk, String str) {
+    long low = 0, high = (long)symbols->sz - 1;
 
     // Perform a binary search
     while (low <= high) {
-        mid = (low + high) / 2;
+        long mid = (low + high) / 2;
 
-        res = tokenCaseCmp(
-            tk, symbols.ptr[mid].loc.tk, 
-            str, symbols.ptr[mid].loc.unit->buf.ptr[symbols.ptr[mid].loc.line]
+        int res = tokenCaseCmp(
+            tk, symbols->ptr[mid].loc.tk, 
+            str, symbols->ptr[mid].loc.unit->buf.ptr[symbols->ptr[mid].loc.line]
         );
 
         if (res == 0) {
-            break;
+            return &symbols->ptr[mid];
         } else if (res > 0) {
             low = mid + 1;
         } else {
@@ -108,9 +284,17 @@ OptInt findSymbol(LC3_Unit *unit, SymbolTable symbols, Token tk, String str) {
         }
     }
 
+    return NULL;
+}
+
+
+// Finds label in sorted symbol table
+OptInt findSymbol(LC3_Unit *unit, SymbolTable symbols, Token tk, String str) {
+    const Symbol *symbol = lookupSymbol(&symbols, tk, str);
+
     OptInt ret = {
-        .value = symbols.ptr[mid].value,
-        .set = !res,
+        .value = (symbol != NULL) ? symbol->value : 0,
+        .set = (symbol != NULL),
     };
 
     return ret;
@@ -151,17 +335,60 @@ void sortSymbolTable(SymbolTable *strarr) {
 }
 
 
+// Position of the first symbol after symbol in the sorted symbols [low, high)
+static size_t upperBound(const Symbol *symbols, size_t low, size_t high, const Symbol *symbol) {
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (symcmp(&symbols[mid], symbol) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+// Few symbols are added at a time, so each is inserted by binary search instead of sorting everything again
+void mergeSymbolTable(SymbolTable *symbols, size_t kept, const SymbolTable *added) {
+    SymbolTable merged = newSymbolTableCapacity(minCapacity(kept + added->sz));
+    size_t from = 0;
+
+    for (size_t i = 0; i < added->sz; i++) {
+        size_t to = upperBound(symbols->ptr, from, kept, &added->ptr[i]);
+
+        memcpy(merged.ptr + merged.sz, symbols->ptr + from, (to - from) * sizeof(Symbol));
+        merged.sz += to - from;
+        merged.ptr[merged.sz++] = added->ptr[i];
+        from = to;
+    }
+
+    memcpy(merged.ptr + merged.sz, symbols->ptr + from, (kept - from) * sizeof(Symbol));
+    merged.sz += kept - from;
+
+    vaFree(symbols->ptr);
+    (*symbols) = merged;
+}
+
+
 LC3_Unit LC3_CreateUnit(LC3_Context *ctx, const char *filename) {
+    vaMemSetOwner(filename);
+
     LC3_Unit ret = {
         .filename = filename,
         .buf   = newStringArray(),
         .obj   = newObjectSectionArray(),
         .symb  = newSymbolTable(),
+        .debug = newDebugStrings(),
+        .diag  = newDiagnosticArray(),
         .upper = newString(),
         .ctx   = ctx,
         .error = false,
     };
 
+    vaMemSetOwner(NULL);
     return ret;
 }
 
@@ -170,7 +397,9 @@ void LC3_DestroyUnit(LC3_Unit unit) {
     freeStringArray(unit.buf);
     freeObjectSectionArray(unit.obj);
     freeSymbolTable(unit.symb);
-    free(unit.upper.ptr);
+    freeDebugStrings(unit.debug);
+    freeDiagnosticArray(unit.diag);
+    vaFree(unit.upper.ptr);
 }
 
 
@@ -188,47 +417,130 @@ void addFileLine(LC3_Unit *unit, String str) {
 }
 
 
-// Reads file into unit buffer
-void readFile(LC3_Unit *unit) {
-    int c;
-    bool inComment = false;
-    FILE *fp = fopen(unit->filename, "r");
+// Copies line into a string with exactly enough room
+String copyLine(const char *str, size_t len) {
+    String ret = {vaMalloc("String", len + 1), len, len + 1};
+    memcpy(ret.ptr, str, len);
+    ret.ptr[len] = '\0';
+    return ret;
+}
 
-    if (fp == NULL || ferror(fp)) {
-        LC3_SimpleError(unit, "failed to open file %s\n", unit->filename);
-        return;
+
+// Reads entire file with as few reads as possible
+String readContents(FILE *fp) {
+    String ret = newString();
+    long size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    size_t count;
+
+    rewind(fp);
+    reserveString(&ret, (size > 0) ? size + 1 : 4096);
+
+    while ((count = fread(ret.ptr + ret.sz, 1, ret.cap - ret.sz - 1, fp)) > 0) {
+        ret.sz += count;
+
+        if (ret.sz + 1 >= ret.cap) {
+            reserveString(&ret, ret.cap * 2);
+        }
     }
 
-    String temp = newString();
+    ret.ptr[ret.sz] = '\0';
+    return ret;
+}
+
+
+size_t sourceLineLength(const char *line, size_t len) {
+    // Don't read comment
+    const char *comment = memchr(line, ';', len);
+    len = (comment != NULL) ? (size_t)(comment - line) : len;
+
+    // Remove trailing whitespace
+    for (; len > 0 && line[len - 1] == ' '; len--);
+    return len;
+}
+
 
-    while ((c = getc(fp)) != EOF) {
-        // Push string onto buf without '\n'
-        if (c == '\n') {
-            // Remove trailing whitespace
-            for (inComment = false; temp.sz > 0 && temp.ptr[temp.sz - 1] == ' '; temp.sz--);
-            addFileLine(unit, temp);
-            temp = newString();
-            continue;
+// Splits text into the lines of unit
+static void readLines(LC3_Unit *unit, const char *text, size_t size) {
+    // Estimate amount of lines and labels, so arrays only need to be allocated once
+    size_t lineCount = 1, labelCount = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        char c = text[i];
+
+        if (i == 0 || text[i - 1] == '\n') {
+            labelCount += (c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != ';' && c != '.');
         }
-        // Mark string as comment
-        else if (c == ';') {
-            inComment = true;
+
+        lineCount += (c == '\n');
+    }
+
+    reserveStringArray(&unit->buf, lineCount);
+    reserveSymbolTable(&unit->symb, labelCount);
+
+    for (size_t start = 0; start < size;) {
+        // Another unit failed
+        if (unit->buf.sz % LC3_CANCEL_CHUNK == 0 && LC3_Cancelled(unit->ctx)) {
+            break;
         }
-        // Don't read comment
-        if (!inComment) {
-            addchar(&temp, c);
+
+        const char *line = text + start;
+        const char *newline = memchr(line, '\n', size - start);
+        size_t end = (newline != NULL) ? (size_t)(newline - text) : size;
+        size_t len = sourceLineLength(line, end - start);
+
+        // Last line is only read if necessary
+        if (newline != NULL || len > 0) {
+            addFileLine(unit, copyLine(line, len));
         }
+
+        start = end + 1;
     }
+}
 
-    // Read last string if necessary
-    if (temp.sz) {
-        addFileLine(unit, temp);
-    } else {
-        free(temp.ptr);
+
+// Points text at the source of unit. Sources given in memory are not read from disk, others are read into contents,
+// which the caller frees. Returns false if the file cannot be opened
+static bool loadSource(LC3_Unit *unit, String *contents, const char **text, size_t *size) {
+    (*contents) = (String){0};
+    (*text) = unit->source;
+    (*size) = unit->sourceSize;
+
+    if (unit->source != NULL) {
+        return true;
     }
 
+    FILE *fp = fopen(unit->filename, "r");
+
+    if (fp == NULL || ferror(fp)) {
+        LC3_SimpleError(unit, "failed to open file %s\n", unit->filename);
+        return false;
+    }
+
+    (*contents) = readContents(fp);
     fclose(fp);
 
+    (*text) = contents->ptr;
+    (*size) = contents->sz;
+    return true;
+}
+
+
+// Reads file into unit buffer
+void readFile(LC3_Unit *unit) {
+    String contents;
+    const char *text;
+    size_t size;
+
+    if (!loadSource(unit, &contents, &text, &size)) {
+        return;
+    }
+
+    if (!LC3_Cancelled(unit->ctx)) {
+        readLines(unit, text, size);
+    }
+
+    vaFree(contents.ptr);
+
 #if (LC3_DEBUG)
     LC3_BeginOutput();
 
@@ -238,236 +550,690 @@ void readFile(LC3_Unit *unit) {
     for (size_t i = 0; i < unit->buf.sz; i++) {
         printf("%3ld|%s\n", i, unit->buf.ptr[i].ptr);
     }
-    printf("--------------------------------------------------------\n");
+    printf("--------------------------------------------------------\n");
+
+    LC3_FinishOutput();
+#endif
+}
+
+
+bool parseStatement(LC3_Unit *unit, size_t i, Statement *stmt) {
+    String current = unit->buf.ptr[i];
+    Token tkn = getToken(0, current);
+
+    memset(stmt, 0, sizeof(Statement));
+    stmt->line = i;
+
+    // No tokens in line
+    if (!validToken(tkn, current)) {
+        return false;
+    }
+
+    stmt->instr = getInstructionIndex(tkn, current);
+
+    if (stmt->instr == NULL) {
+        // Statement starts with a label
+        stmt->label = tkn;
+
+        // Token needs to be key
+        switch (getTokenType(tkn, current)) {
+            case TOKEN_PSEUD:
+                LC3_TokenError(unit, i, tkn, "invalid assembler directive", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+                break;
+            case TOKEN_NUM:
+                LC3_TokenError(unit, i, tkn, "label can't be number", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+                break;
+            case TOKEN_REG:
+                LC3_TokenError(unit, i, tkn, "label can't be register", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+                break;
+            default:
+                break;
+        }
+
+        // Check if there are other tokens
+        tkn = getToken(tkn.start + tkn.sz, current);
+
+        // Label-statement
+        if (!validToken(tkn, current)) {
+            stmt->type = STMT_LABEL;
+            return false;
+        }
+
+        // This should be the actual instruction
+        stmt->instr = getInstructionIndex(tkn, current);
+
+        if (stmt->instr == NULL) {
+            // Invalid instruction!
+            LC3_TokenError(unit , i, tkn, "invalid instruction", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+            return false;
+        }
+    }
+
+    stmt->type = (stmt->instr->instr < INSTR_AS_ADD) ? STMT_PSEUD : STMT_INSTR;
+    stmt->orig = tkn;
+
+    // Check if the amount of tokens is right, arguments of the wrong type can not be translated
+    for (uint8_t j = 0; j < stmt->instr->argc; j++) {
+        tkn = getToken(tkn.start + tkn.sz, current);
+
+        if (!validToken(tkn, current)) {
+            LC3_TokenError(unit , i, tkn, "unexpected end of line", LC3_ERR_SHOW_LINE);
+            return false;
+        }
+        if ((getTokenType(tkn, current) & stmt->instr->argl[j]) == 0) {
+            LC3_TokenError(unit , i, tkn, "unexpected token", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+            return false;
+        }
+        stmt->args[j] = tkn;
+    }
+
+    // Check for too many tokens
+    tkn = getToken(tkn.start + tkn.sz, current);
+
+    if (validToken(tkn, current)) {
+        LC3_TokenError(unit , i, tkn, "unexpected extra argument", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+    }
+
+    return true;
+}
+
+
+void objectify(LC3_Unit *unit) {
+    Statement stmt;
+    OptInt addr = {0, false};
+
+    // Tokenize and create statements
+    for (size_t i = 0; !unit->error && i < unit->buf.sz; i++) {
+        // Another unit failed
+        if (i % LC3_CANCEL_CHUNK == 0 && LC3_Cancelled(unit->ctx)) {
+            break;
+        }
+
+        bool valid = parseStatement(unit, i, &stmt);
+
+        if (stmt.label.sz > 0) {
+            addSymbol(unit, i, stmt.label, unit->buf.ptr[i], addr.value);
+        }
+
+        // Finally, we can add the (validated) statement to the list
+        if (valid) {
+            interpretStatement(unit, stmt, &addr);
+        }
+    }
+
+    // Check for duplicate symbols
+    sortSymbolTable(&unit->symb);
+
+    for (size_t i = 1; i < unit->symb.sz; i++) {
+        Symbol current = unit->symb.ptr[i];
+
+        if (tokenCaseCmp(
+                current.loc.tk,
+                unit->symb.ptr[i - 1].loc.tk,
+                unit->buf.ptr[current.loc.line],
+                unit->buf.ptr[unit->symb.ptr[i - 1].loc.line]
+            ) == 0) {
+            LC3_TokenError(unit, current.loc.line, current.loc.tk, "redefinition of label", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+        }
+    }
+
+#if (LC3_DEBUG == true)
+    LC3_BeginOutput();
+
+    printf("--------------------------------------------------------\n");
+    printf("Symbol table: (file \"%s\" : thread %ld)\n", unit->filename, pthread_self());
+    printf("--------------------------------------------------------\n");
+
+
+    for (size_t i = 0; i < unit->symb.sz; i++) {
+        char *tks = tokenString(unit->symb.ptr[i].loc.tk, unit->buf.ptr[unit->symb.ptr[i].loc.line]);
+        printf("%4X | %s\n", (uint16_t)unit->symb.ptr[i].value, tks);
+        free(tks);
+    }
+
+    printf("--------------------------------------------------------\n");
+    printf("Object table: (file \"%s\" : thread %ld)\n", unit->filename, pthread_self());
+    printf("--------------------------------------------------------\n");
+
+    for (size_t section = 0; !unit->error && section < unit->obj.sz; section++) {
+        ObjectSection current = unit->obj.ptr[section];
+
+        for (size_t i = 0; i < current.words.sz; i++) {
+            printf("%04X | 0x%04X\n", (uint16_t)(current.origin + i), current.words.ptr[i]);
+        }
+
+        for (size_t i = 0; i < current.reloc.sz; i++) {
+            Relocation reloc = current.reloc.ptr[i];
+            char *tk = tokenString(reloc.label.tk, unit->buf.ptr[reloc.label.line]);
+            printf("%04X | %c [%s]\n", (uint16_t)(current.origin + reloc.index), reloc.kind, tk);
+            free(tk);
+        }
+
+        for (size_t i = 0; i < current.debug.sz; i++) {
+            DebugLine debug = current.debug.ptr[i];
+            printf("%04X | \"%s\"\n", (uint16_t)(current.origin + debug.index), unit->debug.str.ptr + debug.offset);
+        }
+    }
+
+    LC3_FinishOutput();
+#endif
+}
+
+
+bool isObjectFile(const char *filename) {
+    char *ext = strchr(filename, '.');
+
+    if (ext && strlen(ext) == 4 && strcmp(ext, ".obj") == 0) {
+        FILE *fp = fopen(filename, "rb");
+        char mgc[4] = {0};
+
+        // Missing files are reported when they are read as source
+        if (fp == NULL) {
+            return false;
+        }
+
+        fread(&mgc, 1, 4, fp);
+        fclose(fp);
+        return (memcmp(mgc, MAGIC_NUM, 4) == 0);
+    }
+
+    return 0;
+}
+
+
+// Frees every source line that no symbol or relocation refers to, the rest is only needed for names
+void releaseSource(LC3_Unit *unit) {
+    bool *keep = vaMalloc("StringArray", (unit->buf.sz + 1) * sizeof(bool));
+    memset(keep, 0, (unit->buf.sz + 1) * sizeof(bool));
+
+    for (size_t i = 0; i < unit->symb.sz; i++) {
+        keep[unit->symb.ptr[i].loc.line] = true;
+    }
+
+    for (size_t section = 0; section < unit->obj.sz; section++) {
+        for (size_t i = 0; i < unit->obj.ptr[section].reloc.sz; i++) {
+            keep[unit->obj.ptr[section].reloc.ptr[i].label.line] = true;
+        }
+    }
+
+    for (size_t i = 0; i < unit->buf.sz; i++) {
+        if (!keep[i]) {
+            vaFree(unit->buf.ptr[i].ptr);
+            unit->buf.ptr[i] = (String){0};
+        }
+    }
+
+    vaFree(keep);
+    vaFree(unit->upper.ptr);
+    unit->upper = (String){0};
+}
+
+
+// Reads and objectifies unit, unless the object of the same text is cached
+static void assembleCached(LC3_Unit *unit) {
+    String contents;
+    const char *text;
+    size_t size;
+
+    if (!loadSource(unit, &contents, &text, &size)) {
+        return;
+    }
+
+    if (!LC3_LoadCached(unit, text, size)) {
+        readLines(unit, text, size);
+
+        if (!unit->error && !LC3_Cancelled(unit->ctx)) {
+            objectify(unit);
+        }
+
+        // Cancelled units may not be complete
+        if (!unit->error && !LC3_Cancelled(unit->ctx)) {
+            LC3_StoreCached(unit, text, size);
+        }
+    }
+
+    vaFree(contents.ptr);
+}
+
+
+// First step of the assembly
+void LC3_AssembleUnit(LC3_Unit *unit) {
+    // Units that have not started yet are skipped after an error
+    if (LC3_Cancelled(unit->ctx)) {
+        return;
+    }
+
+    vaMemSetOwner(unit->filename);
+
+    if (unit->source == NULL && isObjectFile(unit->filename)) {
+        LC3_ReadFromFile(unit);
+    } else if (LC3_CacheEnabled(unit->ctx)) {
+        assembleCached(unit);
+    } else {
+        // Read file contents into unit
+        readFile(unit);
+    
+        // Convert contents into a series of statements (and validate those) - Also constructs symbol table
+        if (!unit->error && !LC3_Cancelled(unit->ctx)) {
+            objectify(unit);
+        }
+    }
+
+    // Streaming links only keep what linking needs
+    if (!unit->error && unit->ctx != NULL && unit->ctx->streamLink) {
+        releaseSource(unit);
+    }
+
+    vaMemSetOwner(NULL);
+}
+
+
+size_t LC3_WorkerCount(const LC3_Context *ctx) {
+    return (ctx != NULL && ctx->workers > 0) ? ctx->workers : LC3_ProcessorCount();
+}
+
+
+static void assembleUnitJob(void *data, size_t index, size_t worker) {
+    LC3_AssembleUnit(&((LC3_Unit *)data)[index]);
+}
+
+
+// Estimated cost of assembling a unit, its file size. Only the inode is read, the file is opened by the worker
+static uint64_t unitCost(const LC3_Unit *unit) {
+    return (unit->source != NULL) ? unit->sourceSize : LC3_FileSize(unit->filename);
+}
+
+
+static void printWorkerReport(size_t workerCount, const LC3_WorkerStats *stats) {
+    double busy = 0, idle = 0;
+
+    printf("%-8s %8s %8s %12s %12s\n", "worker", "jobs", "stolen", "busy (ms)", "idle (ms)");
+
+    for (size_t i = 0; i < workerCount; i++) {
+        printf("%-8zu %8zu %8zu %12.3f %12.3f\n", i, stats[i].jobs, stats[i].stolen, stats[i].busy * 1e3, stats[i].idle * 1e3);
+        busy += stats[i].busy;
+        idle += stats[i].idle;
+    }
+
+    printf("%-8s %8s %8s %12.3f %12.3f\n", "total", "", "", busy * 1e3, idle * 1e3);
+}
+
+
+void LC3_AssembleUnits(size_t unitCount, LC3_Unit *units) {
+    if (unitCount == 0) {
+        return;
+    }
+
+    // Largest files are started first, so a single big unit does not end up holding up the others at the end
+    size_t workerCount = LC3_WorkerCount(units[0].ctx);
+    uint64_t *costs = vaMalloc("Worker", unitCount * sizeof(uint64_t));
+    LC3_WorkerStats *stats = vaMalloc("Worker", workerCount * sizeof(LC3_WorkerStats));
+
+    for (size_t i = 0; i < unitCount; i++) {
+        costs[i] = unitCost(&units[i]);
+    }
+
+    workerCount = LC3_RunWeightedJobs(unitCount, workerCount, assembleUnitJob, units, costs, stats);
+
+    // Errors are shown in unit order, no matter which worker finished first
+    for (size_t i = 0; i < unitCount; i++) {
+        LC3_FlushDiagnostics(&units[i]);
+    }
+
+    if (units[0].ctx != NULL && units[0].ctx->workerReport) {
+        printWorkerReport(workerCount, stats);
+    }
+
+    vaFree(stats);
+    vaFree(costs);
+}
+
+
+// Shared state for assembling a selection of units in parallel
+typedef struct SelectedJob {
+    LC3_Unit *units;
+    const size_t *list;
+} SelectedJob;
+
+
+static void assembleSelectedJob(void *data, size_t index, size_t worker) {
+    SelectedJob *job = data;
+    LC3_AssembleUnit(&job->units[job->list[index]]);
+}
+
+
+void LC3_AssembleSelected(LC3_Unit *units, const size_t *list, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    SelectedJob job = {units, list};
+    size_t workerCount = LC3_WorkerCount(units[list[0]].ctx);
+    LC3_RunJobs(count, (workerCount > count) ? count : workerCount, assembleSelectedJob, &job);
+
+    for (size_t i = 0; i < count; i++) {
+        LC3_FlushDiagnostics(&units[list[i]]);
+    }
+}
+
+
+// Resolve symbols in a parsed unit
+void resolveSymbols(LC3_Unit *unit, const SymbolTable *symbols, IntervalArray *sections) {
+    for (size_t section = 0; section < unit->obj.sz; section++) {
+        BufferSegment addr = {
+            .line = 0,
+            .tk   = {unit->obj.ptr[section].origin, unit->obj.ptr[section].origin},
+            .unit = unit,
+        };
+
+        ObjectSection *current = &unit->obj.ptr[section];
+
+        // Only words referencing a label need to be visited
+        for (size_t i = 0; !unit->error && i < current->reloc.sz; i++) {
+            Relocation *reloc = &current->reloc.ptr[i];
+            const Symbol *label = lookupSymbol(symbols, reloc->label.tk, unit->buf.ptr[reloc->label.line]);
+
+            if (label == NULL) {
+                LC3_linkerError(unit, "unable to determine address for label", reloc->label.tk, reloc->label.line);
+                continue;
+            }
+
+            reloc->value = label->value;
+            resolveInstruction(unit, current, reloc, label->value);
+        }
+
+        addr.tk.sz += current->words.sz;
+
+        if (!unit->error && addr.tk.start != addr.tk.sz) {
+            addInterval(sections, addr);
+        }
+    }
+}
+
+
+// Writes units of a streaming link in order, as soon as they and all units before them are resolved
+typedef struct StreamWriter {
+    FILE *fp;
+    pthread_mutex_t mutex;
+    bool *resolved;
+    size_t next;
+} StreamWriter;
+
+
+// Shared state for resolving units in parallel
+typedef struct ResolveJob {
+    LC3_Unit *units;
+    size_t unitCount;
+    const SymbolTable *symbols;
+    IntervalArray *sections; // One per worker
+    StreamWriter *writer;    // NULL if the units are written afterwards
+} ResolveJob;
+
+
+// Frees the words, relocations and debug info of a written unit, section sizes are kept for the link map
+void releaseSections(LC3_Unit *unit) {
+    for (size_t section = 0; section < unit->obj.sz; section++) {
+        ObjectSection *current = &unit->obj.ptr[section];
+
+        vaFree(current->words.ptr);
+        vaFree(current->reloc.ptr);
+        vaFree(current->debug.ptr);
+
+        current->words.ptr = NULL;
+        current->reloc = (RelocationArray){0};
+        current->debug = (DebugTable){0};
+    }
+
+    freeDebugStrings(unit->debug);
+    unit->debug = (DebugStrings){0};
+}
+
+
+void streamResolvedUnits(ResolveJob *job, size_t index) {
+    StreamWriter *writer = job->writer;
+    pthread_mutex_lock(&writer->mutex);
+    writer->resolved[index] = true;
+
+    // Output stops at the first error, the file is removed afterwards anyway
+    while (writer->next < job->unitCount && writer->resolved[writer->next]) {
+        LC3_Unit *unit = &job->units[writer->next];
+
+        if (!unit->error && !LC3_HasError(unit->ctx)) {
+            LC3_WriteExecutableUnit(unit, writer->fp, (writer->next == 0));
+        }
+
+        releaseSections(unit);
+        writer->next++;
+    }
 
-    LC3_FinishOutput();
-#endif
+    pthread_mutex_unlock(&writer->mutex);
 }
 
 
-void objectify(LC3_Unit *unit) {
-    Statement stmt;
-    OptInt addr = {0, false};
-
-    // Tokenize and create statements
-    for (size_t i = 0; !unit->error && i < unit->buf.sz; i++) {
-        String current = unit->buf.ptr[i];
-        Token tkn = getToken(0, current);
+void resolveUnitJob(void *data, size_t index, size_t worker) {
+    ResolveJob *job = data;
 
-        // No tokens in line
-        if (!validToken(tkn, current)) {
-            continue;
-        }
-
-        memset(&stmt, 0, sizeof(Statement));
-        stmt.line = i;
-        stmt.instr = getInstructionIndex(tkn, current);
-
-        if (stmt.instr == NULL) {
-            // Statement starts with a label
-            stmt.label = tkn;
-            addSymbol(unit, i, tkn, current, addr.value);
-
-            // Token needs to be key
-            switch (getTokenType(tkn, current)) {
-                case TOKEN_PSEUD:
-                    LC3_TokenError(unit, i, tkn, "invalid assembler directive", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
-                    break;
-                case TOKEN_NUM:
-                    LC3_TokenError(unit, i, tkn, "label can't be number", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
-                    break;
-                case TOKEN_REG:
-                    LC3_TokenError(unit, i, tkn, "label can't be register", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
-                    break;
-                default:
-                    break;
-            }
+    if (!LC3_Cancelled(job->units[index].ctx)) {
+        resolveSymbols(&job->units[index], job->symbols, &job->sections[worker]);
+    }
 
-            // Check if there are other tokens
-            tkn = getToken(tkn.start + tkn.sz, current);
+    if (job->writer != NULL) {
+        streamResolvedUnits(job, index);
+    }
+}
 
-            // Label-statement
-            if (!validToken(tkn, current)) {
-                stmt.type = STMT_LABEL;
-                continue;
-            }
 
-            // This should be the actual instruction
-            stmt.instr = getInstructionIndex(tkn, current);
+// Section in the address space, for finding which section a label points into
+typedef struct SectionRef {
+    uint32_t start, end; // [start, end)
+    uint32_t maxEnd; // Highest end of this and all earlier sections
+    size_t unit, section;
+    size_t index; // Position in unit order
+} SectionRef;
 
-            if (stmt.instr == NULL) {
-                // Invalid instruction!
-                LC3_TokenError(unit , i, tkn, "invalid instruction", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
-                continue;
-            }
-        }
 
-        stmt.type = (stmt.instr->instr < INSTR_AS_ADD) ? STMT_PSEUD : STMT_INSTR;
-        stmt.orig = tkn;
+int sectionRefCmp(const void *r1, const void *r2) {
+    const SectionRef *s1 = r1, *s2 = r2;
+    return (s1->start != s2->start) ? ((s1->start < s2->start) ? -1 : 1) : ((s1->index < s2->index) ? -1 : 1);
+}
 
-        // Check if the amount of tokens is right
-        for (uint8_t j = 0; j < stmt.instr->argc; j++) {
-            tkn = getToken(tkn.start + tkn.sz, current);
 
-            if (!validToken(tkn, current)) {
-                LC3_TokenError(unit , i, tkn, "unexpected end of line", LC3_ERR_SHOW_LINE);
-            }
-            if ((getTokenType(tkn, current) & stmt.instr->argl[j]) == 0) {
-                LC3_TokenError(unit , i, tkn, "unexpected token", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
-            }
-            stmt.args[j] = tkn;
-        }
+// Marks the section containing addr as reached, and pushes it if it was not reached before
+void reachAddress(SectionRef *refs, size_t count, uint16_t addr, bool *reached, size_t *stack, size_t *top) {
+    size_t low = 0, high = count;
 
-        // Check for too many tokens
-        tkn = getToken(tkn.start + tkn.sz, current);
+    // First section starting after addr
+    while (low < high) {
+        size_t mid = (low + high) / 2;
 
-        if (validToken(tkn, current)) {
-            LC3_TokenError(unit , i, tkn, "unexpected extra argument", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+        if (refs[mid].start <= addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
+    }
 
-        // Finally, we can add the (validated) statement to the list
-        interpretStatement(unit, stmt, &addr);
+    // Sections can still overlap at this point, so check every earlier section that could contain addr
+    for (size_t i = low; i-- > 0 && refs[i].maxEnd > addr;) {
+        if (addr < refs[i].end && !reached[refs[i].index]) {
+            reached[refs[i].index] = true;
+            stack[(*top)++] = i;
+        }
     }
+}
 
-    // Check for duplicate symbols
-    sortSymbolTable(&unit->symb);
 
-    for (size_t i = 1; i < unit->symb.sz; i++) {
-        Symbol current = unit->symb.ptr[i];
+// Drops sections that can not be reached through label references from the entry section (the first section of the
+// first unit) or from sections in system space, which are entered through vectors instead of labels
+void collectSections(size_t unitCount, LC3_Unit *units, size_t totalSegments) {
+    SectionRef *refs = vaMalloc("IntervalArray", (totalSegments + 1) * sizeof(SectionRef));
+    size_t *stack = vaMalloc("IntervalArray", (totalSegments + 1) * sizeof(size_t));
+    bool *reached = vaMalloc("IntervalArray", (totalSegments + 1) * sizeof(bool));
+    size_t count = 0, top = 0;
 
-        if (tokenCaseCmp(
-                current.loc.tk,
-                unit->symb.ptr[i - 1].loc.tk,
-                unit->buf.ptr[current.loc.line],
-                unit->buf.ptr[unit->symb.ptr[i - 1].loc.line]
-            ) == 0) {
-            LC3_TokenError(unit, current.loc.line, current.loc.tk, "redefinition of label", LC3_ERR_SHOW_LINE | LC3_ERR_SHOW_TK);
+    for (size_t i = 0; i < unitCount; i++) {
+        for (size_t section = 0; section < units[i].obj.sz; section++) {
+            ObjectSection *current = &units[i].obj.ptr[section];
+            SectionRef ref = {current->origin, current->origin + current->words.sz, 0, i, section, count};
+            reached[count] = false;
+            refs[count++] = ref;
         }
     }
 
-#if (LC3_DEBUG == true)
-    LC3_BeginOutput();
-
-    printf("--------------------------------------------------------\n");
-    printf("Symbol table: (file \"%s\" : thread %ld)\n", unit->filename, pthread_self());
-    printf("--------------------------------------------------------\n");
+    qsort(refs, count, sizeof(SectionRef), sectionRefCmp);
 
+    for (size_t i = 0; i < count; i++) {
+        refs[i].maxEnd = (i > 0 && refs[i - 1].maxEnd > refs[i].end) ? refs[i - 1].maxEnd : refs[i].end;
 
-    for (size_t i = 0; i < unit->symb.sz; i++) {
-        char *tks = tokenString(unit->symb.ptr[i].loc.tk, unit->buf.ptr[unit->symb.ptr[i].loc.line]);
-        printf("%4X | %s\n", (uint16_t)unit->symb.ptr[i].value, tks);
-        free(tks);
+        if (refs[i].index == 0 || refs[i].start < LC3_USER_SPACE) {
+            reached[refs[i].index] = true;
+            stack[top++] = i;
+        }
     }
 
-    printf("--------------------------------------------------------\n");
-    printf("Object table: (file \"%s\" : thread %ld)\n", unit->filename, pthread_self());
-    printf("--------------------------------------------------------\n");
+    while (top > 0) {
+        SectionRef ref = refs[stack[--top]];
+        ObjectSection *current = &units[ref.unit].obj.ptr[ref.section];
 
-    for (int i = 0; !unit->error && i < unit->obj.ptr[0].sz; i++) {
-        ObjectLine obj = unit->obj.ptr[0].ptr[i];
+        for (size_t i = 0; i < current->reloc.sz; i++) {
+            reachAddress(refs, count, current->reloc.ptr[i].value, reached, stack, &top);
+        }
+    }
 
-        char *tk = tokenString(obj.label.tk, unit->buf.ptr[obj.label.line]);
-        char *db = tokenString(obj.debug.tk, unit->buf.ptr[obj.debug.line]);
+    // Remove unreached sections, keeping the order of the others
+    size_t index = 0, removed = 0, words = 0;
 
-        printf("%3d | 0x%04X [%s] \"%s\"\n", i, obj.instr, tk, db);
+    for (size_t i = 0; i < unitCount; i++) {
+        ObjectSectionArray *obj = &units[i].obj;
+        size_t kept = 0;
 
-        free(tk);
-        free(db);
-    }
+        for (size_t section = 0; section < obj->sz; section++, index++) {
+            ObjectSection current = obj->ptr[section];
 
-    LC3_FinishOutput();
-#endif
-}
+            if (reached[index]) {
+                obj->ptr[kept++] = current;
+                continue;
+            }
 
+            printf("\x1b[1m%s:\x1b[0m removed section x%04X-x%04X (%zu word%s)\n",
+                units[i].filename, current.origin, (uint16_t)(current.origin + current.words.sz - 1), current.words.sz, (current.words.sz == 1) ? "" : "s");
 
-bool isObjectFile(const char *filename) {
-    char *ext = strchr(filename, '.');
+            removed++;
+            words += current.words.sz;
+            vaFree(current.words.ptr);
+            vaFree(current.reloc.ptr);
+            vaFree(current.debug.ptr);
+        }
 
-    if (ext && strlen(ext) == 4 && strcmp(ext, ".obj") == 0) {
-        FILE *fp = fopen(filename, "rb");
-        char mgc[4];
-        fread(&mgc, 1, 4, fp);
-        fclose(fp);
-        return (memcmp(mgc, MAGIC_NUM, 4) == 0);
+        obj->sz = kept;
     }
 
-    return 0;
+    // Nothing is shown when every section is kept, so normal links stay quiet
+    if (removed > 0) {
+        printf("\x1b[1mgc-sections:\x1b[0m removed %zu of %zu sections, reclaimed %zu word%s\n", removed, count, words, (words == 1) ? "" : "s");
+    }
+
+    vaFree(reached);
+    vaFree(stack);
+    vaFree(refs);
 }
 
 
-// First step of the assembly
-void LC3_AssembleUnit(LC3_Unit *unit) {
-    if (isObjectFile(unit->filename)) {
-        LC3_ReadFromFile(unit);
-    } else {
-        // Read file contents into unit
-        readFile(unit);
-    
-        // Convert contents into a series of statements (and validate those) - Also constructs symbol table
-        if (!unit->error && (unit->ctx == NULL ? true : !unit->ctx->error)) {
-            objectify(unit);
-        }
-    }
+static void writeSymbolName(FILE *fp, const Symbol *symbol, int width) {
+    fwrite(symbol->loc.unit->buf.ptr[symbol->loc.line].ptr + symbol->loc.tk.start, 1, symbol->loc.tk.sz, fp);
+    fprintf(fp, "%*s", (width > symbol->loc.tk.sz) ? width - symbol->loc.tk.sz : 1, "");
 }
 
 
-void *LC3_AssembleUnit_Threaded(void *unit) {
-    LC3_AssembleUnit((LC3_Unit *)unit);
-    return NULL;
-}
+// Writes sections, symbols (by address, then name), unit totals and overlaps, symbols has to be sorted by name
+void writeLinkMap(const char *filename, size_t unitCount, LC3_Unit *units, const SymbolTable *symbols, const LC3_OverlapArray *overlaps,
+                  const IntervalArray *sections) {
+    FILE *fp = fopen(filename, "w");
 
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+        return;
+    }
 
-void LC3_AssembleUnits(size_t unitCount, LC3_Unit *units) {
-    pthread_t *threads = malloc(unitCount * sizeof(pthread_t));
+    fprintf(fp, "Sections\n\n%-8s %-8s %-8s %s\n", "origin", "end", "size", "unit");
 
     for (size_t i = 0; i < unitCount; i++) {
-        pthread_create(&threads[i], NULL, LC3_AssembleUnit_Threaded, &units[i]);
+        for (size_t section = 0; section < units[i].obj.sz; section++) {
+            ObjectSection *current = &units[i].obj.ptr[section];
+            uint16_t end = current->origin + current->words.sz - (current->words.sz > 0);
+
+            fprintf(fp, "x%04X    x%04X    %-8zu %s\n", current->origin, end, current->words.sz, units[i].filename);
+        }
     }
 
-    for (size_t i = 0; i < unitCount; i++) {
-        pthread_join(threads[i], NULL);
+    // Stable counting sort on address keeps the name order within an address
+    uint32_t *start = vaMalloc("SymbolTable", (0x10000 + 1) * sizeof(uint32_t));
+    const Symbol **byAddress = vaMalloc("SymbolTable", (symbols->sz + 1) * sizeof(Symbol *));
+
+    memset(start, 0, (0x10000 + 1) * sizeof(uint32_t));
+
+    for (size_t i = 0; i < symbols->sz; i++) {
+        start[(uint16_t)symbols->ptr[i].value + 1]++;
     }
 
-    free(threads);
-}
+    for (size_t i = 1; i <= 0x10000; i++) {
+        start[i] += start[i - 1];
+    }
 
+    for (size_t i = 0; i < symbols->sz; i++) {
+        byAddress[start[(uint16_t)symbols->ptr[i].value]++] = &symbols->ptr[i];
+    }
 
-// Resolve symbols in a parsed unit
-void resolveSymbols(LC3_Unit *unit, const SymbolTable *symbols, IntervalArray *sections) {
-    for (size_t section = 0; section < unit->obj.sz; section++) {
-        BufferSegment addr = {
-            .line = 0,
-            .tk   = {unit->obj.ptr[section].origin, unit->obj.ptr[section].origin},
-            .unit = unit,
-        };
+    fprintf(fp, "\nSymbols\n\n%-8s %-24s %s\n", "address", "name", "unit");
 
-        for (size_t line = 0; !unit->error && line < unit->obj.ptr[section].sz; line++, addr.tk.sz++) {
-            ObjectLine *current = &unit->obj.ptr[section].ptr[line];
+    for (size_t i = 0; i < symbols->sz; i++) {
+        fprintf(fp, "x%04X    ", (uint16_t)byAddress[i]->value);
+        writeSymbolName(fp, byAddress[i], 24);
+        fprintf(fp, " %s\n", byAddress[i]->loc.unit->filename);
+    }
 
-            if (current->label.tk.sz != 0) {
-                OptInt label = findSymbol(unit, *symbols, current->label.tk, unit->buf.ptr[current->label.line]);
+    fprintf(fp, "\nUnits\n\n%-8s %-8s %-8s %s\n", "words", "sections", "symbols", "unit");
+    size_t totals[3] = {0};
 
-                if (!label.set) {
-                    label.value = 0;
-                    LC3_linkerError(unit, "unable to determine address for label", current->label.tk, current->label.line);
-                    continue;
-                }
+    for (size_t i = 0; i < unitCount; i++) {
+        size_t words = 0;
 
-                resolveInstruction(unit, current, addr.tk.sz, label.value);
-                current->label.tk.sz = 0;
-            }
+        for (size_t section = 0; section < units[i].obj.sz; section++) {
+            words += units[i].obj.ptr[section].words.sz;
         }
 
-        if (addr.tk.start != addr.tk.sz) {
-            addInterval(sections, addr);
+        fprintf(fp, "%-8zu %-8zu %-8zu %s\n", words, units[i].obj.sz, units[i].symb.sz, units[i].filename);
+        totals[0] += words;
+        totals[1] += units[i].obj.sz;
+        totals[2] += units[i].symb.sz;
+    }
+
+    fprintf(fp, "%-8zu %-8zu %-8zu (total)\n", totals[0], totals[1], totals[2]);
+
+    if (overlaps->sz > 0) {
+        fprintf(fp, "\nOverlaps\n\n%-8s %-8s %s\n", "start", "end", "units");
+
+        for (size_t i = 0; i < overlaps->sz; i++) {
+            LC3_Overlap overlap = overlaps->ptr[i];
+            fprintf(fp, "x%04X    x%04X    %s, %s\n", overlap.start, overlap.end,
+                sections->ptr[overlap.owner].unit->filename, sections->ptr[overlap.claimant].unit->filename);
         }
     }
+
+    fclose(fp);
+    vaFree(byAddress);
+    vaFree(start);
 }
 
 
-// Second step - performs linking too
-void LC3_LinkUnits(size_t unitCount, LC3_Unit *units) {
-    // Construct the large symbol table
+// Second step - performs linking too, units are written while linking if writer is set
+void linkUnits(size_t unitCount, LC3_Unit *units, const SymbolTable *sorted, StreamWriter *writer) {
+    // The context comes from the first unit
+    if (unitCount == 0) {
+        return;
+    }
+
+    // Construct the large symbol table, unless the caller already keeps it
     size_t totalCount = 0;
     size_t totalSegments = 0;
 
@@ -476,15 +1242,17 @@ void LC3_LinkUnits(size_t unitCount, LC3_Unit *units) {
         totalSegments += units[i].obj.sz;
     }
 
-    SymbolTable combined = newSymbolTableCapacity(totalCount);
+    SymbolTable combined = (sorted != NULL) ? (*sorted) : newSymbolTableCapacity(totalCount);
 
-    for (size_t i = 0; i < unitCount; i++) {
+    for (size_t i = 0; sorted == NULL && i < unitCount; i++) {
         memcpy(combined.ptr + combined.sz, units[i].symb.ptr, units[i].symb.sz * sizeof(Symbol));
         combined.sz += units[i].symb.sz;
     }
 
     // Another redefinition check
-    sortSymbolTable(&combined);
+    if (sorted == NULL) {
+        sortSymbolTable(&combined);
+    }
 
     for (size_t i = 1; i < combined.sz; i++) {
         Symbol current = combined.ptr[i];
@@ -496,7 +1264,9 @@ void LC3_LinkUnits(size_t unitCount, LC3_Unit *units) {
                 combined.ptr[i - 1].loc.unit->buf.ptr[combined.ptr[i - 1].loc.line]
             ) == 0) {
             LC3_linkerError(current.loc.unit, "redefinition of label", current.loc.tk, current.loc.line);
+            LC3_FlushDiagnostics(current.loc.unit);
             LC3_linkerError(combined.ptr[i - 1].loc.unit, "first defined here", combined.ptr[i - 1].loc.tk, combined.ptr[i - 1].loc.line);
+            LC3_FlushDiagnostics(combined.ptr[i - 1].loc.unit);
         }
     }
 
@@ -516,13 +1286,60 @@ void LC3_LinkUnits(size_t unitCount, LC3_Unit *units) {
 
     LC3_FinishOutput();
 #endif
-    IntervalArray sections = newIntervalArray(totalSegments);
+    // Units only write to their own sections, so they can be resolved in parallel
+    size_t workerCount = LC3_WorkerCount(units[0].ctx);
+    workerCount = (workerCount > unitCount) ? unitCount : workerCount;
+
+    ResolveJob job = {
+        .units     = units,
+        .unitCount = unitCount,
+        .symbols   = &combined,
+        .sections  = vaMalloc("IntervalArray", workerCount * sizeof(IntervalArray)),
+        .writer    = writer,
+    };
+
+    for (size_t i = 0; i < workerCount; i++) {
+        job.sections[i] = newIntervalArray(VA_BASE_CAP);
+    }
+
+    LC3_RunJobs(unitCount, workerCount, resolveUnitJob, &job);
+
+    // Merge intervals of all workers, and show errors in unit order
+    IntervalArray sections = newIntervalArray(totalSegments + 1);
+
+    for (size_t i = 0; i < workerCount; i++) {
+        memcpy(sections.ptr + sections.sz, job.sections[i].ptr, job.sections[i].sz * sizeof(BufferSegment));
+        sections.sz += job.sections[i].sz;
+        freeIntervalArray(job.sections[i]);
+    }
+
+    vaFree(job.sections);
 
     for (size_t i = 0; i < unitCount; i++) {
-        resolveSymbols(&units[i], &combined, &sections);
+        LC3_FlushDiagnostics(&units[i]);
+    }
+
+    // Unreferenced sections are dropped before they can cause overlaps
+    if (writer == NULL && unitCount > 0 && units[0].ctx != NULL && units[0].ctx->gcSections && !units[0].ctx->error) {
+        collectSections(unitCount, units, totalSegments);
+        sections.sz = 0;
+
+        for (size_t i = 0; i < unitCount; i++) {
+            for (size_t section = 0; section < units[i].obj.sz; section++) {
+                BufferSegment addr = {
+                    .line = 0,
+                    .tk   = {units[i].obj.ptr[section].origin, units[i].obj.ptr[section].origin + units[i].obj.ptr[section].words.sz},
+                    .unit = &units[i],
+                };
+
+                if (addr.tk.start != addr.tk.sz) {
+                    addInterval(&sections, addr);
+                }
+            }
+        }
     }
 
-    // Check if any sections overlap
+    // Claim addresses in a fixed order, so the first claimant of an address does not depend on the workers
     qsort(sections.ptr, sections.sz, sizeof(BufferSegment), intvcmp);
 
 #if (LC3_DEBUG)
@@ -531,48 +1348,120 @@ void LC3_LinkUnits(size_t unitCount, LC3_Unit *units) {
     }
 #endif
 
-    for (size_t i = 1; i < sections.sz; i++) {
-        if (sections.ptr[i].tk.start <= sections.ptr[i - 1].tk.sz) {
-            LC3_SimpleError(
-                sections.ptr[i].unit, "\x1b[1m%s:\x1b[0m code overlap with \"%s\" at address x%04X\n", 
-                sections.ptr[i].unit->filename, sections.ptr[i - 1].unit->filename, sections.ptr[i].tk.start);
-        }
+    // Check if any sections overlap, every overlapping range is reported
+    LC3_AddressSpace *space = LC3_CreateAddressSpace();
+    LC3_OverlapArray overlaps = LC3_NewOverlapArray();
+
+    for (size_t i = 0; i < sections.sz; i++) {
+        uint16_t size = sections.ptr[i].tk.sz - sections.ptr[i].tk.start;
+        LC3_ClaimAddresses(space, sections.ptr[i].tk.start, size, i, &overlaps);
+    }
+
+    for (size_t i = 0; i < overlaps.sz; i++) {
+        LC3_Overlap overlap = overlaps.ptr[i];
+        LC3_Unit *owner = sections.ptr[overlap.owner].unit;
+        LC3_Unit *claimant = sections.ptr[overlap.claimant].unit;
+
+        LC3_SimpleError(
+            claimant, "\x1b[1m%s:\x1b[0m code overlap at x%04X-x%04X between \"%s\" and \"%s\"\n",
+            claimant->filename, overlap.start, overlap.end, owner->filename, claimant->filename);
+    }
+
+    for (size_t i = 0; i < unitCount; i++) {
+        LC3_FlushDiagnostics(&units[i]);
+    }
+
+    // Written even if linking failed, to help finding out why
+    if (unitCount > 0 && units[0].ctx != NULL && units[0].ctx->mapFile != NULL) {
+        writeLinkMap(units[0].ctx->mapFile, unitCount, units, &combined, &overlaps, &sections);
     }
 
+    vaFree(overlaps.ptr);
+    vaFree(space);
     freeIntervalArray(sections);
-    free(combined.ptr);
+
+    if (sorted == NULL) {
+        vaFree(combined.ptr);
+    }
 }
 
 
-enum FileFlag {
-    LC3_FILE_OBJ = 0x0001,
-    LC3_FILE_EXC = 0x0002,
-    LC3_FILE_DBG = 0x0004,
-    
-    // Meta
-    LC3_FILE_HDR = 0x10000,
-    LC3_FILE_SYM = 0x20000,
-};
+void LC3_LinkUnits(size_t unitCount, LC3_Unit *units) {
+    linkUnits(unitCount, units, NULL, NULL);
+}
+
+
+void LC3_LinkSortedUnits(size_t unitCount, LC3_Unit *units, const SymbolTable *symbols) {
+    linkUnits(unitCount, units, symbols, NULL);
+}
+
 
+void LC3_StreamLinkUnits(size_t unitCount, LC3_Unit *units, const char *filename) {
+    StreamWriter writer = {
+        .fp       = fopen(filename, "wb"),
+        .resolved = vaMalloc("LC3_Unit", (unitCount + 1) * sizeof(bool)),
+        .next     = 0,
+    };
+
+    if (writer.fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+        vaFree(writer.resolved);
+        return;
+    }
 
-enum FileIndicator {
-    LC3_INDICATOR_SYM = 'S',
-    LC3_INDICATOR_ASM = 'A',
-};
+    pthread_mutex_init(&writer.mutex, NULL);
+    memset(writer.resolved, 0, (unitCount + 1) * sizeof(bool));
+
+    linkUnits(unitCount, units, NULL, &writer);
+
+    pthread_mutex_destroy(&writer.mutex);
+    vaFree(writer.resolved);
+    fclose(writer.fp);
+
+    // Partial output is of no use
+    if (unitCount > 0 && units[0].ctx != NULL && units[0].ctx->error) {
+        remove(filename);
+    }
+}
 
 
-void writeObjectLine(LC3_Unit *unit, FILE *fp, ObjectLine obj, uint32_t flags) {
-    fwrite(&obj.instr, 2, 1, fp);
+// Writes segment as null-terminated string
+void writeSegment(LC3_Unit *unit, FILE *fp, BufferSegment seg) {
     char terminator = '\0';
 
+    if (seg.tk.sz > 0) {
+        fwrite(unit->buf.ptr[seg.line].ptr + seg.tk.start, 1, seg.tk.sz, fp);
+    }
+
+    fwrite(&terminator, 1, 1, fp);
+}
+
+
+void writeObjectSection(LC3_Unit *unit, FILE *fp, ObjectSection section, uint32_t flags) {
     if (flags & LC3_FILE_OBJ) {
-        fwrite(unit->buf.ptr[obj.label.line].ptr + obj.label.tk.start, 1, obj.label.tk.sz, fp);
-        fwrite(&terminator, 1, 1, fp);
+        BufferSegment empty = {0};
+        size_t reloc = 0;
+
+        for (size_t i = 0; i < section.words.sz; i++) {
+            bool found = (reloc < section.reloc.sz && section.reloc.ptr[reloc].index == i);
+
+            fwrite(&section.words.ptr[i], 2, 1, fp);
+            writeSegment(unit, fp, found ? section.reloc.ptr[reloc++].label : empty);
+        }
+    } else {
+        // Executables only contain the words
+        fwrite(section.words.ptr, 2, section.words.sz, fp);
     }
 
+    // Debug lines refer to the string table by offset
     if (flags & LC3_FILE_DBG) {
-        fwrite(unit->buf.ptr[obj.debug.line].ptr + obj.debug.tk.start, 1, obj.debug.tk.sz, fp);
-        fwrite(&terminator, 1, 1, fp);
+        uint16_t count = section.debug.sz;
+        fwrite(&count, 2, 1, fp);
+
+        for (size_t i = 0; i < section.debug.sz; i++) {
+            fwrite(&section.debug.ptr[i].index, 2, 1, fp);
+            fwrite(&section.debug.ptr[i].offset, 4, 1, fp);
+        }
     }
 }
 
@@ -581,7 +1470,7 @@ void writeToFile(LC3_Unit *unit, FILE *fp, uint32_t flags) {
     uint8_t indicator;
 
     if (unit->ctx && unit->ctx->storeDebug) {
-        flags |= LC3_FILE_DBG;
+        flags |= LC3_FILE_DBG | LC3_FILE_DBT;
     }
 
     if (flags & LC3_FILE_HDR) {
@@ -589,6 +1478,19 @@ void writeToFile(LC3_Unit *unit, FILE *fp, uint32_t flags) {
         fwrite((uint16_t *)&flags, 2, 1, fp);
     }
 
+    // Element counts, so readers can allocate everything at once
+    if (flags & LC3_FILE_OBJ) {
+        uint32_t counts[3] = {unit->obj.sz, unit->symb.sz, 0};
+        indicator = LC3_INDICATOR_CNT;
+
+        for (size_t i = 0; i < unit->obj.sz; i++) {
+            counts[2] += unit->obj.ptr[i].reloc.sz;
+        }
+
+        fwrite(&indicator, 1, 1, fp);
+        fwrite(counts, 4, 3, fp);
+    }
+
     if ((flags & LC3_FILE_SYM) && unit->symb.sz > 0) {
         indicator = LC3_INDICATOR_SYM;
 
@@ -609,19 +1511,30 @@ void writeToFile(LC3_Unit *unit, FILE *fp, uint32_t flags) {
         return;
     }
 
+    // Debug strings of this unit, referred to by the following sections
+    if (flags & LC3_FILE_DBG) {
+        uint32_t size = unit->debug.str.sz;
+        indicator = LC3_INDICATOR_DBG;
+
+        fwrite(&indicator, 1, 1, fp);
+        fwrite(&size, 4, 1, fp);
+        fwrite(unit->debug.str.ptr, 1, size, fp);
+    }
+
     indicator = LC3_INDICATOR_ASM;
 
     for (int section = 0; section < unit->obj.sz; section++) {
         ObjectSection current = unit->obj.ptr[section];
+        uint16_t size = current.words.sz;
 
         // Write the section header
         fwrite(&indicator, 1, 1, fp);
         fwrite(&current.origin, 2, 1, fp);
-        fwrite(&current.sz, 2, 1, fp);
+        fwrite(&size, 2, 1, fp);
 
-        for (int i = 0; i < current.sz; i++) {
-            writeObjectLine(unit, fp, current.ptr[i], flags);
-        }
+        unit->obj.ptr[section].offset = ftell(fp);
+
+        writeObjectSection(unit, fp, current, flags);
     }
 }
 
@@ -638,19 +1551,41 @@ void LC3_WriteObject(LC3_Unit *unit, FILE *fp, bool header) {
 
 void LC3_WriteExecutable(size_t unitCount, LC3_Unit *units, const char *filename) {
     FILE *fp = fopen(filename, "wb");
-    uint32_t flags = LC3_FILE_HDR | LC3_FILE_EXC;
 
     for (int i = 0; i < unitCount; i++) {
-        writeToFile(&units[i], fp,  flags);
-        flags &= ~LC3_FILE_HDR;
+        LC3_WriteExecutableUnit(&units[i], fp, (i == 0));
     }
 
     fclose(fp);
 }
 
 
+void LC3_WriteExecutableUnit(LC3_Unit *unit, FILE *fp, bool header) {
+    unit->outputStart = ftell(fp);
+    writeToFile(unit, fp, LC3_FILE_EXC | (LC3_FILE_HDR * (!!header)));
+    unit->outputSize = ftell(fp) - unit->outputStart;
+}
+
+
+size_t LC3_ExecutableSize(LC3_Unit *unit, bool header) {
+    bool debug = (unit->ctx && unit->ctx->storeDebug);
+    size_t size = header ? 6 : 0;
+
+    if (debug) {
+        size += 5 + unit->debug.str.sz;
+    }
+
+    for (size_t i = 0; i < unit->obj.sz; i++) {
+        size += 5 + 2 * unit->obj.ptr[i].words.sz;
+        size += debug ? 2 + 6 * unit->obj.ptr[i].debug.sz : 0;
+    }
+
+    return size;
+}
+
+
 // Check for reading
-#define FREAD_C(ptr, sz, n, fp, ret) if ((fread(ptr, sz, n, fp)) != n) { printf("Failed to read %i elements\n", n); unit->error = true; fclose(fp); return ret; }
+#define FREAD_C(ptr, sz, n, fp, ret) if ((fread(ptr, sz, n, fp)) != n) { LC3_SimpleError(unit, "\x1b[1m%s:\x1b[0m failed to read %i elements\n", unit->filename, n); return ret; }
 
 
 int readString(LC3_Unit *unit, String *str, FILE *fp) {
@@ -687,24 +1622,70 @@ int readObjectLine(LC3_Unit *unit, ObjectSection *section, FILE *fp, String *str
         }
     }
 
-    if (flags & LC3_FILE_DBG) {
+    addObjectLine(unit, section, current);
+
+    // Older files store debug info inline
+    if ((flags & LC3_FILE_DBG) && !(flags & LC3_FILE_DBT)) {
         if (readString(unit, str, fp) != 0) {
             return 1;
         }
 
-        current.debug.unit  = unit;
-        current.debug.line  = unit->buf.sz;
-        current.debug.tk.sz = str->sz;
+        if (str->sz > 0) {
+            DebugLine debug = {
+                .index  = section->words.sz - 1,
+                .offset = internDebugString(&unit->debug, str->ptr, str->sz),
+            };
 
-        if (current.debug.tk.sz > 0) {
-            addString(&unit->buf, *str);
-            (*str) = newString();
-        } else {
-            clearString(str);
+            addDebugLine(&section->debug, debug);
+        }
+
+        clearString(str);
+    }
+
+    return 0;
+}
+
+
+// Reads the debug lines following a section
+int readDebugLines(LC3_Unit *unit, ObjectSection *section, FILE *fp, uint32_t base) {
+    uint16_t count = 0;
+    FREAD_C(&count, 2, 1, fp, 1);
+    reserveDebugTable(&section->debug, count);
+
+    for (int i = 0; i < count; i++) {
+        DebugLine debug = {0};
+        FREAD_C(&debug.index, 2, 1, fp, 1);
+        FREAD_C(&debug.offset, 4, 1, fp, 1);
+        debug.offset += base;
+
+        if (debug.index >= section->words.sz || debug.offset >= unit->debug.str.sz) {
+            LC3_SimpleError(unit, "\x1b[1m%s:\x1b[0m invalid debug line\n", unit->filename);
+            return 1;
         }
+
+        addDebugLine(&section->debug, debug);
+    }
+
+    return 0;
+}
+
+
+// Reads a debug string table with a single copy
+int readDebugStrings(LC3_Unit *unit, FILE *fp, uint32_t *base) {
+    String *table = &unit->debug.str;
+    uint32_t size = 0;
+    FREAD_C(&size, 4, 1, fp, 1);
+
+    if (table->sz + size + 1 > table->cap) {
+        table->cap = table->sz + size + 1;
+        table->ptr = vaRealloc("DebugStrings", table->ptr, table->cap);
     }
 
-    addObjectLine(section, current);
+    (*base) = table->sz;
+    FREAD_C(table->ptr + table->sz, 1, size, fp, 1);
+    table->sz += size;
+    table->ptr[table->sz] = '\0';
+
     return 0;
 }
 
@@ -712,17 +1693,47 @@ int readObjectLine(LC3_Unit *unit, ObjectSection *section, FILE *fp, String *str
 void LC3_ReadFromFile(LC3_Unit *unit) {
     FILE *fp = fopen(unit->filename, "rb");
 
+    if (fp == NULL) {
+        LC3_SimpleError(unit, "failed to open file %s\n", unit->filename);
+        return;
+    }
+
+    LC3_ReadObject(unit, fp, -1);
+    fclose(fp);
+
+    // Read errors only mark the unit, the others are cancelled as well
+    if (unit->error) {
+        LC3_SetError(unit);
+    }
+}
+
+
+// Reads an object file starting at the current position, up to end (or EOF if end is negative)
+void LC3_ReadObject(LC3_Unit *unit, FILE *fp, long end) {
     char mgc[4];
     FREAD_C(&mgc, 1, 4, fp,);
 
     uint16_t flags = 0;
     FREAD_C(&flags, 2, 1, fp,);
     uint8_t indicator = 0;
+    uint32_t debugBase = 0;
+    uint32_t relocCount = 0;
+
+    while ((end < 0 || ftell(fp) < end) && fread(&indicator, 1, 1, fp) == 1) {
+        if (indicator == LC3_INDICATOR_CNT) {
+            // Sections, symbols, relocations
+            uint32_t counts[3];
+            FREAD_C(counts, 4, 3, fp,);
 
-    while (fread(&indicator, 1, 1, fp) == 1) {
-        if (indicator == LC3_INDICATOR_SYM) {
+            reserveObjectSectionArray(&unit->obj, counts[0]);
+            reserveSymbolTable(&unit->symb, counts[1]);
+            reserveStringArray(&unit->buf, unit->buf.sz + counts[1] + counts[2]);
+            relocCount = counts[2];
+
+        } else if (indicator == LC3_INDICATOR_SYM) {
             uint32_t size = 0;
             FREAD_C(&size, 4, 1, fp,);
+            reserveSymbolTable(&unit->symb, unit->symb.sz + size);
 
             for (int i = 0; i < size; i++) {
                 String line = newString();
@@ -742,33 +1753,43 @@ void LC3_ReadFromFile(LC3_Unit *unit) {
             }
 
         } else if (indicator == LC3_INDICATOR_ASM) {
-            addObjectSection(&unit->obj, newObjectSection());
-            ObjectSection *section = &unit->obj.ptr[unit->obj.sz - 1];
-            uint16_t size = 0;
+            uint16_t origin = 0, size = 0;
 
-            FREAD_C(&section->origin, 2, 1, fp,);
+            FREAD_C(&origin, 2, 1, fp,);
             FREAD_C(&size, 2, 1, fp,);
 
+            // Section can't have more relocations than words
+            addObjectSection(&unit->obj, newObjectSection(size, (relocCount < size) ? relocCount : size, 0));
+            ObjectSection *section = &unit->obj.ptr[unit->obj.sz - 1];
+            section->origin = origin;
+
             String label = newString();
 
             for (int i = 0; i < size; i++) {
                 if (readObjectLine(unit, section, fp, &label, flags) != 0) {
-                    free(label.ptr);
+                    vaFree(label.ptr);
                     return;
                 }
             }
 
-            free(label.ptr);
+            vaFree(label.ptr);
+            relocCount -= (section->reloc.sz < relocCount) ? section->reloc.sz : relocCount;
+
+            if ((flags & LC3_FILE_DBT) && readDebugLines(unit, section, fp, debugBase) != 0) {
+                return;
+            }
+
+        } else if (indicator == LC3_INDICATOR_DBG) {
+            if (readDebugStrings(unit, fp, &debugBase) != 0) {
+                return;
+            }
 
         } else {
             unit->error = true;
-            fclose(fp);
             return;
         }
     }
 
-    fclose(fp);
-
 #if (LC3_DEBUG)
     LC3_BeginOutput();
 
@@ -787,16 +1808,24 @@ void LC3_ReadFromFile(LC3_Unit *unit) {
     printf("Object table: (file \"%s\"\n", unit->filename);
     printf("--------------------------------------------------------\n");
 
-    for (int i = 0; !unit->error && i < unit->obj.ptr[0].sz; i++) {
-        ObjectLine obj = unit->obj.ptr[0].ptr[i];
+    for (size_t section = 0; !unit->error && section < unit->obj.sz; section++) {
+        ObjectSection current = unit->obj.ptr[section];
 
-        char *tk = tokenString(obj.label.tk, unit->buf.ptr[obj.label.line]);
-        char *db = tokenString(obj.debug.tk, unit->buf.ptr[obj.label.line + 1]);
+        for (size_t i = 0; i < current.words.sz; i++) {
+            printf("%04X | 0x%04X\n", (uint16_t)(current.origin + i), current.words.ptr[i]);
+        }
 
-        printf("%3d | 0x%04X [%s] \"%s\"\n", i, obj.instr, tk, db);
+        for (size_t i = 0; i < current.reloc.sz; i++) {
+            Relocation reloc = current.reloc.ptr[i];
+            char *tk = tokenString(reloc.label.tk, unit->buf.ptr[reloc.label.line]);
+            printf("%04X | %c [%s]\n", (uint16_t)(current.origin + reloc.index), reloc.kind, tk);
+            free(tk);
+        }
 
-        free(tk);
-        free(db);
+        for (size_t i = 0; i < current.debug.sz; i++) {
+            DebugLine debug = current.debug.ptr[i];
+            printf("%04X | \"%s\"\n", (uint16_t)(current.origin + debug.index), unit->debug.str.ptr + debug.offset);
+        }
     }
 
     LC3_FinishOutput();
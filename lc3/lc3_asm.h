@@ -11,9 +11,33 @@
 
 #define TOKEN_MAX (UINT16_MAX)
 
+// First address of user programs, everything below belongs to the system
+#define LC3_USER_SPACE (0x3000)
+
 /* == Enum type definitions & instruction map == */
 
 
+// Flags in the file header
+enum FileFlag {
+    LC3_FILE_OBJ = 0x0001,
+    LC3_FILE_EXC = 0x0002,
+    LC3_FILE_DBG = 0x0004,
+    LC3_FILE_DBT = 0x0008, // Debug info is stored in a string table instead of inline
+    
+    // Meta
+    LC3_FILE_HDR = 0x10000,
+    LC3_FILE_SYM = 0x20000,
+};
+
+
+enum FileIndicator {
+    LC3_INDICATOR_SYM = 'S',
+    LC3_INDICATOR_ASM = 'A',
+    LC3_INDICATOR_DBG = 'D',
+    LC3_INDICATOR_CNT = 'C',
+};
+
+
 // Stores the different types of statements
 typedef enum {
     STMT_UNKNOWN = 0, // This is an error
@@ -24,6 +48,7 @@ typedef enum {
 
 
 typedef struct LC3_Unit *LC3_Unit_Ptr;
+typedef struct ObjectSection *ObjectSection_Ptr;
 typedef const struct InstructionDefinition *InstructionDefinition_Ptr;
 
 // Section of the file buffer (token including line)
@@ -47,6 +72,7 @@ typedef struct {
 } Statement;
 
 
+// Single assembled word, used while building sections (see addObjectLine)
 typedef struct ObjectLine {
     uint16_t instr;
     BufferSegment label;
@@ -54,6 +80,30 @@ typedef struct ObjectLine {
 } ObjectLine;
 
 
+// Determines how a label address is combined with the instruction word
+typedef enum RelocationKind {
+    RELOC_PC9  = '9', // 9-bit PC-relative offset (BR, LD, LDI, LEA, ST, STI)
+    RELOC_PC11 = 'B', // 11-bit PC-relative offset (JSR)
+    RELOC_ABS  = 'A', // Full 16-bit address (.FILL)
+} RelocationKind;
+
+
+// Word in a section that still needs a label address
+typedef struct Relocation {
+    uint16_t index;
+    RelocationKind kind;
+    BufferSegment label;
+    uint16_t value; // Address of the label, once resolved
+} Relocation;
+
+
+// Original source line belonging to a word in a section, stored in the unit's debug strings
+typedef struct DebugLine {
+    uint16_t index;
+    uint32_t offset;
+} DebugLine;
+
+
 #include "lc3_instr.h"
 
 
@@ -68,13 +118,57 @@ typedef struct {
 vaTypedef(Statement, StatementArray);
 vaTypedef(Symbol, SymbolTable);
 
+vaAllocFunctionDefine(SymbolTable, newSymbolTable);
+vaAllocCapacityFunctionDefine(SymbolTable, newSymbolTableCapacity);
+vaAppendFunctionDefine(SymbolTable, Symbol, addSymbolHelper);
+
+vaTypedef(uint16_t, WordArray);
+vaTypedef(Relocation, RelocationArray);
+vaTypedef(DebugLine, DebugTable);
+
+// Assembled words are stored densely, relocations and debug info are sparse and sorted by index
 typedef struct ObjectSection {
     uint16_t origin;
-    vaRequiredArgs(ObjectLine);
+    long offset; // File position of the words in the last written output
+    WordArray words; // ptr is NULL once written by a streaming link, sz is kept
+    RelocationArray reloc;
+    DebugTable debug;
 } ObjectSection;
 
-vaAllocFunctionDefine(ObjectSection, newObjectSection);
-vaAppendFunctionDefine(ObjectSection, const ObjectLine, addObjectLine);
+// Deduplicated, null-separated debug strings, with a hash index for lookups
+typedef struct DebugStrings {
+    String str;
+    uint32_t *slots; // Offset + 1 into str, 0 if empty
+    size_t slotCap;
+    size_t count;
+} DebugStrings;
+
+ObjectSection newObjectSection(size_t words, size_t reloc, size_t debug);
+void addObjectLine(LC3_Unit_Ptr unit, ObjectSection *section, const ObjectLine obj);
+
+vaAllocCapacityFunctionDefine(WordArray, newWordArray);
+vaAppendFunctionDefine(WordArray, uint16_t, addWord);
+vaAppendFunctionDefine(RelocationArray, const Relocation, addRelocation);
+
+// Error of a unit, recorded by the thread working on the unit and shown by LC3_FlushDiagnostics
+typedef enum LC3_DiagnosticKind {
+    LC3_DIAG_TOKEN,  // Assembler error at a token
+    LC3_DIAG_LINKER, // Linker error at a label
+    LC3_DIAG_SIMPLE, // Preformatted message without a location
+} LC3_DiagnosticKind;
+
+typedef struct LC3_Diagnostic {
+    uint8_t kind;
+    uint8_t flags;   // LC3_ErrorConfig
+    size_t line;
+    Token tk;
+    size_t order;    // Position in which it was recorded, keeps errors on the same line in order
+    char *token;     // Copies, so they stay valid when the source is released
+    char *source;    // NULL if the line is not shown
+    char *message;
+} LC3_Diagnostic;
+
+vaTypedef(LC3_Diagnostic, DiagnosticArray);
 
 vaTypedef(ObjectSection, ObjectSectionArray);
 vaAppendFunctionDefine(ObjectSectionArray, const ObjectSection, addObjectSection);
@@ -84,17 +178,35 @@ typedef struct LC3_Context {
     const char *output;
     bool storeDebug;
     bool storeIndent;
-    bool error;
+    bool gcSections;
+    const char *mapFile; // Link map output, if any
+    bool streamLink;   // Units are written and released while linking, see LC3_StreamLinkUnits
+    size_t workers;    // Worker threads for assembling and linking, 0 for one per online processor
+    bool workerReport; // Show busy and idle time of every worker after assembling
+    bool keepGoing;    // Keep assembling other units after an error, instead of cancelling them
+    FILE *diagJson;    // Errors are written here as JSON lines instead of being shown, if set
+    const char *cacheDir; // Objects of assembled sources are reused from and stored here, if set (see lc3_cache.h)
+    size_t cacheHits, cacheMisses; // Updated by every worker
+
+    // Called for every error instead of showing it, if set. The diagnostic is freed afterwards
+    void (*diagHandler)(void *data, const struct LC3_Unit *unit, const LC3_Diagnostic *diag);
+    void *diagData;
+    bool error;        // Written by every worker, use LC3_SetError and LC3_HasError while units are assembled
 } LC3_Context;
 
 
 typedef struct LC3_Unit {
     const char *filename;
+    const char *source; // Assembly text to use instead of reading filename, if set
+    size_t sourceSize;
     StringArray buf;
     ObjectSectionArray obj;
     SymbolTable symb;
+    DebugStrings debug;
+    DiagnosticArray diag; // Errors that have not been shown yet
     LC3_Context *ctx;
     String upper;
+    long outputStart, outputSize; // Byte range in the last written executable
     bool error;
 } LC3_Unit;
 
@@ -106,10 +218,58 @@ void LC3_FinishOutput();
 LC3_Unit LC3_CreateUnit(LC3_Context *ctx, const char *filename);
 void LC3_DestroyUnit(LC3_Unit unit);
 
+// Worker threads to use for ctx
+size_t LC3_WorkerCount(const LC3_Context *ctx);
+
 void LC3_AssembleUnit(LC3_Unit *unit);
+
+// Copies line into a string with exactly enough room
+String copyLine(const char *str, size_t len);
+
+// Length of line as the assembler reads it, without its comment and trailing spaces
+size_t sourceLineLength(const char *line, size_t len);
+
+// Tokenizes and validates line i of unit into stmt, recording errors in unit. The label of the line is set even if the
+// rest is invalid. Returns false if there is nothing to interpret (no instruction, or an invalid one)
+bool parseStatement(LC3_Unit *unit, size_t i, Statement *stmt);
+
+// Assembles all units on a pool of LC3_WorkerCount threads, largest files first
 void LC3_AssembleUnits(size_t unitCount, LC3_Unit *units);
+
+// Assembles units[list[0]] to units[list[count - 1]] in parallel, and shows their errors in list order
+void LC3_AssembleSelected(LC3_Unit *units, const size_t *list, size_t count);
 void LC3_WriteSymbolTable(LC3_Unit *unit, FILE *fp, bool header);
 void LC3_WriteObject(LC3_Unit *unit, FILE *fp, bool header);
 void LC3_LinkUnits(size_t unitCount, LC3_Unit *units);
+
+// Like LC3_LinkUnits, but with the symbols of all units given in the order of symcmp, for callers that keep them between links
+void LC3_LinkSortedUnits(size_t unitCount, LC3_Unit *units, const SymbolTable *symbols);
+
+// Links units and writes them as an executable while doing so, releasing their memory as soon as they are written.
+// Only the symbol table and section bounds are kept, so the units can not be written again afterwards
+void LC3_StreamLinkUnits(size_t unitCount, LC3_Unit *units, const char *filename);
 void LC3_WriteExecutable(size_t unitCount, LC3_Unit *units, const char *filename);
 void LC3_ReadFromFile(LC3_Unit *unit);
+
+// Reads an object file from fp, up to end (or EOF if end is negative)
+void LC3_ReadObject(LC3_Unit *unit, FILE *fp, long end);
+
+// Writes a single unit as part of an executable, header should only be set for the first unit
+void LC3_WriteExecutableUnit(LC3_Unit *unit, FILE *fp, bool header);
+
+// Amount of bytes LC3_WriteExecutableUnit writes for unit
+size_t LC3_ExecutableSize(LC3_Unit *unit, bool header);
+
+// Order of symbols in a sorted symbol table, by name (case insensitive) and then line
+int symcmp(const void *sym1, const void *sym2);
+void sortSymbolTable(SymbolTable *strarr);
+
+// Replaces symbols with its first kept symbols and the symbols of added, both sorted, in sorted order
+void mergeSymbolTable(SymbolTable *symbols, size_t kept, const SymbolTable *added);
+
+// Compares two tokens case insensitively, like labels are compared
+int tokenCaseCmp(Token t1, Token t2, String s1, String s2);
+
+// Finds label in a sorted symbol table, returns NULL if not found
+const Symbol *lookupSymbol(const SymbolTable *symbols, Token tk, String str);
+void addSymbol(LC3_Unit *unit, size_t line, Token tk, String str, size_t value);
@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_batch.h"
+#include "lc3_asm.h"
+#include "lc3_pool.h"
+#include "lc3_state.h"
+#include "lib/va_alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct BatchJob {
+    size_t line; // In the list, for the summary
+    char *output;
+    char **inputs;
+    size_t inputCount;
+
+    // Results
+    bool ok;
+    double time;
+    size_t words;
+    size_t cacheHits, cacheMisses;
+    char *report;
+    size_t reportSize;
+} BatchJob;
+
+
+vaTypedef(BatchJob, BatchJobArray);
+static vaAllocFunction(BatchJobArray, BatchJob, newBatchJobArray,,)
+static vaAppendFunction(BatchJobArray, const BatchJob, addBatchJob,,)
+
+
+typedef struct Batch {
+    BatchJobArray jobs;
+    LC3_AssemblerOptions options;
+} Batch;
+
+
+static bool readJobs(const char *listFile, BatchJobArray *jobs) {
+    FILE *fp = fopen(listFile, "r");
+    char *line = NULL, *save;
+    size_t cap = 0, number = 0;
+    bool valid = true;
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", listFile);
+        return false;
+    }
+
+    while (valid && getline(&line, &cap, fp) >= 0) {
+        char *word = strtok_r(line, " \t\r\n", &save);
+        number++;
+
+        if (word == NULL || word[0] == '#') {
+            continue;
+        }
+
+        BatchJob job = {.line = number, .output = copyWord("LC3_Batch", word), .inputs = NULL, .inputCount = 0};
+        size_t inputCap = 0;
+
+        while ((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            if (job.inputCount == inputCap) {
+                inputCap = (inputCap == 0) ? 4 : 2 * inputCap;
+                job.inputs = vaRealloc("LC3_Batch", job.inputs, inputCap * sizeof(char *));
+            }
+
+            job.inputs[job.inputCount++] = copyWord("LC3_Batch", word);
+        }
+
+        if (job.inputCount == 0) {
+            printf("\x1b[1;31merror:\x1b[0m \x1b[1m%s:%zu:\x1b[0m job for %s has no inputs\n", listFile, number, job.output);
+            vaFree(job.output);
+            valid = false;
+            continue;
+        }
+
+        addBatchJob(jobs, job);
+    }
+
+    free(line);
+    fclose(fp);
+    return valid;
+}
+
+
+// Errors of a job are kept as text, so they can be shown after all jobs are done
+static void writeReport(FILE *fp, const LC3_Message *messages, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const LC3_Message *msg = &messages[i];
+
+        if (msg->token == NULL) {
+            fprintf(fp, "\x1b[1m%s: \x1b[1;31merror:\x1b[0m %s\n", msg->source, msg->message);
+        } else if (msg->token[0] != '\0') {
+            fprintf(fp, "\x1b[1m%s:%zu:%u: \x1b[1;31merror:\x1b[0m %s \"\x1b[1m%s\x1b[0m\"\n", msg->source, msg->line, msg->column, msg->message, msg->token);
+        } else {
+            fprintf(fp, "\x1b[1m%s:%zu:%u: \x1b[1;31merror:\x1b[0m %s\n", msg->source, msg->line, msg->column, msg->message);
+        }
+    }
+}
+
+
+// Every job has its own assembler, so errors and outputs of one job never affect another
+static void runJob(void *data, size_t index, size_t worker) {
+    Batch *batch = data;
+    BatchJob *job = &batch->jobs.ptr[index];
+    LC3_AssemblerOptions options = batch->options;
+    double start = LC3_Seconds();
+
+    // Jobs are spread over the workers, a single job does not need any more threads
+    options.workers = 1;
+    LC3_Assembler *as = LC3_NewAssembler(&options);
+
+    for (size_t i = 0; i < job->inputCount; i++) {
+        LC3_AddFile(as, job->inputs[i]);
+    }
+
+    job->ok = LC3_Build(as);
+    LC3_GetCacheCounts(as, &job->cacheHits, &job->cacheMisses);
+
+    size_t count, size;
+    const LC3_Message *messages = LC3_GetMessages(as, &count);
+    const LC3_SectionInfo *sections = LC3_GetSections(as, &size);
+    FILE *report = open_memstream(&job->report, &job->reportSize);
+
+    for (size_t i = 0; i < size; i++) {
+        job->words += sections[i].size;
+    }
+
+    if (report != NULL) {
+        writeReport(report, messages, count);
+    }
+
+    if (job->ok) {
+        const uint8_t *executable = LC3_GetExecutable(as, &size);
+        FILE *fp = fopen(job->output, "wb");
+
+        job->ok = (fp != NULL && fwrite(executable, 1, size, fp) == size);
+
+        if (fp != NULL) {
+            fclose(fp);
+        }
+
+        if (!job->ok && report != NULL) {
+            fprintf(report, "\x1b[1;31merror:\x1b[0m failed to write file %s\n", job->output);
+        }
+    }
+
+    if (report != NULL) {
+        fclose(report);
+    }
+
+    LC3_FreeAssembler(as);
+    job->time = LC3_Seconds() - start;
+}
+
+
+// Larger jobs are started first
+static uint64_t jobCost(const BatchJob *job) {
+    uint64_t cost = 0;
+
+    for (size_t i = 0; i < job->inputCount; i++) {
+        cost += LC3_FileSize(job->inputs[i]);
+    }
+
+    return cost;
+}
+
+
+static void printSummary(const char *listFile, const BatchJobArray *jobs, bool cached, double elapsed) {
+    size_t failed = 0, hits = 0, misses = 0;
+
+    // Errors first, in order of the list
+    for (size_t i = 0; i < jobs->sz; i++) {
+        if (jobs->ptr[i].reportSize > 0) {
+            printf("\n\x1b[1m%s:%zu (%s):\x1b[0m\n", listFile, jobs->ptr[i].line, jobs->ptr[i].output);
+            fwrite(jobs->ptr[i].report, 1, jobs->ptr[i].reportSize, stdout);
+        }
+    }
+
+    printf("\n%-8s %-8s %12s %8s  %s\n", "line", "status", "time (ms)", "words", "output");
+
+    for (size_t i = 0; i < jobs->sz; i++) {
+        const BatchJob *job = &jobs->ptr[i];
+        failed += !job->ok;
+        hits += job->cacheHits;
+        misses += job->cacheMisses;
+        printf("%-8zu %-8s %12.3f %8zu  %s\n", job->line, job->ok ? "ok" : "failed", job->time * 1e3, job->words, job->output);
+    }
+
+    printf("%zu jobs, %zu ok, %zu failed in %.3f ms\n", jobs->sz, jobs->sz - failed, failed, elapsed * 1e3);
+
+    if (cached) {
+        printf("cache: %zu hits, %zu misses\n", hits, misses);
+    }
+}
+
+
+long LC3_RunBatch(const char *listFile, const LC3_AssemblerOptions *options) {
+    Batch batch = {.jobs = newBatchJobArray(), .options = *options};
+    long failed = -1;
+
+    if (readJobs(listFile, &batch.jobs)) {
+        uint64_t *costs = vaMalloc("LC3_Batch", (batch.jobs.sz + 1) * sizeof(uint64_t));
+        size_t workers = (options->workers > 0) ? options->workers : LC3_ProcessorCount();
+        double start = LC3_Seconds();
+
+        for (size_t i = 0; i < batch.jobs.sz; i++) {
+            costs[i] = jobCost(&batch.jobs.ptr[i]);
+        }
+
+        LC3_RunWeightedJobs(batch.jobs.sz, workers, runJob, &batch, costs, NULL);
+        printSummary(listFile, &batch.jobs, (options->cacheDir != NULL), LC3_Seconds() - start);
+
+        failed = 0;
+
+        for (size_t i = 0; i < batch.jobs.sz; i++) {
+            failed += !batch.jobs.ptr[i].ok;
+        }
+
+        vaFree(costs);
+    }
+
+    for (size_t i = 0; i < batch.jobs.sz; i++) {
+        for (size_t j = 0; j < batch.jobs.ptr[i].inputCount; j++) {
+            vaFree(batch.jobs.ptr[i].inputs[j]);
+        }
+
+        // Reports come from open_memstream
+        free(batch.jobs.ptr[i].report);
+        vaFree(batch.jobs.ptr[i].inputs);
+        vaFree(batch.jobs.ptr[i].output);
+    }
+
+    vaFree(batch.jobs.ptr);
+    return failed;
+}
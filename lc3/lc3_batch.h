@@ -0,0 +1,13 @@
+/*
+ * Description:
+ * Batch mode, assembles and links many independent programs in one process
+ */
+
+#pragma once
+#include "lc3_lib.h"
+
+
+// Runs every job in listFile on a shared pool of options->workers threads and prints a summary of all jobs.
+// Every non-empty line of the list is a job: the output path, followed by its inputs. Lines starting with '#' are skipped.
+// Returns the number of failed jobs, or -1 if the list could not be read
+long LC3_RunBatch(const char *listFile, const LC3_AssemblerOptions *options);
@@ -0,0 +1,700 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_build.h"
+#include "lc3_ar.h"
+#include "lc3_asm.h"
+#include "lc3_err.h"
+#include "lc3_pool.h"
+#include "lc3_state.h"
+#include "lib/va_alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BUILD_STATE_MAGIC "LC3B"
+#define NO_TARGET (SIZE_MAX)
+
+
+typedef enum TargetKind {
+    TARGET_EXECUTABLE,
+    TARGET_OBJECT,
+    TARGET_ARCHIVE,
+} TargetKind;
+
+
+typedef enum TargetStatus {
+    TARGET_UP_TO_DATE,
+    TARGET_STALE,   // Scheduled to be built
+    TARGET_BUILT,
+    TARGET_FAILED,
+    TARGET_SKIPPED, // An input failed to build, or another target did without --keep-going
+} TargetStatus;
+
+
+typedef struct Target {
+    size_t line; // In the manifest, for errors
+    char *output;
+    char **inputs;
+    size_t inputCount;
+    size_t *producers; // Target building every input, or NO_TARGET
+    bool *archives;    // Whether every input is an archive
+    TargetKind kind;
+    bool storeDebug, storeIndent;
+
+    TargetStatus status;
+    uint64_t key; // Of the inputs and flags of the last successful build
+    bool hasKey;
+    uint8_t mark; // While sorting
+    size_t linkNode;
+
+    // Only while the target is built
+    LC3_Context ctx;
+    LC3_Unit *units;
+    size_t unitCount, sourceCount;
+    LC3_Archive **opened;
+    size_t openedCount;
+} Target;
+
+
+vaTypedef(Target, TargetArray);
+static vaAllocFunction(TargetArray, Target, newTargetArray,,)
+static vaAppendFunction(TargetArray, const Target, addTarget,,)
+
+
+// Every stale target is prepared (its inputs are opened once they are built), its sources are assembled and it is linked
+typedef enum NodeKind {
+    NODE_PREPARE,
+    NODE_ASSEMBLE,
+    NODE_LINK,
+} NodeKind;
+
+
+typedef struct BuildNode {
+    NodeKind kind;
+    size_t target;
+    size_t unit;
+} BuildNode;
+
+
+typedef struct Build {
+    TargetArray targets;
+    LC3_AssemblerOptions options;
+    BuildNode *nodes;
+    pthread_mutex_t reportMutex; // Keeps the errors and status of a target together
+    size_t finished, scheduled;
+    bool failed;
+} Build;
+
+
+static bool hasExtension(const char *filename, const char *ext) {
+    const char *dot = strrchr(filename, '.');
+    return (dot != NULL && strcmp(dot, ext) == 0);
+}
+
+
+static void freeTarget(Target *target) {
+    for (size_t i = 0; i < target->inputCount; i++) {
+        vaFree(target->inputs[i]);
+    }
+
+    vaFree(target->inputs);
+    vaFree(target->producers);
+    vaFree(target->archives);
+    vaFree(target->output);
+}
+
+
+// Reads the output, inputs and flags of a target from the words of a line, returns false if they are invalid
+static bool readTarget(Target *target, char *word, char **save, const char *manifest) {
+    size_t len = strlen(word), inputCap = 0;
+    bool colon = (len > 1 && word[len - 1] == ':');
+
+    if (colon) {
+        word[len - 1] = '\0';
+    }
+
+    target->output = copyWord("LC3_Build", word);
+    target->kind = hasExtension(word, ".obj") ? TARGET_OBJECT : hasExtension(word, ".lca") ? TARGET_ARCHIVE : TARGET_EXECUTABLE;
+
+    while ((word = strtok_r(NULL, " \t\r\n", save)) != NULL) {
+        if (!colon) {
+            colon = (strcmp(word, ":") == 0);
+
+            if (!colon) {
+                break;
+            }
+        } else if (strcmp(word, "-g") == 0) {
+            target->storeDebug = true;
+        } else if (strcmp(word, "-G") == 0) {
+            target->storeDebug = target->storeIndent = true;
+        } else if (word[0] == '-') {
+            printf("\x1b[1;31merror:\x1b[0m \x1b[1m%s:%zu:\x1b[0m unknown flag '%s'\n", manifest, target->line, word);
+            return false;
+        } else {
+            if (target->inputCount == inputCap) {
+                inputCap = (inputCap == 0) ? 4 : 2 * inputCap;
+                target->inputs = vaRealloc("LC3_Build", target->inputs, inputCap * sizeof(char *));
+            }
+
+            target->inputs[target->inputCount++] = copyWord("LC3_Build", word);
+        }
+    }
+
+    if (!colon) {
+        printf("\x1b[1;31merror:\x1b[0m \x1b[1m%s:%zu:\x1b[0m expected ':' after %s\n", manifest, target->line, target->output);
+        return false;
+    }
+
+    if (target->inputCount == 0 || (target->kind == TARGET_OBJECT && target->inputCount > 1)) {
+        printf("\x1b[1;31merror:\x1b[0m \x1b[1m%s:%zu:\x1b[0m %s needs %s\n", manifest, target->line, target->output,
+            (target->kind == TARGET_OBJECT) ? "exactly one input" : "inputs");
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool readManifest(const char *manifest, TargetArray *targets) {
+    FILE *fp = fopen(manifest, "r");
+    char *line = NULL, *save;
+    size_t cap = 0, number = 0;
+    bool valid = true;
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", manifest);
+        return false;
+    }
+
+    while (valid && getline(&line, &cap, fp) >= 0) {
+        char *word = strtok_r(line, " \t\r\n", &save);
+        number++;
+
+        if (word == NULL || word[0] == '#') {
+            continue;
+        }
+
+        Target target = {.line = number, .status = TARGET_UP_TO_DATE};
+        valid = readTarget(&target, word, &save, manifest);
+        addTarget(targets, target);
+    }
+
+    free(line);
+    fclose(fp);
+    return valid;
+}
+
+
+// Finds the target building every input, and whether inputs are archives
+static bool findProducers(const char *manifest, TargetArray *targets) {
+    for (size_t t = 0; t < targets->sz; t++) {
+        Target *target = &targets->ptr[t];
+
+        for (size_t other = 0; other < t; other++) {
+            if (strcmp(targets->ptr[other].output, target->output) == 0) {
+                printf("\x1b[1;31merror:\x1b[0m \x1b[1m%s:%zu:\x1b[0m %s is already built on line %zu\n", manifest, target->line, target->output, targets->ptr[other].line);
+                return false;
+            }
+        }
+
+        target->producers = vaMalloc("LC3_Build", target->inputCount * sizeof(size_t));
+        target->archives = vaMalloc("LC3_Build", target->inputCount * sizeof(bool));
+
+        for (size_t i = 0; i < target->inputCount; i++) {
+            target->producers[i] = NO_TARGET;
+
+            for (size_t other = 0; other < targets->sz; other++) {
+                if (strcmp(targets->ptr[other].output, target->inputs[i]) == 0) {
+                    target->producers[i] = other;
+                }
+            }
+
+            target->archives[i] = (target->producers[i] != NO_TARGET) ?
+                (targets->ptr[target->producers[i]].kind == TARGET_ARCHIVE) : LC3_IsArchive(target->inputs[i]);
+        }
+    }
+
+    return true;
+}
+
+
+// Depth first, so targets come after everything they depend on
+static bool sortTarget(const char *manifest, TargetArray *targets, size_t index, size_t *order, size_t *count) {
+    Target *target = &targets->ptr[index];
+
+    if (target->mark == 1) {
+        printf("\x1b[1;31merror:\x1b[0m \x1b[1m%s:%zu:\x1b[0m dependency cycle through %s\n", manifest, target->line, target->output);
+        return false;
+    }
+
+    if (target->mark == 2) {
+        return true;
+    }
+
+    target->mark = 1;
+
+    for (size_t i = 0; i < target->inputCount; i++) {
+        if (target->producers[i] != NO_TARGET && !sortTarget(manifest, targets, target->producers[i], order, count)) {
+            return false;
+        }
+    }
+
+    target->mark = 2;
+    order[(*count)++] = index;
+    return true;
+}
+
+
+// Hash of the flags, input names and input contents of a target
+static uint64_t targetKey(const Target *target) {
+    bool flags[2] = {target->storeDebug, target->storeIndent};
+    uint64_t key = LC3_HashBytes(LC3_HASH_INIT, flags, sizeof(flags));
+
+    for (size_t i = 0; i < target->inputCount; i++) {
+        uint64_t hash = LC3_HashFile(target->inputs[i]);
+
+        key = LC3_HashBytes(key, target->inputs[i], strlen(target->inputs[i]) + 1);
+        key = LC3_HashBytes(key, &hash, sizeof(hash));
+    }
+
+    return key;
+}
+
+
+static void readBuildState(TargetArray *targets, const char *stateFile) {
+    FILE *fp = fopen(stateFile, "rb");
+    char magic[4], *name = NULL;
+    size_t cap = 0;
+    uint32_t count = 0;
+    uint64_t key;
+
+    if (fp == NULL) {
+        return;
+    }
+
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, BUILD_STATE_MAGIC, 4) == 0 && fread(&count, 4, 1, fp) == 1) {
+        for (uint32_t i = 0; i < count && getdelim(&name, &cap, '\0', fp) > 0 && fread(&key, 8, 1, fp) == 1; i++) {
+            for (size_t t = 0; t < targets->sz; t++) {
+                if (strcmp(targets->ptr[t].output, name) == 0) {
+                    targets->ptr[t].key = key;
+                    targets->ptr[t].hasKey = true;
+                }
+            }
+        }
+    }
+
+    free(name);
+    fclose(fp);
+}
+
+
+static void writeBuildState(const TargetArray *targets, const char *stateFile) {
+    FILE *fp = fopen(stateFile, "wb");
+    uint32_t count = 0;
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", stateFile);
+        return;
+    }
+
+    for (size_t t = 0; t < targets->sz; t++) {
+        count += targets->ptr[t].hasKey;
+    }
+
+    fwrite(BUILD_STATE_MAGIC, 1, 4, fp);
+    fwrite(&count, 4, 1, fp);
+
+    for (size_t t = 0; t < targets->sz; t++) {
+        if (targets->ptr[t].hasKey) {
+            fwrite(targets->ptr[t].output, 1, strlen(targets->ptr[t].output) + 1, fp);
+            fwrite(&targets->ptr[t].key, 8, 1, fp);
+        }
+    }
+
+    fclose(fp);
+}
+
+
+static bool fileExists(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+
+    if (fp != NULL) {
+        fclose(fp);
+    }
+
+    return (fp != NULL);
+}
+
+
+static bool stopped(Build *build) {
+    return !build->options.keepGoing && __atomic_load_n(&build->failed, __ATOMIC_ACQUIRE);
+}
+
+
+// Shows the errors of a finished target and how far the build is
+static void reportTarget(Build *build, Target *target) {
+    pthread_mutex_lock(&build->reportMutex);
+
+    for (size_t i = 0; i < target->unitCount; i++) {
+        LC3_FlushDiagnostics(&target->units[i]);
+    }
+
+    if (target->status == TARGET_BUILT || target->status == TARGET_FAILED) {
+        build->finished++;
+        printf(target->status == TARGET_BUILT ? "[%zu/%zu] %s\n" : "[%zu/%zu] %s \x1b[1;31mfailed\x1b[0m\n",
+            build->finished, build->scheduled, target->output);
+    }
+
+    pthread_mutex_unlock(&build->reportMutex);
+}
+
+
+static void failTarget(Build *build, Target *target) {
+    target->status = TARGET_FAILED;
+    target->hasKey = false;
+    __atomic_store_n(&build->failed, true, __ATOMIC_RELEASE);
+}
+
+
+// Opens the archives of target and creates its units, once every input it depends on is built
+static void prepareTarget(Build *build, Target *target) {
+    size_t memberCount = 0;
+
+    for (size_t i = 0; i < target->inputCount; i++) {
+        size_t producer = target->producers[i];
+
+        if (producer != NO_TARGET && (build->targets.ptr[producer].status == TARGET_FAILED || build->targets.ptr[producer].status == TARGET_SKIPPED)) {
+            target->status = TARGET_SKIPPED;
+        }
+    }
+
+    if (target->status == TARGET_SKIPPED || stopped(build)) {
+        target->status = TARGET_SKIPPED;
+        return;
+    }
+
+    target->ctx = (LC3_Context){
+        .storeDebug  = target->storeDebug,
+        .storeIndent = target->storeIndent,
+        .workers     = 1,
+        .keepGoing   = build->options.keepGoing,
+        .cacheDir    = build->options.cacheDir,
+        .error       = false,
+    };
+
+    target->opened = vaMalloc("LC3_Archive", (target->inputCount + 1) * sizeof(LC3_Archive *));
+
+    for (size_t i = 0; i < target->inputCount; i++) {
+        if (!target->archives[i]) {
+            target->sourceCount++;
+            continue;
+        }
+
+        LC3_Archive *archive = (target->kind == TARGET_EXECUTABLE) ? LC3_OpenArchive(target->inputs[i]) : NULL;
+
+        if (archive == NULL) {
+            pthread_mutex_lock(&build->reportMutex);
+            printf((target->kind == TARGET_EXECUTABLE) ?
+                "\x1b[1;31merror:\x1b[0m invalid archive %s\n" :
+                "\x1b[1;31merror:\x1b[0m archive %s can only be used when linking\n", target->inputs[i]);
+            pthread_mutex_unlock(&build->reportMutex);
+
+            for (size_t a = 0; a < target->openedCount; a++) {
+                LC3_CloseArchive(target->opened[a]);
+            }
+
+            failTarget(build, target);
+            reportTarget(build, target);
+            return;
+        }
+
+        target->opened[target->openedCount++] = archive;
+        memberCount += archive->memberCount;
+    }
+
+    // Room for every member that could be extracted
+    target->units = vaMalloc("LC3_Unit", (target->sourceCount + memberCount + 1) * sizeof(LC3_Unit));
+
+    for (size_t i = 0; i < target->inputCount; i++) {
+        if (!target->archives[i]) {
+            target->units[target->unitCount++] = LC3_CreateUnit(&target->ctx, target->inputs[i]);
+        }
+    }
+}
+
+
+static bool writeExecutable(Target *target) {
+    FILE *fp = fopen(target->output, "wb");
+
+    if (fp == NULL) {
+        LC3_SimpleError(&target->units[0], "failed to open file %s\n", target->output);
+        return false;
+    }
+
+    for (size_t i = 0; i < target->unitCount; i++) {
+        LC3_WriteExecutableUnit(&target->units[i], fp, (i == 0));
+    }
+
+    fclose(fp);
+    return true;
+}
+
+
+static bool writeObject(Target *target) {
+    FILE *fp = fopen(target->output, "wb");
+
+    if (fp == NULL) {
+        LC3_SimpleError(&target->units[0], "failed to open file %s\n", target->output);
+        return false;
+    }
+
+    LC3_WriteObject(&target->units[0], fp, true);
+    fclose(fp);
+    return true;
+}
+
+
+// Links and writes target once all of its sources are assembled
+static void linkTarget(Build *build, Target *target) {
+    if (target->units == NULL) {
+        return;
+    }
+
+    bool written = false;
+
+    if (target->ctx.error) {
+        failTarget(build, target);
+    } else if (stopped(build)) {
+        target->status = TARGET_SKIPPED;
+    } else {
+        if (target->openedCount > 0) {
+            target->unitCount = LC3_ExtractMembers(target->openedCount, target->opened, target->unitCount, target->units, &target->ctx);
+        }
+
+        // Archives alone only give the members that something else refers to, the output is written from the first unit
+        if (!target->ctx.error && target->unitCount == 0) {
+            pthread_mutex_lock(&build->reportMutex);
+            printf("\x1b[1;31merror:\x1b[0m no input files for %s\n", target->output);
+            pthread_mutex_unlock(&build->reportMutex);
+            target->ctx.error = true;
+        }
+
+        if (!target->ctx.error && target->kind == TARGET_EXECUTABLE) {
+            LC3_LinkUnits(target->unitCount, target->units);
+        }
+
+        if (!target->ctx.error && target->kind == TARGET_EXECUTABLE) {
+            written = writeExecutable(target);
+        } else if (!target->ctx.error && target->kind == TARGET_OBJECT) {
+            written = writeObject(target);
+        } else if (!target->ctx.error) {
+            written = LC3_WriteArchive(target->unitCount, target->units, target->output);
+        }
+
+        if (written) {
+            target->status = TARGET_BUILT;
+            target->key = targetKey(target);
+            target->hasKey = true;
+        } else {
+            failTarget(build, target);
+        }
+    }
+
+    reportTarget(build, target);
+
+    // Extracted units refer to their archive for their name
+    for (size_t i = 0; i < target->unitCount; i++) {
+        LC3_DestroyUnit(target->units[i]);
+    }
+
+    for (size_t i = 0; i < target->openedCount; i++) {
+        LC3_CloseArchive(target->opened[i]);
+    }
+
+    vaFree(target->units);
+    target->units = NULL;
+    target->unitCount = 0;
+}
+
+
+static void runNode(void *data, size_t index, size_t worker) {
+    Build *build = data;
+    BuildNode *node = &build->nodes[index];
+    Target *target = &build->targets.ptr[node->target];
+
+    if (node->kind == NODE_PREPARE) {
+        prepareTarget(build, target);
+    } else if (node->kind == NODE_ASSEMBLE && target->units != NULL && !stopped(build)) {
+        LC3_AssembleUnit(&target->units[node->unit]);
+    } else if (node->kind == NODE_LINK) {
+        linkTarget(build, target);
+    }
+}
+
+
+// Marks targets whose output is missing, whose inputs or flags changed, or that use a stale target, in dependency order
+static size_t findStaleTargets(TargetArray *targets, const size_t *order) {
+    size_t staleCount = 0;
+
+    for (size_t o = 0; o < targets->sz; o++) {
+        Target *target = &targets->ptr[order[o]];
+        bool stale = !target->hasKey || !fileExists(target->output);
+
+        for (size_t i = 0; !stale && i < target->inputCount; i++) {
+            stale = (target->producers[i] != NO_TARGET && targets->ptr[target->producers[i]].status == TARGET_STALE);
+        }
+
+        if (stale || targetKey(target) != target->key) {
+            target->status = TARGET_STALE;
+            staleCount++;
+        }
+    }
+
+    return staleCount;
+}
+
+
+// Schedules the nodes of all stale targets on the pool
+static void buildStaleTargets(Build *build, const size_t *order) {
+    TargetArray *targets = &build->targets;
+    size_t nodeCount = 0, edgeCount = 0;
+
+    // Preparing waits for producers, assembling waits for preparing, linking waits for both
+    for (size_t o = 0; o < targets->sz; o++) {
+        Target *target = &targets->ptr[order[o]];
+
+        if (target->status == TARGET_STALE) {
+            size_t sources = 0;
+
+            for (size_t i = 0; i < target->inputCount; i++) {
+                sources += !target->archives[i];
+            }
+
+            target->linkNode = nodeCount + sources + 1;
+            nodeCount += sources + 2;
+            edgeCount += target->inputCount + 2 * sources + 1;
+        }
+    }
+
+    build->nodes = vaMalloc("LC3_Build", (nodeCount + 1) * sizeof(BuildNode));
+    size_t *depStart = vaMalloc("LC3_Build", (nodeCount + 1) * sizeof(size_t));
+    size_t *deps = vaMalloc("LC3_Build", (edgeCount + 1) * sizeof(size_t));
+    uint64_t *costs = vaMalloc("LC3_Build", (nodeCount + 1) * sizeof(uint64_t));
+    size_t node = 0, edge = 0;
+
+    for (size_t o = 0; o < targets->sz; o++) {
+        Target *target = &targets->ptr[order[o]];
+
+        if (target->status != TARGET_STALE) {
+            continue;
+        }
+
+        size_t prepare = node, sources = 0;
+
+        // Preparing and linking unlock other work, so they go before assembling
+        depStart[node] = edge;
+        costs[node] = UINT64_MAX;
+        build->nodes[node++] = (BuildNode){NODE_PREPARE, order[o], 0};
+
+        for (size_t i = 0; i < target->inputCount; i++) {
+            size_t producer = target->producers[i];
+
+            if (producer != NO_TARGET && targets->ptr[producer].status == TARGET_STALE) {
+                deps[edge++] = targets->ptr[producer].linkNode;
+            }
+        }
+
+        for (size_t i = 0; i < target->inputCount; i++) {
+            if (!target->archives[i]) {
+                depStart[node] = edge;
+                deps[edge++] = prepare;
+                costs[node] = LC3_FileSize(target->inputs[i]);
+                build->nodes[node++] = (BuildNode){NODE_ASSEMBLE, order[o], sources++};
+            }
+        }
+
+        depStart[node] = edge;
+        deps[edge++] = prepare;
+
+        for (size_t s = 0; s < sources; s++) {
+            deps[edge++] = prepare + 1 + s;
+        }
+
+        costs[node] = UINT64_MAX;
+        build->nodes[node++] = (BuildNode){NODE_LINK, order[o], 0};
+    }
+
+    depStart[node] = edge;
+
+    size_t workers = (build->options.workers > 0) ? build->options.workers : LC3_ProcessorCount();
+    LC3_RunJobGraph(nodeCount, workers, runNode, build, costs, depStart, deps);
+
+    vaFree(costs);
+    vaFree(deps);
+    vaFree(depStart);
+}
+
+
+static void printSummary(Build *build) {
+    size_t counts[TARGET_SKIPPED + 1] = {0}, hits = 0, misses = 0;
+
+    for (size_t t = 0; t < build->targets.sz; t++) {
+        counts[build->targets.ptr[t].status]++;
+        hits += build->targets.ptr[t].ctx.cacheHits;
+        misses += build->targets.ptr[t].ctx.cacheMisses;
+    }
+
+    printf("%zu targets: %zu built, %zu up to date, %zu failed, %zu skipped\n", build->targets.sz,
+        counts[TARGET_BUILT], counts[TARGET_UP_TO_DATE], counts[TARGET_FAILED], counts[TARGET_SKIPPED]);
+
+    if (build->options.cacheDir != NULL) {
+        printf("cache: %zu hits, %zu misses\n", hits, misses);
+    }
+}
+
+
+long LC3_RunBuild(const char *manifest, const LC3_AssemblerOptions *options) {
+    Build build = {.targets = newTargetArray(), .options = *options, .nodes = NULL, .failed = false};
+    size_t *order = NULL, count = 0;
+    long failed = -1;
+    bool valid = readManifest(manifest, &build.targets) && findProducers(manifest, &build.targets);
+
+    if (valid) {
+        order = vaMalloc("LC3_Build", (build.targets.sz + 1) * sizeof(size_t));
+
+        for (size_t t = 0; valid && t < build.targets.sz; t++) {
+            valid = sortTarget(manifest, &build.targets, t, order, &count);
+        }
+    }
+
+    if (valid) {
+        size_t len = strlen(manifest);
+        char *stateFile = vaMalloc("LC3_Build", len + 7);
+        memcpy(stateFile, manifest, len);
+        memcpy(stateFile + len, ".state", 7);
+
+        readBuildState(&build.targets, stateFile);
+        build.scheduled = findStaleTargets(&build.targets, order);
+        pthread_mutex_init(&build.reportMutex, NULL);
+
+        buildStaleTargets(&build, order);
+        writeBuildState(&build.targets, stateFile);
+        printSummary(&build);
+
+        pthread_mutex_destroy(&build.reportMutex);
+        vaFree(stateFile);
+        failed = 0;
+
+        for (size_t t = 0; t < build.targets.sz; t++) {
+            failed += (build.targets.ptr[t].status == TARGET_FAILED);
+        }
+    }
+
+    for (size_t t = 0; t < build.targets.sz; t++) {
+        vaFree(build.targets.ptr[t].opened);
+        freeTarget(&build.targets.ptr[t]);
+    }
+
+    vaFree(build.targets.ptr);
+    vaFree(build.nodes);
+    vaFree(order);
+    return failed;
+}
@@ -0,0 +1,16 @@
+/*
+ * Description:
+ * Build manifests, bring a set of targets up to date by only rebuilding what changed.
+ * Every line of a manifest is a target: its output, a colon, then its inputs and flags (-g or -G). Lines starting with '#' are skipped.
+ * Outputs ending in .obj are assembled objects of a single source, outputs ending in .lca are archives, all others are executables.
+ * Inputs may be outputs of other targets, which are then built first
+ */
+
+#pragma once
+#include "lc3_lib.h"
+
+
+// Builds every target of manifest that is out of date, assembling and linking on a shared pool of options->workers threads.
+// Targets are out of date if their output is missing, or their flags or the contents of their inputs changed since they
+// were last built, which is kept in the file manifest.state. Returns the number of failed targets, or -1 if the manifest is invalid
+long LC3_RunBuild(const char *manifest, const LC3_AssemblerOptions *options);
@@ -0,0 +1,494 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_cache.h"
+#include "lc3_state.h"
+#include "lib/va_alloc.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Entry layout: magic, flags, text size, text, line count, location count, locations, object
+#define CACHE_MAGIC   "LC3K"
+#define CACHE_VERSION (1)
+
+
+#define MEMORY_BASE_SLOTS (64)
+
+
+enum CacheFlag {
+    LC3_CACHE_DEBUG  = 0x01,
+    LC3_CACHE_INDENT = 0x02,
+};
+
+
+// Entry kept in memory, in the same layout as on disk
+typedef struct MemoryEntry {
+    uint64_t key;
+    char *data; // NULL if the slot is empty
+    size_t size;
+} MemoryEntry;
+
+
+// Open addressing table of entries, shared by all workers of the process
+static struct {
+    pthread_mutex_t mutex;
+    MemoryEntry *slots;
+    size_t slotCount, count;
+    size_t bytes, limit; // Disabled if limit is 0
+    size_t hits, misses;
+} memory = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+static uint16_t cacheFlags(const LC3_Context *ctx) {
+    return (ctx->storeDebug ? LC3_CACHE_DEBUG : 0) | (ctx->storeIndent ? LC3_CACHE_INDENT : 0);
+}
+
+
+// FNV-1a hash of text, the object format and the flags, so a change to any of them gives a different entry
+static uint64_t cacheKey(const LC3_Context *ctx, const char *text, size_t size) {
+    uint16_t header[2] = {CACHE_VERSION, cacheFlags(ctx)};
+    uint64_t hash = LC3_HashBytes(LC3_HASH_INIT, MAGIC_NUM, 4);
+
+    hash = LC3_HashBytes(hash, header, sizeof(header));
+    return LC3_HashBytes(hash, text, size);
+}
+
+
+// Path of the entry for key, followed by suffix
+static char *entryPath(const char *dir, uint64_t key, const char *suffix) {
+    int len = snprintf(NULL, 0, "%s/%016" PRIx64 "%s", dir, key, suffix);
+    char *path = vaMalloc("LC3_Cache", len + 1);
+
+    snprintf(path, len + 1, "%s/%016" PRIx64 "%s", dir, key, suffix);
+    return path;
+}
+
+
+static MemoryEntry *findSlot(MemoryEntry *slots, size_t slotCount, uint64_t key) {
+    size_t i = key & (slotCount - 1);
+
+    while (slots[i].data != NULL && slots[i].key != key) {
+        i = (i + 1) & (slotCount - 1);
+    }
+
+    return &slots[i];
+}
+
+
+static void clearMemory() {
+    for (size_t i = 0; i < memory.slotCount; i++) {
+        vaFree(memory.slots[i].data);
+    }
+
+    vaFree(memory.slots);
+    memory.slots = NULL;
+    memory.slotCount = memory.count = memory.bytes = 0;
+}
+
+
+void LC3_KeepCacheInMemory(size_t limit) {
+    pthread_mutex_lock(&memory.mutex);
+    __atomic_store_n(&memory.limit, limit, __ATOMIC_RELAXED);
+
+    if (limit == 0) {
+        clearMemory();
+    }
+
+    pthread_mutex_unlock(&memory.mutex);
+}
+
+
+static bool memoryEnabled() {
+    return __atomic_load_n(&memory.limit, __ATOMIC_RELAXED) > 0;
+}
+
+
+bool LC3_CacheEnabled(const LC3_Context *ctx) {
+    return ctx != NULL && (ctx->cacheDir != NULL || memoryEnabled());
+}
+
+
+void LC3_GetMemoryCacheStats(LC3_MemoryCacheStats *stats) {
+    pthread_mutex_lock(&memory.mutex);
+    (*stats) = (LC3_MemoryCacheStats){memory.count, memory.bytes, memory.hits, memory.misses};
+    pthread_mutex_unlock(&memory.mutex);
+}
+
+
+// Takes ownership of data. Once the limit is reached all entries are dropped, which keeps the cache bounded without
+// tracking how recently entries were used
+static void storeMemoryEntry(uint64_t key, char *data, size_t size) {
+    pthread_mutex_lock(&memory.mutex);
+
+    if (memory.limit == 0 || size > memory.limit) {
+        pthread_mutex_unlock(&memory.mutex);
+        vaFree(data);
+        return;
+    }
+
+    if (memory.bytes + size > memory.limit) {
+        clearMemory();
+    }
+
+    if (2 * (memory.count + 1) > memory.slotCount) {
+        size_t slotCount = (memory.slotCount == 0) ? MEMORY_BASE_SLOTS : 2 * memory.slotCount;
+        MemoryEntry *slots = vaMalloc("LC3_Cache", slotCount * sizeof(MemoryEntry));
+
+        memset(slots, 0, slotCount * sizeof(MemoryEntry));
+
+        for (size_t i = 0; i < memory.slotCount; i++) {
+            if (memory.slots[i].data != NULL) {
+                (*findSlot(slots, slotCount, memory.slots[i].key)) = memory.slots[i];
+            }
+        }
+
+        vaFree(memory.slots);
+        memory.slots = slots;
+        memory.slotCount = slotCount;
+    }
+
+    MemoryEntry *slot = findSlot(memory.slots, memory.slotCount, key);
+
+    if (slot->data != NULL) {
+        memory.bytes -= slot->size;
+        vaFree(slot->data);
+    } else {
+        memory.count++;
+    }
+
+    (*slot) = (MemoryEntry){key, data, size};
+    memory.bytes += size;
+    pthread_mutex_unlock(&memory.mutex);
+}
+
+
+// Returns a copy of the entry, so it stays valid if the cache is cleared by another worker
+static char *loadMemoryEntry(uint64_t key, size_t *size) {
+    char *data = NULL;
+
+    pthread_mutex_lock(&memory.mutex);
+
+    if (memory.limit > 0) {
+        MemoryEntry *slot = (memory.slotCount > 0) ? findSlot(memory.slots, memory.slotCount, key) : NULL;
+
+        if (slot != NULL && slot->data != NULL) {
+            data = vaMalloc("LC3_Cache", slot->size);
+            memcpy(data, slot->data, slot->size);
+            (*size) = slot->size;
+            memory.hits++;
+        } else {
+            memory.misses++;
+        }
+    }
+
+    pthread_mutex_unlock(&memory.mutex);
+    return data;
+}
+
+
+static char *readEntryFile(const char *path, size_t *size) {
+    FILE *fp = fopen(path, "rb");
+    char *data = NULL;
+    long len = -1;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        data = vaMalloc("LC3_Cache", len);
+
+        if (fread(data, 1, len, fp) != (size_t)len) {
+            vaFree(data);
+            data = NULL;
+        }
+    }
+
+    fclose(fp);
+    (*size) = (len > 0) ? len : 0;
+    return data;
+}
+
+
+bool LC3_OpenCache(const char *dir) {
+    struct stat info;
+
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    return (stat(dir, &info) == 0 && S_ISDIR(info.st_mode) && access(dir, R_OK | W_OK | X_OK) == 0);
+}
+
+
+// Entries store the text they were assembled from, so a hash collision is a miss and not a wrong object
+static bool matchText(FILE *fp, uint16_t flags, const char *text, size_t size) {
+    char magic[4], chunk[4096];
+    uint16_t entryFlags = 0;
+    uint64_t entrySize = 0;
+
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, CACHE_MAGIC, 4) != 0 ||
+        fread(&entryFlags, 2, 1, fp) != 1 || entryFlags != flags ||
+        fread(&entrySize, 8, 1, fp) != 1 || entrySize != size) {
+        return false;
+    }
+
+    for (size_t done = 0; done < size;) {
+        size_t count = (size - done < sizeof(chunk)) ? size - done : sizeof(chunk);
+
+        if (fread(chunk, 1, count, fp) != count || memcmp(chunk, text + done, count) != 0) {
+            return false;
+        }
+
+        done += count;
+    }
+
+    return true;
+}
+
+
+// Object files only keep label names, the source position of every symbol and relocation is stored next to them
+static void writeLocation(FILE *fp, BufferSegment seg) {
+    uint32_t line = seg.line;
+    fwrite(&line, 4, 1, fp);
+    fwrite(&seg.tk.start, 2, 1, fp);
+}
+
+
+static void setLocation(const uint8_t *location, uint32_t lineCount, BufferSegment *seg, bool *keep, bool *valid) {
+    uint32_t line;
+    memcpy(&line, location, 4);
+    memcpy(&seg->tk.start, location + 4, 2);
+    seg->line = line;
+
+    (*valid) = (*valid) && line < lineCount;
+    keep[(*valid) ? line : 0] = true;
+}
+
+
+// Copies the source lines that labels refer to, like readLines. The others stay empty, like after releasing the source
+static void restoreLines(LC3_Unit *unit, const char *text, size_t size, const bool *keep, uint32_t lineCount) {
+    StringArray buf = {vaMalloc("StringArray", (lineCount + 1) * sizeof(String)), lineCount, lineCount + 1};
+    size_t line = 0;
+
+    for (size_t start = 0; start < size && line < lineCount; line++) {
+        const char *current = text + start;
+        const char *newline = memchr(current, '\n', size - start);
+        size_t end = (newline != NULL) ? (size_t)(newline - text) : size;
+        buf.ptr[line] = (String){0};
+
+        if (keep[line]) {
+            buf.ptr[line] = copyLine(current, sourceLineLength(current, end - start));
+        }
+
+        start = end + 1;
+    }
+
+    for (; line < lineCount; line++) {
+        buf.ptr[line] = (String){0};
+    }
+
+    for (size_t i = 0; i < unit->buf.sz; i++) {
+        vaFree(unit->buf.ptr[i].ptr);
+    }
+
+    vaFree(unit->buf.ptr);
+    unit->buf = buf;
+}
+
+
+// Moves the labels of an object read from an entry back to their place in the source
+static bool relocateLabels(LC3_Unit *unit, const char *text, size_t size, FILE *fp) {
+    uint32_t counts[2] = {0}, relocCount = 0;
+
+    // Every line and label takes at least a byte of text
+    if (fread(counts, 4, 2, fp) != 2 || counts[0] > size + 1 || counts[1] > size) {
+        return false;
+    }
+
+    uint8_t *locations = vaMalloc("LC3_Cache", (size_t)counts[1] * 6 + 1);
+    bool *keep = vaMalloc("LC3_Cache", (size_t)counts[0] + 1);
+    bool valid = (fread(locations, 6, counts[1], fp) == counts[1]);
+    size_t next = 0;
+
+    memset(keep, 0, (size_t)counts[0] + 1);
+
+    // Errors in a damaged entry must not fail the build, so they are kept out of the context
+    LC3_Context *ctx = unit->ctx;
+    unit->ctx = NULL;
+
+    if (valid) {
+        LC3_ReadObject(unit, fp, -1);
+    }
+
+    unit->ctx = ctx;
+
+    for (size_t i = 0; i < unit->obj.sz; i++) {
+        relocCount += unit->obj.ptr[i].reloc.sz;
+    }
+
+    valid = valid && !unit->error && counts[1] == unit->symb.sz + relocCount;
+
+    for (size_t i = 0; valid && i < unit->symb.sz; i++) {
+        setLocation(&locations[6 * next++], counts[0], &unit->symb.ptr[i].loc, keep, &valid);
+    }
+
+    for (size_t section = 0; valid && section < unit->obj.sz; section++) {
+        for (size_t i = 0; i < unit->obj.ptr[section].reloc.sz; i++) {
+            setLocation(&locations[6 * next++], counts[0], &unit->obj.ptr[section].reloc.ptr[i].label, keep, &valid);
+        }
+    }
+
+    if (valid) {
+        restoreLines(unit, text, size, keep, counts[0]);
+    }
+
+    vaFree(keep);
+    vaFree(locations);
+    return valid;
+}
+
+
+bool LC3_LoadCached(LC3_Unit *unit, const char *text, size_t size) {
+    LC3_Context *ctx = unit->ctx;
+    uint64_t key = cacheKey(ctx, text, size);
+    size_t entrySize = 0;
+    char *entry = loadMemoryEntry(key, &entrySize);
+    bool hit = false, fromDisk = false;
+
+    if (entry == NULL && ctx->cacheDir != NULL) {
+        char *path = entryPath(ctx->cacheDir, key, "");
+        entry = readEntryFile(path, &entrySize);
+        fromDisk = (entry != NULL);
+        vaFree(path);
+    }
+
+    // Entries are read completely first, so ones from disk can be kept in memory as they are
+    FILE *fp = (entry != NULL) ? fmemopen(entry, entrySize, "rb") : NULL;
+
+    if (fp != NULL && matchText(fp, cacheFlags(ctx), text, size)) {
+        hit = relocateLabels(unit, text, size, fp);
+    }
+
+    if (fp != NULL) {
+        fclose(fp);
+    }
+
+    if (hit && fromDisk) {
+        storeMemoryEntry(key, entry, entrySize);
+        entry = NULL;
+    }
+
+    vaFree(entry);
+
+    // Start over with an empty unit, which is assembled from text instead
+    if (!hit && (unit->error || unit->buf.sz > 0 || unit->obj.sz > 0 || unit->symb.sz > 0)) {
+        LC3_Unit fresh = LC3_CreateUnit(ctx, unit->filename);
+        fresh.source = unit->source;
+        fresh.sourceSize = unit->sourceSize;
+
+        LC3_DestroyUnit(*unit);
+        (*unit) = fresh;
+        vaMemSetOwner(unit->filename);
+    }
+
+    __atomic_add_fetch(hit ? &ctx->cacheHits : &ctx->cacheMisses, 1, __ATOMIC_RELAXED);
+    return hit;
+}
+
+
+static void writeEntry(LC3_Unit *unit, FILE *fp, const char *text, size_t size) {
+    uint16_t flags = cacheFlags(unit->ctx);
+    uint64_t textSize = size;
+
+    fwrite(CACHE_MAGIC, 1, 4, fp);
+    fwrite(&flags, 2, 1, fp);
+    fwrite(&textSize, 8, 1, fp);
+    fwrite(text, 1, size, fp);
+
+    uint32_t counts[2] = {unit->buf.sz, unit->symb.sz};
+
+    for (size_t i = 0; i < unit->obj.sz; i++) {
+        counts[1] += unit->obj.ptr[i].reloc.sz;
+    }
+
+    fwrite(counts, 4, 2, fp);
+
+    for (size_t i = 0; i < unit->symb.sz; i++) {
+        writeLocation(fp, unit->symb.ptr[i].loc);
+    }
+
+    for (size_t section = 0; section < unit->obj.sz; section++) {
+        for (size_t i = 0; i < unit->obj.ptr[section].reloc.sz; i++) {
+            writeLocation(fp, unit->obj.ptr[section].reloc.ptr[i].label);
+        }
+    }
+
+    LC3_WriteObject(unit, fp, true);
+}
+
+
+// Failing to store an entry only means the unit is assembled again next time
+static void storeDiskEntry(const char *dir, uint64_t key, const char *data, size_t size) {
+    char *temp = entryPath(dir, key, ".XXXXXX");
+    int fd = mkstemp(temp);
+    FILE *fp = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+
+    if (fp == NULL) {
+        if (fd >= 0) {
+            close(fd);
+            remove(temp);
+        }
+
+        vaFree(temp);
+        return;
+    }
+
+    // Other users of the cache need to be able to read the entry
+    fchmod(fd, 0644);
+
+    bool written = (fwrite(data, 1, size, fp) == size);
+    written = (fclose(fp) == 0) && written;
+
+    char *path = entryPath(dir, key, "");
+
+    if (!written || rename(temp, path) != 0) {
+        remove(temp);
+    }
+
+    vaFree(path);
+    vaFree(temp);
+}
+
+
+void LC3_StoreCached(LC3_Unit *unit, const char *text, size_t size) {
+    LC3_Context *ctx = unit->ctx;
+    uint64_t key = cacheKey(ctx, text, size);
+    char *buffer = NULL;
+    size_t bufferSize = 0;
+    FILE *fp = open_memstream(&buffer, &bufferSize);
+
+    if (fp == NULL) {
+        return;
+    }
+
+    writeEntry(unit, fp, text, size);
+    bool written = !ferror(fp);
+    written = (fclose(fp) == 0) && written;
+
+    if (written && ctx->cacheDir != NULL) {
+        storeDiskEntry(ctx->cacheDir, key, buffer, bufferSize);
+    }
+
+    // Buffers of open_memstream come from malloc
+    if (written && memoryEnabled()) {
+        char *data = vaMalloc("LC3_Cache", bufferSize);
+        memcpy(data, buffer, bufferSize);
+        storeMemoryEntry(key, data, bufferSize);
+    }
+
+    free(buffer);
+}
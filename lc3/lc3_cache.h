@@ -0,0 +1,36 @@
+/*
+ * Description:
+ * Content-addressed object cache, shared between processes.
+ * Objects are stored under a hash of the source text and the flags that affect assembly, together with the text itself.
+ * Long-running processes can keep entries in memory as well, in front of the directory or without one
+ */
+
+#pragma once
+#include "lc3_asm.h"
+
+
+typedef struct LC3_MemoryCacheStats {
+    size_t entries, bytes;
+    size_t hits, misses; // Lookups in memory since the start of the process
+} LC3_MemoryCacheStats;
+
+
+// Creates the cache directory if it does not exist yet, returns false if it can not be used
+bool LC3_OpenCache(const char *dir);
+
+// Keeps entries of every unit assembled by this process in memory, up to limit bytes (0 disables and frees them).
+// Units with the same text and flags are not assembled again, even without a cache directory
+void LC3_KeepCacheInMemory(size_t limit);
+
+// Whether units of ctx are looked up in a cache, on disk or in memory
+bool LC3_CacheEnabled(const LC3_Context *ctx);
+
+void LC3_GetMemoryCacheStats(LC3_MemoryCacheStats *stats);
+
+// Reads the object of text into unit if it was cached by an earlier build, returns false if it was not.
+// Counts a hit or miss in the context of unit
+bool LC3_LoadCached(LC3_Unit *unit, const char *text, size_t size);
+
+// Stores the object of unit, which was assembled from text without errors.
+// Entries are renamed into place once complete, so processes sharing the cache never read a partial entry
+void LC3_StoreCached(LC3_Unit *unit, const char *text, size_t size);
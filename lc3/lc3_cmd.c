@@ -1,6 +1,18 @@
 #include <stdio.h>
 #include "lc3_cmd.h"
 #include "lc3_asm.h"
+#include "lc3_ar.h"
+#include "lc3_batch.h"
+#include "lc3_build.h"
+#include "lc3_cache.h"
+#include "lc3_err.h"
+#include "lc3_mem.h"
+#include "lc3_state.h"
+#include "lc3_image.h"
+#include "lc3_out.h"
+#include "lc3_lsp.h"
+#include "lc3_serve.h"
+#include "lc3_watch.h"
 #include "lib/cmdarg.h"
 
 
@@ -10,6 +22,19 @@ enum LC3_CommandLineFlag {
     LC3_CMD_FLAG_SYMB    = 0x04,
     LC3_CMD_FLAG_DEBUG   = 0x08,
     LC3_CMD_FLAG_INDENT  = 0x10,
+    LC3_CMD_FLAG_MEMORY  = 0x20,
+    LC3_CMD_FLAG_ARCHIVE = 0x40,
+    LC3_CMD_FLAG_GC      = 0x80,
+    LC3_CMD_FLAG_IMAGE   = 0x100,
+    LC3_CMD_FLAG_BENCH   = 0x200,
+    LC3_CMD_FLAG_FORMAT  = 0x400,
+    LC3_CMD_FLAG_STREAM  = 0x800,
+    LC3_CMD_FLAG_WORKERS = 0x1000,
+    LC3_CMD_FLAG_KEEP    = 0x2000,
+    LC3_CMD_FLAG_JSON    = 0x4000,
+    LC3_CMD_FLAG_DEPS    = 0x8000,
+    LC3_CMD_FLAG_WATCH   = 0x10000,
+    LC3_CMD_FLAG_LSP     = 0x20000,
 };
 
 
@@ -19,19 +44,43 @@ static void showHelpMessage() {
     printf("  --help                     Display this information.\n");
     printf("  -a                         Assemble, but do not link.\n");
     printf("  -s                         Only output symbol table.\n");
+    printf("  -r                         Bundle the assembled files into an archive, which is only linked where needed.\n");
     printf("  -g                         Embed original code (excluding indentation) in output file.\n");
     printf("  -G                         Embed original code (including indentation) in output file.\n");
     printf("  -o <file>                  Place the output into <file>.\n");
+    printf("  -MD                        Write the inputs of every output as a make rule, to the output with .d as extension.\n");
+    printf("  -MF <file>                 Write the make rules to <file> instead.\n");
+    printf("  -j <count>                 Use <count> worker threads (default: one per online processor).\n");
+    printf("  --worker-report            Show how long every worker was busy and idle while assembling.\n");
+    printf("  --keep-going               Keep assembling the other files after an error, to report all errors.\n");
+    printf("  --diag-json[=<file>]       Write errors as JSON lines, to <file> or instead of showing them.\n");
+    printf("  -Map <file>                Write a map of sections, symbols and unit sizes to <file> when linking.\n");
+    printf("  --gc-sections              Leave out sections that are never referenced from the first section.\n");
+    printf("  --format=<lc3|obj|hex|bin> Output format when linking: this assembler's own executable (default),\n");
+    printf("                             big-endian LC3 object file, Intel HEX or raw big-endian binary.\n");
+    printf("  --image[=be|native]        Output a flat 64K-word memory image instead of an executable.\n");
+    printf("  --bench-load[=<count>]     Compare loading the output as an executable and as a memory image.\n");
+    printf("  --mem-report[=<file>]      Show memory use per unit, or write it to <file> as JSON.\n");
+    printf("  --stream                   Write units while linking and free them right away, for very large links.\n");
+    printf("  --cache <dir>              Reuse objects of sources assembled before from <dir>, and store new ones there.\n");
+    printf("  --batch <file>             Build every job in <file> (an output followed by its inputs, one job per line).\n");
+    printf("  --build <manifest>         Rebuild the targets in <manifest> that are out of date, see lc3/lc3_build.h.\n");
+    printf("  --link-state <file>        Keep link state in <file>, and only reassemble changed files when relinking.\n");
+    printf("  --watch                    Keep running, and relink the executable whenever an input is saved.\n");
+    printf("  --serve <socket>           Run a server on <socket> that keeps assembled sources in memory between requests.\n");
+    printf("  --connect <socket> ...     Run the rest of the command line on the server at <socket> (must come first).\n");
+    printf("  --lsp                      Run a language server for editors on stdin and stdout.\n");
 }
 
 
-static char objFilename[64];
+#define OBJ_FILENAME_SIZE (64)
 
 
-const char *getObjectFilename(const char *filename) {
+// Writes the object file name for filename into objFilename (OBJ_FILENAME_SIZE bytes) and returns it
+const char *getObjectFilename(const char *filename, char *objFilename) {
     int i;
 
-    for (i = 0; i < 60 && filename[i] != '\0' && filename[i] != '.'; i++) {
+    for (i = 0; i < OBJ_FILENAME_SIZE - 5 && filename[i] != '\0' && filename[i] != '.'; i++) {
         objFilename[i] = filename[i];
     }
 
@@ -40,16 +89,239 @@ const char *getObjectFilename(const char *filename) {
 }
 
 
+// Writes path as a make target or prerequisite
+static void writeMakePath(FILE *fp, const char *path) {
+    for (; *path != '\0'; path++) {
+        if (*path == '$') {
+            putc('$', fp);
+        } else if (*path == ' ' || *path == '\t' || *path == '#' || *path == ':') {
+            putc('\\', fp);
+        }
+
+        putc(*path, fp);
+    }
+}
+
+
+// Writes a make rule for every output, to the file given with -MF or next to every output. Outputs depend on all inputs,
+// unless there are multiple (objects of -a), then every output only depends on the input at the same index
+static void writeDependencies(ca_info *argInfo, size_t outputCount, const char **outputs, size_t inputCount, const char **inputs) {
+    const char *depFile = ca_flag_value(argInfo, "-MF");
+    FILE *fp = NULL;
+
+    for (size_t i = 0; i < outputCount; i++) {
+        if (depFile == NULL || i == 0) {
+            const char *filename = depFile;
+            char *derived = NULL;
+
+            if (depFile == NULL) {
+                // Extension of the output, if it has one, is replaced
+                const char *slash = strrchr(outputs[i], '/'), *dot = strrchr(outputs[i], '.');
+                size_t len = (dot != NULL && (slash == NULL || dot > slash)) ? (size_t)(dot - outputs[i]) : strlen(outputs[i]);
+
+                filename = derived = vaMalloc("DepFile", len + 3);
+                memcpy(derived, outputs[i], len);
+                memcpy(derived + len, ".d", 3);
+            }
+
+            if (fp != NULL) {
+                fclose(fp);
+            }
+
+            if ((fp = fopen(filename, "w")) == NULL) {
+                printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+            }
+
+            vaFree(derived);
+        }
+
+        if (fp == NULL) {
+            continue;
+        }
+
+        size_t first = (outputCount > 1) ? i : 0, count = (outputCount > 1) ? 1 : inputCount;
+
+        writeMakePath(fp, outputs[i]);
+        putc(':', fp);
+
+        for (size_t j = first; j < first + count; j++) {
+            fputs(" \\\n  ", fp);
+            writeMakePath(fp, inputs[j]);
+        }
+
+        putc('\n', fp);
+    }
+
+    if (fp != NULL) {
+        fclose(fp);
+    }
+}
+
+
+// Memory accounting has to start before the arguments are parsed to include them
+static bool wantsMemoryReport(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--mem-report", 12) == 0 && (argv[i][12] == '\0' || argv[i][12] == '=')) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Splits inputs into archives and files to assemble, returns false if an archive can not be opened
+static bool openArchives(size_t inputCount, const char **inputs, LC3_Archive **archives, size_t *archiveCount, const char **sources, size_t *sourceCount) {
+    for (size_t i = 0; i < inputCount; i++) {
+        if (!LC3_IsArchive(inputs[i])) {
+            sources[(*sourceCount)++] = inputs[i];
+            continue;
+        }
+
+        archives[*archiveCount] = LC3_OpenArchive(inputs[i]);
+
+        if (archives[*archiveCount] == NULL) {
+            printf("\x1b[1;31mfatal error:\x1b[0m invalid archive %s\nassembly terminated.\n", inputs[i]);
+            return false;
+        }
+
+        (*archiveCount)++;
+    }
+
+    return true;
+}
+
+
+// Writes the linked program in both formats and times loading them
+static void benchmarkLoad(ca_info *argInfo, size_t unitCount, LC3_Unit *units, const char *output, bool image) {
+    const char *countValue = ca_flag_value(argInfo, "--bench-load");
+    long count = (countValue == NULL) ? 1000 : strtol(countValue, NULL, 10);
+    char other[256];
+
+    if (count <= 0) {
+        printf("\x1b[1;31merror:\x1b[0m invalid benchmark count %s\n", countValue);
+        return;
+    }
+
+    // The format that was not requested is only written for the benchmark
+    snprintf(other, sizeof(other), "%s.bench", output);
+
+    if (image) {
+        LC3_WriteExecutable(unitCount, units, other);
+        LC3_BenchmarkLoad(other, output, count);
+    } else {
+        LC3_WriteImage(unitCount, units, other, false);
+        LC3_BenchmarkLoad(output, other, count);
+    }
+
+    remove(other);
+}
+
+
+// Errors go to the file given with --diag-json, or to stdout in place of the text
+static void openDiagnostics(ca_info *argInfo, LC3_Context *ctx) {
+    const char *filename = ca_flag_value(argInfo, "--diag-json");
+
+    if (!(ca_flags(argInfo) & LC3_CMD_FLAG_JSON)) {
+        return;
+    }
+
+    if (filename == NULL) {
+        ctx->diagJson = stdout;
+    } else if ((ctx->diagJson = fopen(filename, "w")) == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+    }
+}
+
+
+static void closeDiagnostics(LC3_Context *ctx) {
+    if (ctx->diagJson != NULL && ctx->diagJson != stdout) {
+        fclose(ctx->diagJson);
+    }
+
+    ctx->diagJson = NULL;
+}
+
+
+// Builds without a usable cache still work, they just assemble every source
+static void openCache(ca_info *argInfo, LC3_Context *ctx) {
+    const char *dir = ca_flag_value(argInfo, "--cache");
+
+    if (dir != NULL && LC3_OpenCache(dir)) {
+        ctx->cacheDir = dir;
+    } else if (dir != NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open cache directory %s\n", dir);
+    }
+}
+
+
+static void printCacheReport(const LC3_Context *ctx) {
+    if (ctx->cacheDir != NULL) {
+        printf("cache: %zu hits, %zu misses\n", ctx->cacheHits, ctx->cacheMisses);
+    }
+}
+
+
+static void writeMemoryReport(ca_info *argInfo) {
+    const char *filename = ca_flag_value(argInfo, "--mem-report");
+
+    if (filename == NULL) {
+        LC3_WriteMemoryReport(stdout, false);
+        return;
+    }
+
+    FILE *fp = fopen(filename, "w");
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+        return;
+    }
+
+    LC3_WriteMemoryReport(fp, true);
+    fclose(fp);
+}
+
+
 int LC3_AssemblyCommand(int argc, char **argv) {
+    // Everything after the socket is for the server
+    if (argc > 2 && strcmp(argv[1], "--connect") == 0) {
+        return LC3_Connect(argv[2], argc - 3, argv + 3);
+    }
+
+    if (wantsMemoryReport(argc, argv)) {
+        LC3_TrackMemory();
+    }
+
     ca_config *argConfig = ca_alloc_config();
 
     ca_bind_flag(argConfig, "--help", LC3_CMD_FLAG_HELP);
     ca_bind_flag(argConfig, "-a", LC3_CMD_FLAG_OBJ);
     ca_bind_flag(argConfig, "-s", LC3_CMD_FLAG_SYMB);
+    ca_bind_flag(argConfig, "-r", LC3_CMD_FLAG_ARCHIVE);
     ca_bind_flag(argConfig, "-g", LC3_CMD_FLAG_DEBUG);
     ca_bind_flag(argConfig, "-G", LC3_CMD_FLAG_DEBUG | LC3_CMD_FLAG_INDENT);
+    ca_bind_flag(argConfig, "--mem-report", LC3_CMD_FLAG_MEMORY);
+    ca_bind_flag(argConfig, "--gc-sections", LC3_CMD_FLAG_GC);
+    ca_bind_flag(argConfig, "--image", LC3_CMD_FLAG_IMAGE);
+    ca_bind_flag(argConfig, "--format", LC3_CMD_FLAG_FORMAT);
+    ca_bind_flag(argConfig, "--stream", LC3_CMD_FLAG_STREAM);
+    ca_bind_flag(argConfig, "--worker-report", LC3_CMD_FLAG_WORKERS);
+    ca_bind_flag(argConfig, "--keep-going", LC3_CMD_FLAG_KEEP);
+    ca_bind_flag(argConfig, "--diag-json", LC3_CMD_FLAG_JSON);
+    ca_bind_flag(argConfig, "--bench-load", LC3_CMD_FLAG_BENCH);
+    ca_bind_flag(argConfig, "-MD", LC3_CMD_FLAG_DEPS);
+    ca_bind_flag(argConfig, "--watch", LC3_CMD_FLAG_WATCH);
+    ca_bind_flag(argConfig, "--lsp", LC3_CMD_FLAG_LSP);
 
     ca_set_hasv(argConfig, "-o");
+    ca_set_hasv(argConfig, "-j");
+    ca_set_hasv(argConfig, "--link-state");
+    ca_set_hasv(argConfig, "--batch");
+    ca_set_hasv(argConfig, "--build");
+    ca_set_hasv(argConfig, "--serve");
+    ca_set_hasv(argConfig, "--cache");
+    ca_set_hasv(argConfig, "-Map");
+    ca_set_hasv(argConfig, "-MF");
 
     ca_info *argInfo = ca_parse(argConfig, argc - 1, argv + 1);
     uint64_t flags = ca_flags(argInfo);
@@ -65,63 +337,366 @@ int LC3_AssemblyCommand(int argc, char **argv) {
     const char **inputs = ca_literals(argInfo, &inputCount);
 
     // Pre-checks
-    if (inputCount == 0) {
+    const char *batchFile = ca_flag_value(argInfo, "--batch");
+    const char *manifest = ca_flag_value(argInfo, "--build");
+    const char *serveSocket = ca_flag_value(argInfo, "--serve");
+
+    if (inputCount == 0 && batchFile == NULL && manifest == NULL && serveSocket == NULL && !(flags & LC3_CMD_FLAG_LSP)) {
         printf("\x1b[1;31mfatal error:\x1b[0m no input files\nassembly terminated.\n");
         ca_free_info(argInfo);
         return 1;
     }
 
+    // Options of the server are those of every request
+    if (serveSocket != NULL) {
+        int status = 1;
+
+        if (argc != 3) {
+            printf("\x1b[1;31mfatal error:\x1b[0m '--serve' does not take any other options\nassembly terminated.\n");
+        } else {
+            status = LC3_Serve(serveSocket);
+        }
+
+        ca_free_info(argInfo);
+        return status;
+    }
+
+    // The editor talks to the language server on stdin and stdout, documents come from the editor
+    if (flags & LC3_CMD_FLAG_LSP) {
+        int status = 1;
+
+        if (argc != 2) {
+            printf("\x1b[1;31mfatal error:\x1b[0m '--lsp' does not take any other options\nassembly terminated.\n");
+        } else {
+            status = LC3_LanguageServer(stdin, stdout);
+        }
+
+        ca_free_info(argInfo);
+        return status;
+    }
+
     LC3_Context ctx = {
-        .output      = ca_flag_value(argInfo, "-o"),
-        .storeDebug  = (flags & LC3_CMD_FLAG_DEBUG),
-        .storeIndent = (flags & LC3_CMD_FLAG_INDENT),
-        .error       = false,
+        .output       = ca_flag_value(argInfo, "-o"),
+        .storeDebug   = (flags & LC3_CMD_FLAG_DEBUG),
+        .storeIndent  = (flags & LC3_CMD_FLAG_INDENT),
+        .gcSections   = (flags & LC3_CMD_FLAG_GC),
+        .mapFile      = ca_flag_value(argInfo, "-Map"),
+        .streamLink   = (flags & LC3_CMD_FLAG_STREAM),
+        .workers      = 0,
+        .workerReport = (flags & LC3_CMD_FLAG_WORKERS),
+        .keepGoing    = (flags & LC3_CMD_FLAG_KEEP),
+        .diagJson     = NULL,
+        .error        = false,
     };
 
+    const char *workers = ca_flag_value(argInfo, "-j");
+
+    if (workers != NULL) {
+        char *end;
+        long count = strtol(workers, &end, 10);
+
+        if (*workers == '\0' || *end != '\0' || count <= 0) {
+            printf("\x1b[1;31mfatal error:\x1b[0m invalid worker count '%s'\nassembly terminated.\n", workers);
+            ca_free_info(argInfo);
+            return 1;
+        }
+
+        ctx.workers = count;
+    }
+
+    openCache(argInfo, &ctx);
+
+    uint64_t singleOutput = LC3_CMD_FLAG_OBJ | LC3_CMD_FLAG_SYMB | LC3_CMD_FLAG_ARCHIVE | LC3_CMD_FLAG_GC | LC3_CMD_FLAG_IMAGE |
+        LC3_CMD_FLAG_BENCH | LC3_CMD_FLAG_FORMAT | LC3_CMD_FLAG_STREAM | LC3_CMD_FLAG_WORKERS | LC3_CMD_FLAG_JSON | LC3_CMD_FLAG_DEPS |
+        LC3_CMD_FLAG_WATCH;
+    bool hasOutput = (inputCount > 0 || ctx.output != NULL || ctx.mapFile != NULL || ca_flag_value(argInfo, "--link-state") != NULL ||
+        ca_flag_value(argInfo, "-MF") != NULL);
+    bool dependencies = (flags & LC3_CMD_FLAG_DEPS) || ca_flag_value(argInfo, "-MF") != NULL;
+
+    // Targets of a manifest have their own inputs, outputs and flags
+    if (manifest != NULL) {
+        if (hasOutput || batchFile != NULL || (flags & (singleOutput | LC3_CMD_FLAG_DEBUG))) {
+            printf("\x1b[1;31mfatal error:\x1b[0m '--build' only takes '-j', '--keep-going', '--cache' and '--mem-report'\nassembly terminated.\n");
+            ca_free_info(argInfo);
+            return 1;
+        }
+
+        LC3_AssemblerOptions options = {
+            .workers   = ctx.workers,
+            .keepGoing = ctx.keepGoing,
+            .cacheDir  = ctx.cacheDir,
+        };
+
+        long failed = LC3_RunBuild(manifest, &options);
+
+        if (flags & LC3_CMD_FLAG_MEMORY) {
+            writeMemoryReport(argInfo);
+        }
+
+        ca_free_info(argInfo);
+        return (failed != 0);
+    }
+
+    // Jobs of a batch are independent programs, with their own inputs and outputs
+    if (batchFile != NULL) {
+        if (hasOutput || (flags & singleOutput)) {
+            printf("\x1b[1;31mfatal error:\x1b[0m '--batch' only takes '-g', '-G', '-j', '--keep-going', '--cache' and '--mem-report'\nassembly terminated.\n");
+            ca_free_info(argInfo);
+            return 1;
+        }
+
+        LC3_AssemblerOptions options = {
+            .workers     = ctx.workers,
+            .storeDebug  = ctx.storeDebug,
+            .storeIndent = ctx.storeIndent,
+            .keepGoing   = ctx.keepGoing,
+            .cacheDir    = ctx.cacheDir,
+        };
+
+        long failed = LC3_RunBatch(batchFile, &options);
+
+        if (flags & LC3_CMD_FLAG_MEMORY) {
+            writeMemoryReport(argInfo);
+        }
+
+        ca_free_info(argInfo);
+        return (failed != 0);
+    }
+
+    const char *order = ca_flag_value(argInfo, "--image");
+    bool bigEndian = (order != NULL && strcmp(order, "be") == 0);
+
+    if (order != NULL && !bigEndian && strcmp(order, "native") != 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m unknown image byte order '%s'\nassembly terminated.\n", order);
+        ca_free_info(argInfo);
+        return 1;
+    }
+
+    // Formats of other tools are written by a backend, the default format is not
+    const char *format = ca_flag_value(argInfo, "--format");
+    const LC3_OutputBackend *backend = NULL;
+
+    if (format != NULL && strcmp(format, "lc3") != 0 && (backend = LC3_FindOutputBackend(format)) == NULL) {
+        printf("\x1b[1;31mfatal error:\x1b[0m unknown output format '%s'\nassembly terminated.\n", format);
+        ca_free_info(argInfo);
+        return 1;
+    }
+
+    if (backend != NULL && (flags & LC3_CMD_FLAG_IMAGE)) {
+        printf("\x1b[1;31mfatal error:\x1b[0m cannot specify '--format' with '--image'\nassembly terminated.\n");
+        ca_free_info(argInfo);
+        return 1;
+    }
+
+    // Streamed units are gone once written, so nothing else can use them
+    uint64_t needsUnits = LC3_CMD_FLAG_OBJ | LC3_CMD_FLAG_SYMB | LC3_CMD_FLAG_ARCHIVE | LC3_CMD_FLAG_IMAGE | LC3_CMD_FLAG_BENCH | LC3_CMD_FLAG_GC;
+
+    if (ctx.streamLink && ((flags & needsUnits) || backend != NULL || ca_flag_value(argInfo, "--link-state") != NULL)) {
+        printf("\x1b[1;31mfatal error:\x1b[0m '--stream' can only be used to link an executable\nassembly terminated.\n");
+        ca_free_info(argInfo);
+        return 1;
+    }
+
+    // Watched units stay in memory and are relinked as they are, only into an executable
+    uint64_t notWatched = needsUnits | LC3_CMD_FLAG_FORMAT | LC3_CMD_FLAG_STREAM | LC3_CMD_FLAG_DEPS;
+
+    if ((flags & LC3_CMD_FLAG_WATCH) && ((flags & notWatched) || ca_flag_value(argInfo, "--link-state") != NULL || ca_flag_value(argInfo, "-MF") != NULL)) {
+        printf("\x1b[1;31mfatal error:\x1b[0m '--watch' can only be used to link an executable\nassembly terminated.\n");
+        ca_free_info(argInfo);
+        return 1;
+    }
+
     if (inputCount > 1 && ctx.output != NULL && (flags & LC3_CMD_FLAG_OBJ)) {
         printf("\x1b[1;31mfatal error:\x1b[0m cannot specify '-o' with '-a' with multiple files\nassembly terminated.\n");
         ca_free_info(argInfo);
         return 1;
     }
 
-    // Assembly process
-    LC3_Unit *units = malloc(inputCount * sizeof(LC3_Unit));
+    // Archive members are only added when linking needs them
+    LC3_Archive **archives = vaMalloc("LC3_Archive", inputCount * sizeof(LC3_Archive *));
+    const char **sources = vaMalloc("LC3_Unit", inputCount * sizeof(const char *));
+    size_t archiveCount = 0, sourceCount = 0, memberCount = 0;
+    bool opened = openArchives(inputCount, inputs, archives, &archiveCount, sources, &sourceCount);
 
-    for (size_t i = 0; i < inputCount; i++) {
-        units[i] = LC3_CreateUnit(&ctx, inputs[i]);
+    if (opened && archiveCount > 0 && (flags & (LC3_CMD_FLAG_OBJ | LC3_CMD_FLAG_ARCHIVE))) {
+        printf("\x1b[1;31mfatal error:\x1b[0m archives can only be used when linking\nassembly terminated.\n");
+        opened = false;
+    }
+
+    if (opened && archiveCount > 0 && (flags & LC3_CMD_FLAG_WATCH)) {
+        printf("\x1b[1;31mfatal error:\x1b[0m archives can not be watched\nassembly terminated.\n");
+        opened = false;
     }
 
-    LC3_AssembleUnits(inputCount, units);
+    if (!opened) {
+        for (size_t i = 0; i < archiveCount; i++) {
+            LC3_CloseArchive(archives[i]);
+        }
 
-    if (!ctx.error && !(flags & LC3_CMD_FLAG_OBJ)) {
-        LC3_LinkUnits(inputCount, units);
+        vaFree(sources);
+        vaFree(archives);
+        ca_free_info(argInfo);
+        return 1;
+    }
+
+    for (size_t i = 0; i < archiveCount; i++) {
+        memberCount += archives[i]->memberCount;
+    }
+
+    const char *executable = (ctx.output != NULL) ? ctx.output : ((flags & LC3_CMD_FLAG_IMAGE) ? "out.img" : "out.lc3");
+    const char *linkState = (archiveCount == 0 && !ctx.gcSections && !(flags & LC3_CMD_FLAG_IMAGE) && backend == NULL) ?
+        ca_flag_value(argInfo, "--link-state") : NULL;
+
+    if (ctx.output == NULL && backend != NULL) {
+        executable = backend->defaultOutput;
+    }
+
+    openDiagnostics(argInfo, &ctx);
+
+    // Runs until interrupted, rebuilding the executable on every change
+    if (flags & LC3_CMD_FLAG_WATCH) {
+        bool watched = LC3_Watch(&ctx, inputCount, inputs, executable);
+
+        closeDiagnostics(&ctx);
+        printCacheReport(&ctx);
+
+        if (flags & LC3_CMD_FLAG_MEMORY) {
+            writeMemoryReport(argInfo);
+        }
+
+        vaFree(sources);
+        vaFree(archives);
+        ca_free_info(argInfo);
+        return !watched;
+    }
+
+    // Only the inputs that changed since the previous link have to be assembled again
+    if (linkState != NULL && !(flags & (LC3_CMD_FLAG_OBJ | LC3_CMD_FLAG_SYMB | LC3_CMD_FLAG_ARCHIVE))) {
+        LC3_RelinkResult result = LC3_Relink(&ctx, inputCount, inputs, executable, linkState);
+
+        if (result == LC3_RELINK_DONE && dependencies) {
+            writeDependencies(argInfo, 1, &executable, inputCount, inputs);
+        }
+
+        if (result != LC3_RELINK_UNAVAILABLE) {
+            closeDiagnostics(&ctx);
+            printCacheReport(&ctx);
+
+            if (flags & LC3_CMD_FLAG_MEMORY) {
+                writeMemoryReport(argInfo);
+            }
+
+            vaFree(sources);
+            vaFree(archives);
+            ca_free_info(argInfo);
+            return 0;
+        }
+    }
+
+    // Assembly process, with room for every member that could be extracted
+    int status = 0;
+    LC3_Unit *units = vaMalloc("LC3_Unit", (sourceCount + memberCount) * sizeof(LC3_Unit));
+    size_t unitCount = sourceCount;
+
+    for (size_t i = 0; i < sourceCount; i++) {
+        units[i] = LC3_CreateUnit(&ctx, sources[i]);
+    }
+
+    LC3_AssembleUnits(sourceCount, units);
+
+    if (!ctx.error && archiveCount > 0) {
+        unitCount = LC3_ExtractMembers(archiveCount, archives, sourceCount, units, &ctx);
+    }
+
+    // Archives alone only give the members that something else refers to
+    if (!ctx.error && unitCount == 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m no input files\nassembly terminated.\n");
+        ctx.error = true;
+        status = 1;
+    }
+
+    if (!ctx.error && ctx.streamLink) {
+        LC3_StreamLinkUnits(unitCount, units, executable);
+    } else if (!ctx.error && !(flags & (LC3_CMD_FLAG_OBJ | LC3_CMD_FLAG_ARCHIVE))) {
+        LC3_LinkUnits(unitCount, units);
     }
 
     // Writing output
+    const char *output = executable;
+
     if (!ctx.error && (flags & LC3_CMD_FLAG_OBJ)) {
-        for (size_t i = 0; i < inputCount; i++) {
-            FILE *fp = fopen((inputCount > 1 || ctx.output == NULL) ? getObjectFilename(units[i].filename) : ctx.output, "wb");
+        char (*objFilenames)[OBJ_FILENAME_SIZE] = vaMalloc("LC3_Unit", (unitCount + 1) * OBJ_FILENAME_SIZE);
+        const char **objects = vaMalloc("LC3_Unit", (unitCount + 1) * sizeof(const char *));
+
+        for (size_t i = 0; i < unitCount; i++) {
+            objects[i] = (unitCount > 1 || ctx.output == NULL) ? getObjectFilename(units[i].filename, objFilenames[i]) : ctx.output;
+
+            FILE *fp = fopen(objects[i], "wb");
             LC3_WriteObject(&units[i], fp, true);
             fclose(fp);
         }
+
+        // Every object only depends on its own source
+        if (dependencies) {
+            writeDependencies(argInfo, unitCount, objects, unitCount, sources);
+        }
+
+        vaFree(objects);
+        vaFree(objFilenames);
+        output = NULL;
+    } else if (!ctx.error && (flags & LC3_CMD_FLAG_ARCHIVE)) {
+        output = (ctx.output == NULL) ? "out.lca" : ctx.output;
+        LC3_WriteArchive(unitCount, units, output);
     } else if (!ctx.error && (flags & LC3_CMD_FLAG_SYMB)) {
-        FILE *fp = fopen((ctx.output == NULL) ? "out.symb" : ctx.output, "wb");
+        output = (ctx.output == NULL) ? "out.symb" : ctx.output;
+        FILE *fp = fopen(output, "wb");
 
-        for (size_t i = 0; i < inputCount; i++) {
+        for (size_t i = 0; i < unitCount; i++) {
             LC3_WriteSymbolTable(&units[i], fp, (i == 0));
         }
         
         fclose(fp);
-    } else if (!ctx.error) {
-        LC3_WriteExecutable(inputCount, units, (ctx.output == NULL) ? "out.lc3" : ctx.output);
+    } else if (!ctx.error && backend != NULL) {
+        LC3_WriteOutput(backend, unitCount, units, executable);
+    } else if (!ctx.error && (flags & LC3_CMD_FLAG_IMAGE)) {
+        LC3_WriteImage(unitCount, units, executable, bigEndian);
+    } else if (!ctx.error && !ctx.streamLink) {
+        LC3_WriteExecutable(unitCount, units, executable);
+
+        if (linkState != NULL) {
+            LC3_WriteLinkState(unitCount, units, executable, linkState);
+        }
     }
 
-    // Cleanup
-    for (size_t i = 0; i < inputCount; i++) {
+    if (!ctx.error && dependencies && output != NULL) {
+        writeDependencies(argInfo, 1, &output, inputCount, inputs);
+    }
+
+    if (!ctx.error && (flags & LC3_CMD_FLAG_BENCH) && backend == NULL && !(flags & (LC3_CMD_FLAG_OBJ | LC3_CMD_FLAG_SYMB | LC3_CMD_FLAG_ARCHIVE))) {
+        benchmarkLoad(argInfo, unitCount, units, executable, (flags & LC3_CMD_FLAG_IMAGE));
+    }
+
+    printCacheReport(&ctx);
+
+    if (flags & LC3_CMD_FLAG_MEMORY) {
+        writeMemoryReport(argInfo);
+    }
+
+    // Cleanup, extracted units refer to their archive for their name
+    for (size_t i = 0; i < unitCount; i++) {
+        LC3_FlushDiagnostics(&units[i]);
         LC3_DestroyUnit(units[i]);
     }
 
-    free(units);
+    closeDiagnostics(&ctx);
+
+    for (size_t i = 0; i < archiveCount; i++) {
+        LC3_CloseArchive(archives[i]);
+    }
+
+    vaFree(units);
+    vaFree(sources);
+    vaFree(archives);
     ca_free_info(argInfo);
-    return 0;
+    return status;
 }
@@ -1,68 +1,139 @@
 #include "lc3_err.h"
 #include "lc3_tk.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 
 
-static void setError(LC3_Unit *unit) {
+void LC3_SetError(LC3_Unit *unit) {
     unit->error = true;
 
     if (unit->ctx != NULL) {
-        unit->ctx->error = true;
+        __atomic_store_n(&unit->ctx->error, true, __ATOMIC_RELEASE);
     }
 }
 
 
-void LC3_linkerError(LC3_Unit *unit, const char *msg, Token tk, size_t line) {
-    String str = unit->buf.ptr[line];
-    char *tkString = tokenString(tk, str);
-    setError(unit);
+bool LC3_HasError(const LC3_Context *ctx) {
+    return (ctx != NULL && __atomic_load_n(&ctx->error, __ATOMIC_ACQUIRE));
+}
 
-    LC3_BeginOutput();
 
-    printf(tk.sz != 0 ? 
-        "\x1b[1m%s: \x1b[1;31merror:\x1b[0m %s \"\x1b[1m%s\x1b[0m\"\n" :
-        "\x1b[1m%s: \x1b[1;31merror:\x1b[0m %s\n",
-        unit->filename, msg, (tk.sz != 0) ? tkString : ""
-    );
+bool LC3_Cancelled(const LC3_Context *ctx) {
+    return (ctx != NULL && !ctx->keepGoing && LC3_HasError(ctx));
+}
 
-    LC3_FinishOutput();
-    free(tkString);
+
+static vaAppendFunction(DiagnosticArray, const LC3_Diagnostic, addDiagnostic,,)
+vaAllocFunction(DiagnosticArray, LC3_Diagnostic, newDiagnosticArray,,)
+vaFreeFunction(DiagnosticArray, LC3_Diagnostic, freeDiagnosticArray, vaFree(el.token); vaFree(el.source); vaFree(el.message), ;, ;)
+
+
+// Records a diagnostic, only the thread working on unit may call this
+static void recordDiagnostic(LC3_Unit *unit, LC3_DiagnosticKind kind, size_t line, Token tk, LC3_ErrorConfig flags, char *message) {
+    LC3_Diagnostic diag = {
+        .kind    = kind,
+        .flags   = flags,
+        .line    = line,
+        .tk      = tk,
+        .order   = unit->diag.sz,
+        .token   = NULL,
+        .source  = NULL,
+        .message = message,
+    };
+
+    if (kind != LC3_DIAG_SIMPLE) {
+        String str = unit->buf.ptr[line];
+        diag.token = copyText("LC3_Diagnostic", validToken(tk, str) ? str.ptr + tk.start : "", validToken(tk, str) ? tk.sz : 0);
+        diag.source = (flags & LC3_ERR_SHOW_LINE) ? copyText("LC3_Diagnostic", str.ptr, str.sz) : NULL;
+    }
+
+    LC3_SetError(unit);
+    addDiagnostic(&unit->diag, diag);
+}
+
+
+void LC3_linkerError(LC3_Unit *unit, const char *msg, Token tk, size_t line) {
+    recordDiagnostic(unit, LC3_DIAG_LINKER, line, tk, LC3_ERR_SHOW_TK, copyWord("LC3_Diagnostic", msg));
 }
 
 
 void LC3_TokenError(LC3_Unit *unit, size_t line, Token tk, const char *msg, LC3_ErrorConfig flags) {
-    String str = unit->buf.ptr[line];
-    char *tkString = tokenString(tk, str);
-    setError(unit);
+    recordDiagnostic(unit, LC3_DIAG_TOKEN, line, tk, flags, copyWord("LC3_Diagnostic", msg));
+}
 
-    LC3_BeginOutput();
-    printf((flags & LC3_ERR_SHOW_TK) ? 
+
+void LC3_SimpleError(LC3_Unit *unit, const char *fmt, ...) {
+    va_list args;
+
+    // Errors outside of units are shown right away
+    if (unit == NULL) {
+        va_start(args, fmt);
+        printf("\x1b[1;31merror:\x1b[0m ");
+        vprintf(fmt, args);
+        va_end(args);
+        return;
+    }
+
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char *message = vaMalloc("LC3_Diagnostic", (len > 0) ? len + 1 : 1);
+    message[0] = '\0';
+
+    va_start(args, fmt);
+    vsnprintf(message, (len > 0) ? len + 1 : 1, fmt, args);
+    va_end(args);
+
+    recordDiagnostic(unit, LC3_DIAG_SIMPLE, 0, (Token){0, 0}, 0, message);
+}
+
+
+static void renderText(const LC3_Unit *unit, const LC3_Diagnostic *diag) {
+    if (diag->kind == LC3_DIAG_SIMPLE) {
+        printf("\x1b[1;31merror:\x1b[0m %s", diag->message);
+        return;
+    }
+
+    if (diag->kind == LC3_DIAG_LINKER) {
+        printf(diag->tk.sz != 0 ?
+            "\x1b[1m%s: \x1b[1;31merror:\x1b[0m %s \"\x1b[1m%s\x1b[0m\"\n" :
+            "\x1b[1m%s: \x1b[1;31merror:\x1b[0m %s\n",
+            unit->filename, diag->message, diag->token
+        );
+        return;
+    }
+
+    printf((diag->flags & LC3_ERR_SHOW_TK) ?
         "\n\x1b[1m%s:%ld:%hd: \x1b[1;31merror:\x1b[0m %s \"\x1b[1m%s\x1b[0m\"\n" :
         "\n\x1b[1m%s:%ld:%hd: \x1b[1;31merror:\x1b[0m %s\n",
-        unit->filename, line, tk.start, msg, (flags & LC3_ERR_SHOW_TK) ? tkString : ""
+        unit->filename, diag->line, diag->tk.start, diag->message, (diag->flags & LC3_ERR_SHOW_TK) ? diag->token : ""
     );
 
-    if (!(flags & LC3_ERR_SHOW_LINE)) {
-        LC3_FinishOutput();
-        free(tkString);
+    if (diag->source == NULL) {
         return;
     }
 
+    const char *str = diag->source;
+    size_t len = strlen(str);
+    Token tk = diag->tk;
     uint8_t digitCount;
     size_t copy;
-    for (digitCount = 1, copy = line; (copy /= 10) > 0; digitCount++);
+    for (digitCount = 1, copy = diag->line; (copy /= 10) > 0; digitCount++);
 
     // Print string with incorrect token highlighted
-    printf("%ld | ", line);
-    for (copy = 0; copy < tk.start; copy++) {
-        putchar(str.ptr[copy]);
+    printf("%ld | ", diag->line);
+    for (copy = 0; copy < tk.start && copy < len; copy++) {
+        putchar(str[copy]);
     }
     printf("\x1b[1;31m");
-    for (; copy < (tk.start + tk.sz); copy++) {
-        putchar(str.ptr[copy]);
+    for (; copy < (size_t)(tk.start + tk.sz) && copy < len; copy++) {
+        putchar(str[copy]);
     }
     printf("\x1b[0m");
-    for (; copy < str.sz; copy++) {
-        putchar(str.ptr[copy]);
+    for (; copy < len; copy++) {
+        putchar(str[copy]);
     }
     putchar('\n');
 
@@ -80,7 +151,75 @@ void LC3_TokenError(LC3_Unit *unit, size_t line, Token tk, const char *msg, LC3_
     }
 
     printf("\x1b[0m\n");
+}
+
+
+static void renderJson(FILE *fp, const LC3_Unit *unit, const LC3_Diagnostic *diag) {
+    static const char *KINDS[] = {"assembler", "linker", "general"};
+
+    fprintf(fp, "{\"file\": ");
+    writeJsonString(fp, unit->filename);
+    fprintf(fp, ", \"severity\": \"error\", \"kind\": \"%s\"", KINDS[diag->kind]);
+
+    if (diag->kind != LC3_DIAG_SIMPLE) {
+        fprintf(fp, ", \"line\": %zu, \"column\": %u, \"length\": %u, \"token\": ", diag->line, diag->tk.start, diag->tk.sz);
+        writeJsonString(fp, diag->token);
+    }
+
+    fprintf(fp, ", \"message\": ");
+    writeJsonString(fp, diag->message);
+
+    if (diag->source != NULL) {
+        fprintf(fp, ", \"source\": ");
+        writeJsonString(fp, diag->source);
+    }
+
+    fprintf(fp, "}\n");
+}
+
+
+static int diagnosticCmp(const void *d1, const void *d2) {
+    const LC3_Diagnostic *a = d1, *b = d2;
+
+    if (a->line != b->line) {
+        return (a->line < b->line) ? -1 : 1;
+    }
+
+    return (a->order > b->order) - (a->order < b->order);
+}
+
+
+void LC3_FlushDiagnostics(LC3_Unit *unit) {
+    if (unit->diag.sz == 0) {
+        return;
+    }
+
+    FILE *json = (unit->ctx != NULL) ? unit->ctx->diagJson : NULL;
+    qsort(unit->diag.ptr, unit->diag.sz, sizeof(LC3_Diagnostic), diagnosticCmp);
+
+    // Embedders get the diagnostics, nothing is shown
+    if (unit->ctx != NULL && unit->ctx->diagHandler != NULL) {
+        for (size_t i = 0; i < unit->diag.sz; i++) {
+            unit->ctx->diagHandler(unit->ctx->diagData, unit, &unit->diag.ptr[i]);
+        }
+
+        freeDiagnosticArray(unit->diag);
+        unit->diag = newDiagnosticArray();
+        return;
+    }
+
+    LC3_BeginOutput();
+
+    for (size_t i = 0; i < unit->diag.sz; i++) {
+        if (json != NULL) {
+            renderJson(json, unit, &unit->diag.ptr[i]);
+        } else {
+            renderText(unit, &unit->diag.ptr[i]);
+        }
+    }
 
     LC3_FinishOutput();
-    free(tkString);
+
+    freeDiagnosticArray(unit->diag);
+    unit->diag = newDiagnosticArray();
 }
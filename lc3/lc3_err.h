@@ -8,11 +8,29 @@ typedef enum LC3_ErrorConfig {
 } LC3_ErrorConfig;
 
 
-#define LC3_SimpleError(unit, ...) \
-    if (unit != NULL) {((LC3_Unit *)unit)->error = true; if (((LC3_Unit *)unit)->ctx != NULL) {((LC3_Unit *)unit)->ctx->error = true;}}\
-    printf("\x1b[1;31merror:\x1b[0m ");\
-    printf(__VA_ARGS__);\
+// Units poll for cancellation every this many lines
+#define LC3_CANCEL_CHUNK (1024)
 
 
+vaAllocFunctionDefine(DiagnosticArray, newDiagnosticArray);
+vaFreeFunctionDefine(DiagnosticArray, freeDiagnosticArray);
+
+
+// Marks unit and its context as failed, safe to call from any thread
+void LC3_SetError(LC3_Unit *unit);
+
+// Whether any unit of ctx failed so far
+bool LC3_HasError(const LC3_Context *ctx);
+
+// Whether work for ctx should stop, because a unit failed and ctx does not keep going
+bool LC3_Cancelled(const LC3_Context *ctx);
+
+// Errors are recorded in their unit without locking, and only shown after LC3_FlushDiagnostics
 void LC3_linkerError(LC3_Unit *unit, const char *msg, Token tk, size_t line);
 void LC3_TokenError(LC3_Unit *unit, size_t line, Token tk, const char *msg, LC3_ErrorConfig flags);
+
+// Preformatted error, shown right away if unit is NULL
+void LC3_SimpleError(LC3_Unit *unit, const char *fmt, ...);
+
+// Shows the recorded errors of unit in order of line, as text or as JSON lines if the context has diagJson set
+void LC3_FlushDiagnostics(LC3_Unit *unit);
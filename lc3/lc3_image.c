@@ -0,0 +1,290 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_image.h"
+#include "lib/va_alloc.h"
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_WORDS (0x10000)
+
+
+static bool hostBigEndian() {
+    uint16_t probe = 1;
+    return (*(uint8_t *)&probe == 0);
+}
+
+
+static uint16_t swap16(uint16_t value) {
+    return (value >> 8) | (value << 8);
+}
+
+
+static uint32_t swap32(uint32_t value) {
+    return ((uint32_t)swap16(value) << 16) | swap16(value >> 16);
+}
+
+
+void LC3_WriteImage(size_t unitCount, LC3_Unit *units, const char *filename, bool bigEndian) {
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+        return;
+    }
+
+    uint16_t *memory = vaMalloc("LC3_Image", IMAGE_WORDS * sizeof(uint16_t));
+    LC3_ImageHeader header = {
+        .magic       = LC3_IMAGE_MAGIC,
+        .order       = bigEndian ? 'B' : 'L',
+        .version     = LC3_IMAGE_VERSION,
+        .entry       = LC3_USER_SPACE,
+        .imageOffset = sizeof(LC3_ImageHeader),
+        .usedWords   = 0,
+    };
+
+    bool swap = (bigEndian != hostBigEndian());
+    bool entry = false;
+
+    memset(memory, 0, IMAGE_WORDS * sizeof(uint16_t));
+    memset(header.pages, 0, sizeof(header.pages));
+    memset(header.reserved, 0, sizeof(header.reserved));
+
+    for (size_t i = 0; i < unitCount; i++) {
+        for (size_t section = 0; section < units[i].obj.sz; section++) {
+            ObjectSection *current = &units[i].obj.ptr[section];
+
+            if (!entry && current->words.sz > 0) {
+                header.entry = current->origin;
+                entry = true;
+            }
+
+            // Addresses wrap around, just like when the executable is loaded
+            for (size_t w = 0; w < current->words.sz; w++) {
+                uint16_t addr = current->origin + w;
+                memory[addr] = swap ? swap16(current->words.ptr[w]) : current->words.ptr[w];
+                header.pages[addr / LC3_IMAGE_PAGE_SIZE / 8] |= 1 << ((addr / LC3_IMAGE_PAGE_SIZE) % 8);
+            }
+
+            header.usedWords += current->words.sz;
+        }
+    }
+
+    if (swap) {
+        header.entry       = swap16(header.entry);
+        header.imageOffset = swap32(header.imageOffset);
+        header.usedWords   = swap32(header.usedWords);
+    }
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(memory, sizeof(uint16_t), IMAGE_WORDS, fp);
+    fclose(fp);
+
+    vaFree(memory);
+}
+
+
+bool LC3_MapImage(const char *filename, LC3_Image *image) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(LC3_ImageHeader) + IMAGE_WORDS * sizeof(uint16_t))) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const LC3_ImageHeader *header = map;
+    uint32_t offset = ((header->order == 'B') != hostBigEndian()) ? swap32(header->imageOffset) : header->imageOffset;
+
+    if (memcmp(header->magic, LC3_IMAGE_MAGIC, 4) != 0 || header->version != LC3_IMAGE_VERSION ||
+        offset % 2 != 0 || offset + IMAGE_WORDS * sizeof(uint16_t) > (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return false;
+    }
+
+    image->header  = header;
+    image->words   = (const uint16_t *)((const char *)map + offset);
+    image->map     = map;
+    image->mapSize = st.st_size;
+    return true;
+}
+
+
+void LC3_UnmapImage(LC3_Image *image) {
+    munmap(image->map, image->mapSize);
+    image->map = NULL;
+}
+
+
+// Skips size bytes, returns false if the file ends before that
+static bool skipBytes(FILE *fp, long size) {
+    return fseek(fp, size, SEEK_CUR) == 0;
+}
+
+
+bool LC3_LoadExecutable(const char *filename, uint16_t *memory) {
+    FILE *fp = fopen(filename, "rb");
+    char mgc[4];
+    uint16_t flags;
+    uint8_t indicator;
+    bool valid;
+
+    if (fp == NULL) {
+        return false;
+    }
+
+    valid = fread(mgc, 1, 4, fp) == 4 && memcmp(mgc, MAGIC_NUM, 4) == 0 && fread(&flags, 2, 1, fp) == 1 && (flags & LC3_FILE_EXC);
+    memset(memory, 0, IMAGE_WORDS * sizeof(uint16_t));
+
+    while (valid && fread(&indicator, 1, 1, fp) == 1) {
+        uint16_t origin, size, count;
+        uint32_t stringSize;
+
+        switch (indicator) {
+            case LC3_INDICATOR_DBG:
+                valid = fread(&stringSize, 4, 1, fp) == 1 && skipBytes(fp, stringSize);
+                break;
+
+            case LC3_INDICATOR_ASM:
+                valid = fread(&origin, 2, 1, fp) == 1 && fread(&size, 2, 1, fp) == 1;
+
+                // Older files store debug info inline, after every word
+                if (valid && (flags & LC3_FILE_DBG) && !(flags & LC3_FILE_DBT)) {
+                    for (uint16_t i = 0; valid && i < size; i++) {
+                        int c;
+                        valid = fread(&memory[(uint16_t)(origin + i)], 2, 1, fp) == 1;
+                        while (valid && (c = fgetc(fp)) != '\0') {
+                            valid = (c != EOF);
+                        }
+                    }
+
+                    break;
+                }
+
+                // Sections that wrap around are split in two reads
+                if (valid) {
+                    size_t first = (origin + size > IMAGE_WORDS) ? IMAGE_WORDS - origin : size;
+                    valid = fread(&memory[origin], 2, first, fp) == first && fread(memory, 2, size - first, fp) == size - first;
+                }
+
+                if (valid && (flags & LC3_FILE_DBT)) {
+                    valid = fread(&count, 2, 1, fp) == 1 && skipBytes(fp, 6 * (long)count);
+                }
+
+                break;
+
+            default:
+                valid = false;
+                break;
+        }
+    }
+
+    fclose(fp);
+    return valid;
+}
+
+
+static double elapsed(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+// Sum of all words, to check that both loaders produce the same memory
+static uint64_t checksum(const uint16_t *memory) {
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < IMAGE_WORDS; i++) {
+        sum += memory[i] * (i + 1);
+    }
+
+    return sum;
+}
+
+
+void LC3_BenchmarkLoad(const char *executable, const char *image, size_t count) {
+    uint16_t *memory = vaMalloc("LC3_Image", IMAGE_WORDS * sizeof(uint16_t));
+    const char *names[3] = {"sections (parse)", "image (map)", "image (map + touch)"};
+    double times[3] = {0};
+    struct timespec start, end;
+    volatile uint16_t touched = 0;
+    LC3_Image mapped;
+    bool valid = true;
+
+    // Parse the sections into memory
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; valid && i < count; i++) {
+        valid = LC3_LoadExecutable(executable, memory);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    times[0] = elapsed(start, end);
+
+    // Only map the image, pages are read when they are first used
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; valid && i < count; i++) {
+        valid = LC3_MapImage(image, &mapped);
+
+        if (valid) {
+            LC3_UnmapImage(&mapped);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    times[1] = elapsed(start, end);
+
+    // Map the image and read a word from every page of the mapping
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; valid && i < count; i++) {
+        valid = LC3_MapImage(image, &mapped);
+
+        for (size_t w = 0; valid && w < IMAGE_WORDS; w += 2048) {
+            touched += mapped.words[w];
+        }
+
+        if (valid) {
+            LC3_UnmapImage(&mapped);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    times[2] = elapsed(start, end);
+
+    if (!valid) {
+        printf("\x1b[1;31merror:\x1b[0m failed to load %s or %s\n", executable, image);
+        vaFree(memory);
+        return;
+    }
+
+    printf("%-20s %12s %14s\n", "loader", "total (ms)", "per load (us)");
+
+    for (int i = 0; i < 3; i++) {
+        printf("%-20s %12.3f %14.3f\n", names[i], times[i] * 1e3, times[i] * 1e6 / count);
+    }
+
+    // Both loaders should end up with the same memory, unless the image uses another byte order
+    if (LC3_MapImage(image, &mapped)) {
+        if (checksum(memory) != checksum(mapped.words)) {
+            printf("note: image contents differ from the executable (byte order?)\n");
+        }
+
+        LC3_UnmapImage(&mapped);
+    }
+
+    vaFree(memory);
+}
@@ -0,0 +1,50 @@
+/*
+ * Description:
+ * Flat memory images, the whole LC3 address space in a single file that can be mapped without parsing
+ */
+
+#pragma once
+#include "lc3_asm.h"
+
+#define LC3_IMAGE_MAGIC "LC3M"
+#define LC3_IMAGE_VERSION (1)
+
+// Words per page in the used-page bitmap
+#define LC3_IMAGE_PAGE_SIZE (256)
+#define LC3_IMAGE_PAGES (0x10000 / LC3_IMAGE_PAGE_SIZE)
+
+
+// Image header, the memory image (0x10000 words) follows at imageOffset. All fields are in the byte order of the image
+typedef struct LC3_ImageHeader {
+    char magic[4];
+    uint8_t order;         // 'L' for little endian, 'B' for big endian
+    uint8_t version;
+    uint16_t entry;        // Origin of the first section
+    uint32_t imageOffset;
+    uint32_t usedWords;
+    uint8_t pages[LC3_IMAGE_PAGES / 8]; // Bit set if a page contains any section
+    uint8_t reserved[16];
+} LC3_ImageHeader;
+
+
+// Mapped image, words point directly into the file
+typedef struct LC3_Image {
+    const LC3_ImageHeader *header;
+    const uint16_t *words;
+    void *map;
+    size_t mapSize;
+} LC3_Image;
+
+
+// Writes the linked units as a memory image, in big endian or in the byte order of this machine
+void LC3_WriteImage(size_t unitCount, LC3_Unit *units, const char *filename, bool bigEndian);
+
+// Maps an image into memory, returns false if the file is not a valid image
+bool LC3_MapImage(const char *filename, LC3_Image *image);
+void LC3_UnmapImage(LC3_Image *image);
+
+// Reads an executable in the section format into memory (0x10000 words), returns false on failure
+bool LC3_LoadExecutable(const char *filename, uint16_t *memory);
+
+// Times loading the same program from an executable and from an image, count times each
+void LC3_BenchmarkLoad(const char *executable, const char *image, size_t count);
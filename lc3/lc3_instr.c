@@ -75,6 +75,33 @@ Token getDebugLine(LC3_Unit *unit, const Statement stmt) {
 }
 
 
+// Counts the lines from .ORIG at line up to the next .ORIG or .END, a good estimate for the size of the section
+static size_t sectionLines(const LC3_Unit *unit, size_t line) {
+    size_t end = line + 1;
+
+    for (; end < unit->buf.sz; end++) {
+        String str = unit->buf.ptr[end];
+        Token tk = getToken(0, str);
+
+        // Directives may follow a label
+        if (validToken(tk, str) && str.ptr[tk.start] != '.') {
+            tk = getToken(tk.start + tk.sz, str);
+        }
+        if (!validToken(tk, str) || str.ptr[tk.start] != '.') {
+            continue;
+        }
+
+        const InstructionDefinition *def = getInstructionIndex(tk, str);
+
+        if (def != NULL && (def->instr == INSTR_PS_ORIG || def->instr == INSTR_PS_END)) {
+            break;
+        }
+    }
+
+    return end - line;
+}
+
+
 // Apply .ORIG pseud to unit
 void interpretOrig(LC3_Unit_Ptr unit, const Statement stmt, OptInt *addr) {
     if (addr->set) {
@@ -82,8 +109,10 @@ void interpretOrig(LC3_Unit_Ptr unit, const Statement stmt, OptInt *addr) {
         return;
     }
     
-    // This marks a new object section
-    ObjectSection section = newObjectSection();
+    // This marks a new object section, sized from its lines so many small sections stay small
+    size_t lines = sectionLines(unit, stmt.line);
+    bool debug = (unit->ctx && unit->ctx->storeDebug);
+    ObjectSection section = newObjectSection(lines, 0, debug ? lines : 0);
     section.origin = getNumber(stmt.args[0], unit->buf.ptr[stmt.line]).value;
     addObjectSection(&unit->obj, section);
 
@@ -105,7 +134,7 @@ void interpretBlkw(LC3_Unit_Ptr unit, const Statement stmt, OptInt *addr) {
     ObjectLine empty = {.label = {.line = stmt.line}, .debug = {stmt.line, getDebugLine(unit, stmt)}};
 
     for (int i = 0; i < value; i++) {
-        addObjectLine(section, empty);
+        addObjectLine(unit, section, empty);
         empty.debug.tk.sz = 0;
     }
 
@@ -123,7 +152,7 @@ void interpretFill(LC3_Unit *unit, const Statement stmt, OptInt *addr) {
         .debug = {.line = stmt.line, .tk = getDebugLine(unit, stmt)}
     };
 
-    addObjectLine(&unit->obj.ptr[unit->obj.sz - 1], value);
+    addObjectLine(unit, &unit->obj.ptr[unit->obj.sz - 1], value);
     addr->value++;
 }
 
@@ -140,12 +169,12 @@ void interpretStrz(LC3_Unit *unit, const Statement stmt, OptInt *addr) {
 
     for (int i = 0; i < lit.sz + 1; i++) {
         obj.instr = lit.ptr[i];
-        addObjectLine(section, obj);
+        addObjectLine(unit, section, obj);
         obj.debug.tk.sz = 0;
     }
 
     addr->value += lit.sz + 1;
-    free(lit.ptr);
+    vaFree(lit.ptr);
 }
 
 
@@ -303,7 +332,7 @@ void translateInstructionStatement(LC3_Unit *unit, const Statement stmt, OptInt
             break;
     }
 
-    addObjectLine(section, ret);
+    addObjectLine(unit, section, ret);
     addr->value++;
 }
 
@@ -326,44 +355,63 @@ void interpretStatement(LC3_Unit *unit, const Statement stmt, OptInt *addr) {
 }
 
 
-void resolveInstruction(LC3_Unit *unit, ObjectLine *obj, uint16_t addr, uint16_t label) {
-    Converter cast;
-    int16_t offset;
-
-    switch (obj->instr >> 12) {
+RelocationKind getRelocationKind(uint16_t instr) {
+    switch (instr >> 12) {
         case 0x4: // JSR
-            offset = (int)label - (int)addr - 1;
-            cast.pc_offset11 = offset;
+            return RELOC_PC11;
+        case 0xF: // .FILL
+            return RELOC_ABS;
+        default:  // BR, LD, LDI, LEA, ST, STI
+            return RELOC_PC9;
+    }
+}
 
-            if (offset < -1024 || offset > 1023) {
-                LC3_linkerError(unit, "offset larger than allowed [-1024, 1023] for label", obj->label.tk, obj->label.line);
-            }
 
-            obj->instr |= cast.pc_offset11;
-            break;
+uint16_t relocationMask(RelocationKind kind) {
+    switch (kind) {
+        case RELOC_PC9:  return 0x01FF;
+        case RELOC_PC11: return 0x07FF;
+        default:         return 0xFFFF;
+    }
+}
 
-        case 0x0: // BR
-        case 0x2: // LD
-        case 0xA: // LDI
-        case 0xE: // LEA
-        case 0x3: // ST
-        case 0xB: // STI
-            offset = (int)label - (int)addr - 1;
-            cast.pc_offset9 = offset;
 
-            if (offset < -256 || offset > 255) {
-                LC3_linkerError(unit, "offset larger than allowed [-256, 255] for label", obj->label.tk, obj->label.line);
-            }
+const char *relocationError(RelocationKind kind, int offset) {
+    switch (kind) {
+        case RELOC_PC11:
+            return (offset < -1024 || offset > 1023) ? "offset larger than allowed [-1024, 1023] for label" : NULL;
+        case RELOC_PC9:
+            return (offset < -256 || offset > 255) ? "offset larger than allowed [-256, 255] for label" : NULL;
+        default:
+            return NULL;
+    }
+}
+
+
+void resolveInstruction(LC3_Unit *unit, ObjectSection *section, const Relocation *reloc, uint16_t label) {
+    Converter cast;
+    uint16_t *instr = &section->words.ptr[reloc->index];
+    uint16_t addr = section->origin + reloc->index;
+    int16_t offset = (int)label - (int)addr - 1;
+    const char *error = relocationError(reloc->kind, offset);
+
+    if (error != NULL) {
+        LC3_linkerError(unit, error, reloc->label.tk, reloc->label.line);
+    }
 
-            obj->instr |= cast.pc_offset9;
+    switch (reloc->kind) {
+        case RELOC_PC11:
+            cast.pc_offset11 = offset;
+            (*instr) |= cast.pc_offset11;
             break;
-        
-        case 0xF: // .FILL
-            obj->instr = label;
+
+        case RELOC_PC9:
+            cast.pc_offset9 = offset;
+            (*instr) |= cast.pc_offset9;
             break;
         
-        default:
+        case RELOC_ABS:
+            (*instr) = label;
             break;
     }
 }
-
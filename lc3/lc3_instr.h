@@ -334,5 +334,14 @@ const InstructionDefinition *getInstructionIndex(Token tk, String str);
 // Convert statement into objec line(s) and update address value
 void interpretStatement(struct LC3_Unit *unit, const Statement stmt, OptInt *addr);
 
+// Deduces how a label should be applied to an (unresolved) instruction word
+RelocationKind getRelocationKind(uint16_t instr);
+
+// Bits of an instruction that are filled in by a relocation of kind
+uint16_t relocationMask(RelocationKind kind);
+
+// Error for a PC-relative offset that does not fit a relocation of kind, NULL if it fits
+const char *relocationError(RelocationKind kind, int offset);
+
 // Combines instruction with label value (linking)
-void resolveInstruction(struct LC3_Unit *unit, ObjectLine *obj, uint16_t addr, uint16_t label);
+void resolveInstruction(struct LC3_Unit *unit, ObjectSection_Ptr section, const Relocation *reloc, uint16_t label);
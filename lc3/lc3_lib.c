@@ -0,0 +1,255 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_lib.h"
+#include "lc3_asm.h"
+#include "lc3_cache.h"
+#include "lc3_err.h"
+#include "lib/va_alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMORY_WORDS (0x10000)
+
+
+typedef struct LibSource {
+    char *name;
+    char *text; // NULL for files on disk
+    size_t size;
+} LibSource;
+
+
+vaTypedef(LibSource, LibSourceArray);
+vaTypedef(LC3_SectionInfo, SectionInfoArray);
+vaTypedef(LC3_SymbolInfo, SymbolInfoArray);
+vaTypedef(LC3_Message, MessageArray);
+
+static vaAllocFunction(LibSourceArray, LibSource, newLibSourceArray,,)
+static vaAppendFunction(LibSourceArray, const LibSource, addLibSource,,)
+static vaAllocFunction(SectionInfoArray, LC3_SectionInfo, newSectionInfoArray,,)
+static vaAppendFunction(SectionInfoArray, const LC3_SectionInfo, addSectionInfo,,)
+static vaAllocFunction(SymbolInfoArray, LC3_SymbolInfo, newSymbolInfoArray,,)
+static vaAppendFunction(SymbolInfoArray, const LC3_SymbolInfo, addSymbolInfo,,)
+static vaAllocFunction(MessageArray, LC3_Message, newMessageArray,,)
+static vaAppendFunction(MessageArray, const LC3_Message, addMessage,,)
+
+
+struct LC3_Assembler {
+    LC3_Context ctx;
+    LibSourceArray sources;
+    LC3_Unit *units;
+    size_t unitCount;
+    bool built;
+
+    uint16_t *memory;
+    uint8_t *executable;
+    size_t executableSize;
+    SectionInfoArray sections;
+    SymbolInfoArray symbols;
+    MessageArray messages;
+};
+
+
+// Keeps every diagnostic of the build, in place of showing it
+static void collectMessage(void *data, const LC3_Unit *unit, const LC3_Diagnostic *diag) {
+    static const char *KINDS[] = {"assembler", "linker", "general"};
+    LC3_Assembler *as = data;
+
+    LC3_Message message = {
+        .source  = unit->filename,
+        .kind    = KINDS[diag->kind],
+        .line    = diag->line,
+        .column  = (diag->kind != LC3_DIAG_SIMPLE) ? diag->tk.start : 0,
+        .length  = (diag->kind != LC3_DIAG_SIMPLE) ? diag->tk.sz : 0,
+        .token   = (diag->token != NULL) ? copyWord("LC3_Assembler", diag->token) : NULL,
+        .message = copyPlainText("LC3_Assembler", diag->message),
+        .text    = (diag->source != NULL) ? copyWord("LC3_Assembler", diag->source) : NULL,
+    };
+
+    addMessage(&as->messages, message);
+}
+
+
+LC3_Assembler *LC3_NewAssembler(const LC3_AssemblerOptions *options) {
+    LC3_AssemblerOptions defaults = {0};
+    LC3_Assembler *as = vaMalloc("LC3_Assembler", sizeof(LC3_Assembler));
+
+    if (options == NULL) {
+        options = &defaults;
+    }
+
+    memset(as, 0, sizeof(LC3_Assembler));
+
+    as->ctx = (LC3_Context){
+        .storeDebug  = options->storeDebug,
+        .storeIndent = options->storeIndent,
+        .workers     = options->workers,
+        .keepGoing   = options->keepGoing,
+        .cacheDir    = (options->cacheDir != NULL && LC3_OpenCache(options->cacheDir)) ? options->cacheDir : NULL,
+        .diagHandler = collectMessage,
+        .diagData    = as,
+        .error       = false,
+    };
+
+    as->sources  = newLibSourceArray();
+    as->sections = newSectionInfoArray();
+    as->symbols  = newSymbolInfoArray();
+    as->messages = newMessageArray();
+    return as;
+}
+
+
+void LC3_FreeAssembler(LC3_Assembler *as) {
+    for (size_t i = 0; i < as->unitCount; i++) {
+        LC3_DestroyUnit(as->units[i]);
+    }
+
+    for (size_t i = 0; i < as->sources.sz; i++) {
+        vaFree(as->sources.ptr[i].name);
+        vaFree(as->sources.ptr[i].text);
+    }
+
+    for (size_t i = 0; i < as->symbols.sz; i++) {
+        vaFree((char *)as->symbols.ptr[i].name);
+    }
+
+    for (size_t i = 0; i < as->messages.sz; i++) {
+        vaFree((char *)as->messages.ptr[i].token);
+        vaFree((char *)as->messages.ptr[i].message);
+        vaFree((char *)as->messages.ptr[i].text);
+    }
+
+    // The executable comes from open_memstream
+    free(as->executable);
+
+    vaFree(as->units);
+    vaFree(as->memory);
+    vaFree(as->sources.ptr);
+    vaFree(as->sections.ptr);
+    vaFree(as->symbols.ptr);
+    vaFree(as->messages.ptr);
+    vaFree(as);
+}
+
+
+void LC3_AddSource(LC3_Assembler *as, const char *name, const char *text, size_t size) {
+    addLibSource(&as->sources, (LibSource){copyWord("LC3_Assembler", name), copyText("LC3_Assembler", text, size), size});
+}
+
+
+void LC3_AddFile(LC3_Assembler *as, const char *filename) {
+    addLibSource(&as->sources, (LibSource){copyWord("LC3_Assembler", filename), NULL, 0});
+}
+
+
+static void collectSymbols(LC3_Assembler *as) {
+    for (size_t i = 0; i < as->unitCount; i++) {
+        const LC3_Unit *unit = &as->units[i];
+
+        for (size_t s = 0; s < unit->symb.sz; s++) {
+            const Symbol *symbol = &unit->symb.ptr[s];
+            const char *name = symbol->loc.unit->buf.ptr[symbol->loc.line].ptr + symbol->loc.tk.start;
+            addSymbolInfo(&as->symbols, (LC3_SymbolInfo){copyText("LC3_Assembler", name, symbol->loc.tk.sz), symbol->value, i});
+        }
+    }
+}
+
+
+// Places all sections in memory, addresses wrap around like when the executable is loaded
+static void collectImage(LC3_Assembler *as) {
+    as->memory = vaMalloc("LC3_Assembler", MEMORY_WORDS * sizeof(uint16_t));
+    memset(as->memory, 0, MEMORY_WORDS * sizeof(uint16_t));
+
+    for (size_t i = 0; i < as->unitCount; i++) {
+        for (size_t section = 0; section < as->units[i].obj.sz; section++) {
+            const ObjectSection *current = &as->units[i].obj.ptr[section];
+
+            for (size_t w = 0; w < current->words.sz; w++) {
+                as->memory[(uint16_t)(current->origin + w)] = current->words.ptr[w];
+            }
+
+            if (current->words.sz > 0) {
+                addSectionInfo(&as->sections, (LC3_SectionInfo){current->origin, current->words.sz, i});
+            }
+        }
+    }
+
+    // Same bytes as an executable written by the command line tool
+    FILE *fp = open_memstream((char **)&as->executable, &as->executableSize);
+
+    if (fp != NULL) {
+        for (size_t i = 0; i < as->unitCount; i++) {
+            LC3_WriteExecutableUnit(&as->units[i], fp, (i == 0));
+        }
+
+        fclose(fp);
+    }
+}
+
+
+bool LC3_Build(LC3_Assembler *as) {
+    if (as->built) {
+        return false;
+    }
+
+    as->built = true;
+    as->unitCount = as->sources.sz;
+    as->units = vaMalloc("LC3_Unit", (as->unitCount + 1) * sizeof(LC3_Unit));
+
+    for (size_t i = 0; i < as->unitCount; i++) {
+        as->units[i] = LC3_CreateUnit(&as->ctx, as->sources.ptr[i].name);
+        as->units[i].source = as->sources.ptr[i].text;
+        as->units[i].sourceSize = as->sources.ptr[i].size;
+    }
+
+    LC3_AssembleUnits(as->unitCount, as->units);
+
+    if (!as->ctx.error && as->unitCount > 0) {
+        LC3_LinkUnits(as->unitCount, as->units);
+    }
+
+    for (size_t i = 0; i < as->unitCount; i++) {
+        LC3_FlushDiagnostics(&as->units[i]);
+    }
+
+    collectSymbols(as);
+
+    if (!as->ctx.error) {
+        collectImage(as);
+    }
+
+    return !as->ctx.error;
+}
+
+
+const uint16_t *LC3_GetMemory(const LC3_Assembler *as) {
+    return as->memory;
+}
+
+
+const uint8_t *LC3_GetExecutable(const LC3_Assembler *as, size_t *size) {
+    (*size) = as->executableSize;
+    return as->executable;
+}
+
+
+const LC3_SectionInfo *LC3_GetSections(const LC3_Assembler *as, size_t *count) {
+    (*count) = as->sections.sz;
+    return as->sections.ptr;
+}
+
+
+const LC3_SymbolInfo *LC3_GetSymbols(const LC3_Assembler *as, size_t *count) {
+    (*count) = as->symbols.sz;
+    return as->symbols.ptr;
+}
+
+
+const LC3_Message *LC3_GetMessages(const LC3_Assembler *as, size_t *count) {
+    (*count) = as->messages.sz;
+    return as->messages.ptr;
+}
+
+
+void LC3_GetCacheCounts(const LC3_Assembler *as, size_t *hits, size_t *misses) {
+    (*hits) = as->ctx.cacheHits;
+    (*misses) = as->ctx.cacheMisses;
+}
@@ -0,0 +1,71 @@
+/*
+ * Description:
+ * Embeddable assembler, assembles and links sources from memory and keeps all results in memory.
+ * Every assembler is independent, so any number of them can be used at the same time from different threads
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct LC3_Assembler LC3_Assembler;
+
+
+typedef struct LC3_AssemblerOptions {
+    size_t workers;   // Worker threads, 0 for one per online processor
+    bool storeDebug;  // Embed source lines in the executable, like -g
+    bool storeIndent; // Keep their indentation, like -G
+    bool keepGoing;   // Assemble all sources even after an error
+    const char *cacheDir; // Object cache directory, shared with other builds, or NULL. Must outlive the assembler
+} LC3_AssemblerOptions;
+
+
+typedef struct LC3_SectionInfo {
+    uint16_t origin;
+    size_t size;   // Words
+    size_t source; // Index of the source, in order of adding
+} LC3_SectionInfo;
+
+
+typedef struct LC3_SymbolInfo {
+    const char *name;
+    uint16_t value;
+    size_t source;
+} LC3_SymbolInfo;
+
+
+typedef struct LC3_Message {
+    const char *source;  // Name of the source
+    const char *kind;    // "assembler", "linker" or "general"
+    size_t line;         // Line, column, length and token are only set for assembler and linker errors
+    uint16_t column, length;
+    const char *token;
+    const char *message;
+    const char *text;    // Source line, NULL if it is not part of the message
+} LC3_Message;
+
+
+// Options may be NULL for the defaults
+LC3_Assembler *LC3_NewAssembler(const LC3_AssemblerOptions *options);
+void LC3_FreeAssembler(LC3_Assembler *as);
+
+// Adds assembly source, text is copied. name only identifies the source in messages
+void LC3_AddSource(LC3_Assembler *as, const char *name, const char *text, size_t size);
+
+// Adds an assembly or object file on disk
+void LC3_AddFile(LC3_Assembler *as, const char *filename);
+
+// Assembles and links all sources, returns false if there were errors. Can only be called once per assembler
+bool LC3_Build(LC3_Assembler *as);
+
+// Results of the build, owned by the assembler. Memory is 0x10000 words, memory and executable are NULL if the build failed
+const uint16_t *LC3_GetMemory(const LC3_Assembler *as);
+const uint8_t *LC3_GetExecutable(const LC3_Assembler *as, size_t *size);
+const LC3_SectionInfo *LC3_GetSections(const LC3_Assembler *as, size_t *count);
+const LC3_SymbolInfo *LC3_GetSymbols(const LC3_Assembler *as, size_t *count);
+const LC3_Message *LC3_GetMessages(const LC3_Assembler *as, size_t *count);
+
+// Sources whose object was and was not found in the cache
+void LC3_GetCacheCounts(const LC3_Assembler *as, size_t *hits, size_t *misses);
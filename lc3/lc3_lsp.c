@@ -0,0 +1,1207 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_lsp.h"
+#include "lc3_asm.h"
+#include "lc3_err.h"
+#include "lc3_instr.h"
+#include "lib/va_alloc.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+
+// Messages larger than this are skipped
+#define MESSAGE_MAX (64 << 20)
+
+// Deeper nesting is not valid for the protocol, and would only use up the stack
+#define JSON_DEPTH_MAX (64)
+#define JSON_NONE ((size_t)-1)
+
+// JSON-RPC error codes
+#define RPC_PARSE_ERROR      (-32700)
+#define RPC_METHOD_NOT_FOUND (-32601)
+
+#define SEVERITY_ERROR   (1)
+#define SEVERITY_WARNING (2)
+
+// Target of a label reference that is not defined in the document, or that has to be looked up again
+#define TARGET_NONE    ((size_t)-1)
+#define TARGET_UNKNOWN ((size_t)-2)
+
+// Pasting more labels than this looks up every label reference again, instead of comparing each with the new labels
+#define TARGET_RECHECK_MAX (16)
+
+
+typedef enum JsonType {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+} JsonType;
+
+// Value of a parsed message, the elements of an array or object (keys and values) follow it
+typedef struct JsonValue {
+    JsonType type;
+    size_t start, end; // Text of the value, strings include their quotes
+    size_t count;      // Elements of an array, members of an object
+    size_t next;       // First value after this one and its elements
+} JsonValue;
+
+vaTypedef(JsonValue, JsonValues);
+static vaAllocFunction(JsonValues, JsonValue, newJsonValues,,)
+static vaAppendFunction(JsonValues, const JsonValue, addJsonValue,,)
+
+typedef struct Message {
+    char *text;        // Null-terminated
+    size_t size;
+    JsonValues values; // The message itself is the first
+} Message;
+
+
+// Line of a document. Everything but the address is found by parsing the line on its own
+typedef struct LineInfo {
+    String raw;           // As in the editor, the unit has the line without its comment
+    Statement stmt;
+    bool valid;           // stmt can be interpreted
+    uint16_t origin;      // Of a .ORIG statement
+    uint16_t size;        // Words the statement takes up
+    Relocation ref;       // Label the statement refers to, ref.label.tk.sz is 0 if none
+    size_t target;        // Line that defines the label of ref, see TARGET_NONE
+    DiagnosticArray diag; // Errors found while parsing the line
+    OptInt addr;          // Address of the line, which is the value of its label
+    const char *addrError; // Error because of the address before the line, NULL if none
+} LineInfo;
+
+vaTypedef(LineInfo, LineInfoArray);
+static vaAllocFunction(LineInfoArray, LineInfo, newLineInfoArray,,)
+static vaReserveFunction(LineInfoArray, LineInfo, reserveLineInfoArray,,)
+
+typedef struct Document {
+    char *uri;
+    LC3_Unit unit; // Lines without comments, the symbols of all lines (sorted) and a section to translate lines in
+    LineInfoArray lines;
+} Document;
+
+vaTypedef(Document *, DocumentArray);
+static vaAllocFunction(DocumentArray, Document *, newDocumentArray,,)
+static vaAppendFunction(DocumentArray, Document *, addDocument,,)
+
+typedef struct Server {
+    FILE *in, *out;
+    LC3_Context ctx;
+    DocumentArray docs;
+    bool shutdown, exiting;
+} Server;
+
+// Message that is written while it is built, and sent once it is complete
+typedef struct Reply {
+    FILE *fp;
+    char *body;
+    size_t size;
+} Reply;
+
+
+/* == JSON == */
+
+
+static void skipSpace(const Message *msg, size_t *pos) {
+    for (; *pos < msg->size; (*pos)++) {
+        char c = msg->text[*pos];
+
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+    }
+}
+
+
+static bool skipLiteral(const Message *msg, size_t *pos, const char *literal) {
+    size_t len = strlen(literal);
+
+    if (msg->size - *pos < len || memcmp(msg->text + *pos, literal, len) != 0) {
+        return false;
+    }
+
+    (*pos) += len;
+    return true;
+}
+
+
+static bool isNumberChar(char c) {
+    return isdigit((unsigned char)c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+
+// Parses the value at pos and its elements, returns its index or JSON_NONE if the text is not valid JSON
+static size_t parseValue(Message *msg, size_t *pos, int depth) {
+    skipSpace(msg, pos);
+
+    if (*pos >= msg->size || depth > JSON_DEPTH_MAX) {
+        return JSON_NONE;
+    }
+
+    size_t index = msg->values.sz;
+    JsonValue value = {.start = *pos};
+    char c = msg->text[*pos];
+    bool valid = true;
+
+    // Elements are added after their parent
+    addJsonValue(&msg->values, value);
+
+    if (c == '{' || c == '[') {
+        char close = (c == '{') ? '}' : ']';
+        value.type = (c == '{') ? JSON_OBJECT : JSON_ARRAY;
+        (*pos)++;
+        skipSpace(msg, pos);
+
+        if (*pos < msg->size && msg->text[*pos] == close) {
+            (*pos)++;
+        } else {
+            while (valid) {
+                if (value.type == JSON_OBJECT) {
+                    size_t key = parseValue(msg, pos, depth + 1);
+                    skipSpace(msg, pos);
+                    valid = (key != JSON_NONE && msg->values.ptr[key].type == JSON_STRING && *pos < msg->size && msg->text[(*pos)++] == ':');
+                }
+
+                valid = valid && parseValue(msg, pos, depth + 1) != JSON_NONE;
+                skipSpace(msg, pos);
+                value.count++;
+
+                if (!valid || *pos >= msg->size) {
+                    valid = false;
+                    break;
+                }
+
+                c = msg->text[(*pos)++];
+
+                if (c == close) {
+                    break;
+                }
+
+                valid = (c == ',');
+            }
+        }
+    } else if (c == '"') {
+        value.type = JSON_STRING;
+
+        for ((*pos)++; *pos < msg->size && msg->text[*pos] != '"'; (*pos)++) {
+            (*pos) += (msg->text[*pos] == '\\');
+        }
+
+        valid = (*pos < msg->size);
+        (*pos)++;
+    } else if (skipLiteral(msg, pos, "true") || skipLiteral(msg, pos, "false")) {
+        value.type = JSON_BOOL;
+    } else if (skipLiteral(msg, pos, "null")) {
+        value.type = JSON_NULL;
+    } else {
+        value.type = JSON_NUMBER;
+        for (; *pos < msg->size && isNumberChar(msg->text[*pos]); (*pos)++);
+        valid = (*pos > value.start);
+    }
+
+    value.end = *pos;
+    value.next = msg->values.sz;
+    msg->values.ptr[index] = value;
+    return valid ? index : JSON_NONE;
+}
+
+
+static bool parseMessage(Message *msg) {
+    size_t pos = 0;
+
+    msg->values.sz = 0;
+
+    if (parseValue(msg, &pos, 0) != 0) {
+        return false;
+    }
+
+    skipSpace(msg, &pos);
+    return (pos == msg->size && msg->values.ptr[0].type == JSON_OBJECT);
+}
+
+
+static size_t jsonMember(const Message *msg, size_t object, const char *key) {
+    if (object == JSON_NONE || msg->values.ptr[object].type != JSON_OBJECT) {
+        return JSON_NONE;
+    }
+
+    size_t len = strlen(key);
+    size_t member = object + 1;
+
+    for (size_t i = 0; i < msg->values.ptr[object].count; i++) {
+        const JsonValue *name = &msg->values.ptr[member];
+
+        // Keys of the protocol do not need escapes
+        if (name->end - name->start == len + 2 && memcmp(msg->text + name->start + 1, key, len) == 0) {
+            return name->next;
+        }
+
+        member = msg->values.ptr[name->next].next;
+    }
+
+    return JSON_NONE;
+}
+
+
+// Follows object keys from value, up to a NULL key
+static size_t jsonPath(const Message *msg, size_t value, ...) {
+    va_list keys;
+    const char *key;
+
+    va_start(keys, value);
+
+    while (value != JSON_NONE && (key = va_arg(keys, const char *)) != NULL) {
+        value = jsonMember(msg, value, key);
+    }
+
+    va_end(keys);
+    return value;
+}
+
+
+// Elements of an array are found by following next from the first
+static size_t jsonElement(const Message *msg, size_t array, size_t *element) {
+    if (array == JSON_NONE || msg->values.ptr[array].type != JSON_ARRAY) {
+        return 0;
+    }
+
+    (*element) = array + 1;
+    return msg->values.ptr[array].count;
+}
+
+
+static size_t jsonInteger(const Message *msg, size_t value) {
+    if (value == JSON_NONE || msg->values.ptr[value].type != JSON_NUMBER) {
+        return 0;
+    }
+
+    long number = strtol(msg->text + msg->values.ptr[value].start, NULL, 10);
+    return (number > 0) ? (size_t)number : 0;
+}
+
+
+static long hexValue(const char *str, size_t len) {
+    long value = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)str[i])) {
+            return -1;
+        }
+
+        value = value * 16 + (isdigit((unsigned char)str[i]) ? str[i] - '0' : toupper((unsigned char)str[i]) - 'A' + 10);
+    }
+
+    return value;
+}
+
+
+static size_t encodeUtf8(char *out, long code) {
+    if (code < 0x80) {
+        out[0] = code;
+        return 1;
+    } else if (code < 0x800) {
+        out[0] = 0xC0 | (code >> 6);
+        out[1] = 0x80 | (code & 0x3F);
+        return 2;
+    } else if (code < 0x10000) {
+        out[0] = 0xE0 | (code >> 12);
+        out[1] = 0x80 | ((code >> 6) & 0x3F);
+        out[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+
+    out[0] = 0xF0 | (code >> 18);
+    out[1] = 0x80 | ((code >> 12) & 0x3F);
+    out[2] = 0x80 | ((code >> 6) & 0x3F);
+    out[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+
+
+// Decodes a string value, returns NULL if value is not a string. Escapes never decode to more bytes than they take up
+static char *jsonString(const Message *msg, size_t value, size_t *len) {
+    if (value == JSON_NONE || msg->values.ptr[value].type != JSON_STRING) {
+        return NULL;
+    }
+
+    const char *src = msg->text + msg->values.ptr[value].start + 1;
+    size_t size = msg->values.ptr[value].end - msg->values.ptr[value].start - 2;
+    char *str = vaMalloc("LC3_Lsp", size + 1);
+    size_t out = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        if (src[i] != '\\' || i + 1 >= size) {
+            str[out++] = src[i];
+            continue;
+        }
+
+        switch (src[++i]) {
+            case 'b': str[out++] = '\b'; break;
+            case 'f': str[out++] = '\f'; break;
+            case 'n': str[out++] = '\n'; break;
+            case 'r': str[out++] = '\r'; break;
+            case 't': str[out++] = '\t'; break;
+            case 'u': {
+                long code = (i + 4 < size) ? hexValue(src + i + 1, 4) : -1;
+
+                if (code < 0) {
+                    str[out++] = '?';
+                    break;
+                }
+
+                i += 4;
+
+                // Characters outside of the BMP are escaped as a surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && i + 6 < size && src[i + 1] == '\\' && src[i + 2] == 'u') {
+                    long low = hexValue(src + i + 3, 4);
+
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+
+                out += encodeUtf8(str + out, code);
+                break;
+            }
+            default:
+                str[out++] = src[i];
+                break;
+        }
+    }
+
+    str[out] = '\0';
+
+    if (len != NULL) {
+        (*len) = out;
+    }
+
+    return str;
+}
+
+
+static void writeEscaped(FILE *fp, const char *str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = str[i];
+
+        if (c == '"' || c == '\\') {
+            fprintf(fp, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(fp, "\\u%04x", c);
+        } else {
+            putc(c, fp);
+        }
+    }
+}
+
+
+static void writeString(FILE *fp, const char *str) {
+    putc('"', fp);
+    writeEscaped(fp, str, strlen(str));
+    putc('"', fp);
+}
+
+
+/* == Messages == */
+
+
+// Reads the next message into msg, returns false at the end of the input
+static bool readMessage(Server *server, Message *msg) {
+    char *header = NULL;
+    size_t cap = 0;
+    long length = -1;
+    ssize_t len;
+
+    // Headers end with an empty line, only the content length is needed
+    while ((len = getline(&header, &cap, server->in)) > 0 && !(length >= 0 && (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0))) {
+        if (strncasecmp(header, "Content-Length:", 15) == 0) {
+            length = strtol(header + 15, NULL, 10);
+        }
+    }
+
+    // From getline
+    free(header);
+
+    if (len <= 0) {
+        return false;
+    }
+
+    msg->size = 0;
+
+    // Too large messages are read, but not kept
+    for (long skipped = 0; length > MESSAGE_MAX && skipped < length; skipped++) {
+        if (getc(server->in) == EOF) {
+            return false;
+        }
+    }
+
+    if (length > MESSAGE_MAX) {
+        msg->text[0] = '\0';
+        return true;
+    }
+
+    msg->text = vaRealloc("LC3_Lsp", msg->text, length + 1);
+    msg->size = fread(msg->text, 1, length, server->in);
+    msg->text[msg->size] = '\0';
+    return (msg->size == (size_t)length);
+}
+
+
+// The stream writes to the body and size of reply, so it can not be moved
+static void beginReply(Reply *reply) {
+    reply->fp = open_memstream(&reply->body, &reply->size);
+    fprintf(reply->fp, "{\"jsonrpc\":\"2.0\",");
+}
+
+
+static void sendReply(Server *server, Reply *reply) {
+    putc('}', reply->fp);
+    fclose(reply->fp);
+
+    fprintf(server->out, "Content-Length: %zu\r\n\r\n", reply->size);
+    fwrite(reply->body, 1, reply->size, server->out);
+    fflush(server->out);
+
+    // Buffers of open_memstream come from malloc
+    free(reply->body);
+}
+
+
+// Starts the response to the request with id, its result follows
+static void beginResponse(Reply *reply, const Message *msg, size_t id) {
+    const JsonValue *value = &msg->values.ptr[id];
+
+    beginReply(reply);
+    fprintf(reply->fp, "\"id\":%.*s,\"result\":", (int)(value->end - value->start), msg->text + value->start);
+}
+
+
+static void sendError(Server *server, const Message *msg, size_t id, int code, const char *message) {
+    Reply reply;
+    beginReply(&reply);
+
+    if (id != JSON_NONE) {
+        fprintf(reply.fp, "\"id\":%.*s,", (int)(msg->values.ptr[id].end - msg->values.ptr[id].start), msg->text + msg->values.ptr[id].start);
+    } else {
+        fprintf(reply.fp, "\"id\":null,");
+    }
+
+    fprintf(reply.fp, "\"error\":{\"code\":%d,\"message\":", code);
+    writeString(reply.fp, message);
+    putc('}', reply.fp);
+    sendReply(server, &reply);
+}
+
+
+/* == Documents == */
+
+
+// Editors count columns in UTF-16 code units, documents are stored as UTF-8
+static size_t byteColumn(String raw, size_t character) {
+    size_t byte = 0;
+
+    for (size_t units = 0; byte < raw.sz && units < character;) {
+        unsigned char c = raw.ptr[byte];
+        size_t len = (c >= 0xF0) ? 4 : (c >= 0xE0) ? 3 : (c >= 0xC0) ? 2 : 1;
+
+        units += (len == 4) ? 2 : 1;
+        byte += len;
+    }
+
+    return (byte < raw.sz) ? byte : raw.sz;
+}
+
+
+static size_t utf16Column(String raw, size_t byte) {
+    size_t units = 0;
+
+    for (size_t i = 0; i < byte && i < raw.sz; i++) {
+        unsigned char c = raw.ptr[i];
+        units += ((c & 0xC0) != 0x80) + (c >= 0xF0);
+    }
+
+    return units;
+}
+
+
+static Document *openDocument(Server *server, const char *uri) {
+    Document *doc = vaMalloc("LC3_Lsp", sizeof(Document));
+
+    doc->uri = vaMalloc("LC3_Lsp", strlen(uri) + 1);
+    memcpy(doc->uri, uri, strlen(uri) + 1);
+    doc->unit = LC3_CreateUnit(&server->ctx, doc->uri);
+    doc->lines = newLineInfoArray();
+
+    addObjectSection(&doc->unit.obj, newObjectSection(0, 0, 0));
+    addDocument(&server->docs, doc);
+    return doc;
+}
+
+
+static void closeDocument(Server *server, size_t index) {
+    Document *doc = server->docs.ptr[index];
+
+    for (size_t i = 0; i < doc->lines.sz; i++) {
+        vaFree(doc->lines.ptr[i].raw.ptr);
+        freeDiagnosticArray(doc->lines.ptr[i].diag);
+    }
+
+    LC3_DestroyUnit(doc->unit);
+    vaFree(doc->lines.ptr);
+    vaFree(doc->uri);
+    vaFree(doc);
+
+    server->docs.ptr[index] = server->docs.ptr[--server->docs.sz];
+}
+
+
+static size_t findDocument(const Server *server, const char *uri) {
+    for (size_t i = 0; uri != NULL && i < server->docs.sz; i++) {
+        if (strcmp(server->docs.ptr[i]->uri, uri) == 0) {
+            return i;
+        }
+    }
+
+    return JSON_NONE;
+}
+
+
+// Parses line i on its own. Statements are translated (at address 0) in the scratch section of the unit, which gives
+// their size, the label they refer to and the errors that do not depend on other lines
+static void parseLine(Document *doc, size_t i) {
+    LC3_Unit *unit = &doc->unit;
+    LineInfo *line = &doc->lines.ptr[i];
+    ObjectSection *scratch = &unit->obj.ptr[0];
+
+    // Token positions can not go past TOKEN_MAX
+    if (unit->buf.ptr[i].sz >= TOKEN_MAX) {
+        unit->buf.ptr[i].sz = 0;
+        unit->buf.ptr[i].ptr[0] = '\0';
+        LC3_TokenError(unit, i, (Token){0, 0}, "line longer than maximum allowed length", 0);
+    }
+
+    line->valid = parseStatement(unit, i, &line->stmt);
+    line->origin = 0;
+    line->size = 0;
+    line->ref = (Relocation){0};
+
+    if (line->valid && line->stmt.instr->instr == INSTR_PS_ORIG) {
+        line->origin = getNumber(line->stmt.args[0], unit->buf.ptr[i]).value;
+    } else if (line->valid && line->stmt.instr->instr != INSTR_PS_END) {
+        OptInt addr = {0, true};
+
+        scratch->words.sz = 0;
+        scratch->reloc.sz = 0;
+        interpretStatement(unit, line->stmt, &addr);
+
+        line->size = addr.value;
+        line->ref = (scratch->reloc.sz > 0) ? scratch->reloc.ptr[0] : line->ref;
+    }
+
+    // Errors of the line are kept with it, most lines have none
+    if (unit->diag.sz > 0) {
+        line->diag = unit->diag;
+        unit->diag = newDiagnosticArray();
+    } else {
+        line->diag = (DiagnosticArray){0};
+    }
+
+    unit->error = false;
+}
+
+
+// Moves addr past line like interpretStatement does, returns the error if line needs an address it does not have
+static const char *advanceAddress(const LineInfo *line, OptInt *addr) {
+    if (!line->valid) {
+        return NULL;
+    }
+
+    if (line->stmt.instr->instr == INSTR_PS_ORIG) {
+        if (addr->set) {
+            return "origin already set, use .END to end previous section";
+        }
+
+        addr->set = true;
+        addr->value = line->origin;
+        return NULL;
+    }
+
+    if (!addr->set) {
+        return "unable to determine address for token";
+    }
+
+    if (line->stmt.instr->instr == INSTR_PS_END) {
+        addr->set = false;
+    } else {
+        addr->value += line->size;
+    }
+
+    return NULL;
+}
+
+
+// After replacing lines [first, last), addresses are updated from first until a line after them has its old address
+static void updateAddresses(Document *doc, size_t first, size_t last) {
+    OptInt addr = {0, false};
+
+    if (first > 0) {
+        addr = doc->lines.ptr[first - 1].addr;
+        advanceAddress(&doc->lines.ptr[first - 1], &addr);
+    }
+
+    for (size_t i = first; i < doc->lines.sz; i++) {
+        LineInfo *line = &doc->lines.ptr[i];
+
+        if (i >= last && line->addr.value == addr.value && line->addr.set == addr.set) {
+            break;
+        }
+
+        line->addr = addr;
+        line->addrError = advanceAddress(line, &addr);
+    }
+}
+
+
+// Duplicate labels are next to each other in order of line, references go to the first and the others are redefinitions
+static const Symbol *firstSymbol(const SymbolTable *symbols, Token tk, String str) {
+    const Symbol *symbol = lookupSymbol(symbols, tk, str);
+
+    while (symbol != NULL && symbol > symbols->ptr && tokenCaseCmp(symbol[-1].loc.tk, tk, symbol[-1].loc.unit->buf.ptr[symbol[-1].loc.line], str) == 0) {
+        symbol--;
+    }
+
+    return symbol;
+}
+
+
+static size_t resolveTarget(Document *doc, size_t i) {
+    LineInfo *line = &doc->lines.ptr[i];
+
+    if (line->target == TARGET_UNKNOWN) {
+        const Symbol *symbol = firstSymbol(&doc->unit.symb, line->ref.label.tk, doc->unit.buf.ptr[i]);
+        line->target = (symbol != NULL) ? symbol->loc.line : TARGET_NONE;
+    }
+
+    return line->target;
+}
+
+
+// Targets of label references are kept between edits. They move along with their lines, and are looked up again when
+// their definition is replaced or a label of the same name is added (which may come first)
+static void updateTargets(Document *doc, size_t first, size_t last, size_t count, const SymbolTable *added) {
+    LC3_Unit *unit = &doc->unit;
+
+    for (size_t i = 0; i < doc->lines.sz; i++) {
+        LineInfo *line = &doc->lines.ptr[i];
+
+        if (i >= first && i < first + count) {
+            continue;
+        }
+
+        if (line->target != TARGET_NONE && line->target != TARGET_UNKNOWN) {
+            if (line->target >= first && line->target < last) {
+                line->target = TARGET_UNKNOWN;
+            } else if (line->target >= last) {
+                line->target = line->target - (last - first) + count;
+            }
+        }
+
+        for (size_t j = 0; line->target != TARGET_UNKNOWN && line->ref.label.tk.sz > 0 && j < added->sz; j++) {
+            const Symbol *symbol = &added->ptr[j];
+
+            if (added->sz > TARGET_RECHECK_MAX || tokenCaseCmp(line->ref.label.tk, symbol->loc.tk, unit->buf.ptr[i], unit->buf.ptr[symbol->loc.line]) == 0) {
+                line->target = TARGET_UNKNOWN;
+            }
+        }
+    }
+}
+
+
+// Replaces lines [first, last) with count new lines, which the document takes over
+static void replaceLines(Document *doc, size_t first, size_t last, const String *raw, size_t count) {
+    LC3_Unit *unit = &doc->unit;
+    size_t oldCount = doc->lines.sz;
+    size_t newCount = oldCount - (last - first) + count;
+    size_t kept = 0;
+
+    for (size_t i = first; i < last; i++) {
+        vaFree(doc->lines.ptr[i].raw.ptr);
+        freeDiagnosticArray(doc->lines.ptr[i].diag);
+        vaFree(unit->buf.ptr[i].ptr);
+    }
+
+    // Symbols of the replaced lines are removed, the ones after them move along with their lines and stay sorted
+    for (size_t i = 0; i < unit->symb.sz; i++) {
+        Symbol symbol = unit->symb.ptr[i];
+
+        if (symbol.loc.line >= first && symbol.loc.line < last) {
+            continue;
+        }
+
+        if (symbol.loc.line >= last) {
+            symbol.loc.line = symbol.loc.line - (last - first) + count;
+        }
+
+        unit->symb.ptr[kept++] = symbol;
+    }
+
+    reserveLineInfoArray(&doc->lines, newCount);
+    reserveStringArray(&unit->buf, newCount);
+    memmove(doc->lines.ptr + first + count, doc->lines.ptr + last, (oldCount - last) * sizeof(LineInfo));
+    memmove(unit->buf.ptr + first + count, unit->buf.ptr + last, (oldCount - last) * sizeof(String));
+    doc->lines.sz = newCount;
+    unit->buf.sz = newCount;
+
+    SymbolTable added = newSymbolTable();
+
+    for (size_t i = first; i < first + count; i++) {
+        LineInfo *line = &doc->lines.ptr[i];
+
+        memset(line, 0, sizeof(LineInfo));
+        line->raw = raw[i - first];
+        line->target = TARGET_UNKNOWN;
+        unit->buf.ptr[i] = copyLine(line->raw.ptr, sourceLineLength(line->raw.ptr, line->raw.sz));
+        parseLine(doc, i);
+
+        // Addresses are kept with the lines, the value of a symbol is not used
+        if (line->stmt.label.sz > 0) {
+            Symbol symbol = {.value = 0, .loc = {.line = i, .tk = line->stmt.label, .unit = unit}};
+            addSymbolHelper(&added, symbol);
+        }
+    }
+
+    sortSymbolTable(&added);
+    mergeSymbolTable(&unit->symb, kept, &added);
+    updateTargets(doc, first, last, count, &added);
+    vaFree(added.ptr);
+
+    updateAddresses(doc, first, first + count);
+}
+
+
+// Applies a change from the editor, a range in UTF-16 positions and its new text, or the whole text if there is no range
+static void applyChange(Document *doc, const Message *msg, size_t change) {
+    size_t size;
+    char *text = jsonString(msg, jsonMember(msg, change, "text"), &size);
+    size_t range = jsonMember(msg, change, "range");
+    size_t first = 0, last = doc->lines.sz;
+    String before = {0}, after = {0};
+
+    if (text == NULL) {
+        return;
+    }
+
+    if (range != JSON_NONE && doc->lines.sz > 0) {
+        // Positions past the end are at the end
+        size_t startLine = jsonInteger(msg, jsonPath(msg, range, "start", "line", NULL));
+        size_t endLine = jsonInteger(msg, jsonPath(msg, range, "end", "line", NULL));
+        size_t startChar = jsonInteger(msg, jsonPath(msg, range, "start", "character", NULL));
+        size_t endChar = jsonInteger(msg, jsonPath(msg, range, "end", "character", NULL));
+
+        startChar = (startLine < doc->lines.sz) ? startChar : SIZE_MAX;
+        startLine = (startLine < doc->lines.sz) ? startLine : doc->lines.sz - 1;
+        endChar = (endLine < doc->lines.sz) ? endChar : SIZE_MAX;
+        endLine = (endLine < doc->lines.sz) ? endLine : doc->lines.sz - 1;
+        endLine = (endLine > startLine) ? endLine : startLine;
+
+        before = doc->lines.ptr[startLine].raw;
+        before.sz = byteColumn(before, startChar);
+        after = doc->lines.ptr[endLine].raw;
+
+        size_t end = byteColumn(after, endChar);
+        end = (endLine > startLine || end > before.sz) ? end : before.sz;
+        after.ptr += end;
+        after.sz -= end;
+
+        first = startLine;
+        last = endLine + 1;
+    }
+
+    // The text of the replaced lines around the range is kept
+    size_t total = before.sz + size + after.sz;
+    char *joined = vaMalloc("LC3_Lsp", total + 1);
+    StringArray lines = newStringArray();
+
+    if (before.sz > 0) memcpy(joined, before.ptr, before.sz);
+    if (size > 0) memcpy(joined + before.sz, text, size);
+    if (after.sz > 0) memcpy(joined + before.sz + size, after.ptr, after.sz);
+    joined[total] = '\0';
+
+    for (size_t start = 0;;) {
+        const char *newline = memchr(joined + start, '\n', total - start);
+        size_t end = (newline != NULL) ? (size_t)(newline - joined) : total;
+        size_t len = end - start;
+
+        // Line endings of the editor may be CRLF
+        len -= (newline != NULL && len > 0 && joined[end - 1] == '\r');
+        addString(&lines, copyLine(joined + start, len));
+
+        if (newline == NULL) {
+            break;
+        }
+
+        start = end + 1;
+    }
+
+    replaceLines(doc, first, last, lines.ptr, lines.sz);
+
+    vaFree(lines.ptr);
+    vaFree(joined);
+    vaFree(text);
+}
+
+
+// Finds the definition of label tk in str, in doc itself or else in another open document
+static const Symbol *findLabel(const Server *server, Document *doc, Token tk, String str, Document **found) {
+    const Symbol *symbol = firstSymbol(&doc->unit.symb, tk, str);
+    (*found) = doc;
+
+    for (size_t i = 0; symbol == NULL && i < server->docs.sz; i++) {
+        (*found) = server->docs.ptr[i];
+        symbol = (*found != doc) ? firstSymbol(&(*found)->unit.symb, tk, str) : NULL;
+    }
+
+    return symbol;
+}
+
+
+static void writeRange(FILE *fp, const Document *doc, size_t line, Token tk) {
+    String raw = doc->lines.ptr[line].raw;
+
+    fprintf(fp, "{\"start\":{\"line\":%zu,\"character\":%zu},\"end\":{\"line\":%zu,\"character\":%zu}}",
+        line, utf16Column(raw, tk.start), line, utf16Column(raw, tk.start + tk.sz)
+    );
+}
+
+
+// Token is added to the message in quotes, if not NULL
+static void writeDiagnostic(FILE *fp, size_t *count, const Document *doc, size_t line, Token tk, int severity, const char *message, const char *token) {
+    fprintf(fp, "%s{\"range\":", ((*count)++ > 0) ? "," : "");
+    writeRange(fp, doc, line, tk);
+    fprintf(fp, ",\"severity\":%d,\"source\":\"lc3a\",\"message\":\"", severity);
+    writeEscaped(fp, message, strlen(message));
+
+    if (token != NULL) {
+        fprintf(fp, " \\\"");
+        writeEscaped(fp, token, strlen(token));
+        fprintf(fp, "\\\"");
+    }
+
+    fprintf(fp, "\"}");
+}
+
+
+// Labels are checked like the linker would, but only against this document. Labels defined in other open documents
+// are accepted, others are only warned about since they may come from a file that is linked in
+static void writeLabelDiagnostics(const Server *server, FILE *fp, size_t *count, Document *doc, size_t i) {
+    const LineInfo *line = &doc->lines.ptr[i];
+    Token tk = line->ref.label.tk;
+    String str = doc->unit.buf.ptr[i];
+    const char *error = NULL;
+    int severity = SEVERITY_ERROR;
+    Document *found;
+
+    if (!line->valid || tk.sz == 0 || !line->addr.set) {
+        return;
+    }
+
+    size_t target = resolveTarget(doc, i);
+
+    if (target != TARGET_NONE && line->ref.kind != RELOC_ABS) {
+        uint16_t label = doc->lines.ptr[target].addr.value;
+        uint16_t addr = line->addr.value;
+        int16_t offset = (int)label - (int)addr - 1;
+        error = relocationError(line->ref.kind, offset);
+    } else if (target == TARGET_NONE && findLabel(server, doc, tk, str, &found) == NULL) {
+        error = "label is not defined in any open file";
+        severity = SEVERITY_WARNING;
+    }
+
+    if (error != NULL) {
+        char *name = tokenString(tk, str);
+        writeDiagnostic(fp, count, doc, i, tk, severity, error, name);
+        free(name);
+    }
+}
+
+
+// The protocol has no incremental diagnostics, so all of them are sent after every change
+static void publishDiagnostics(Server *server, Document *doc) {
+    Reply reply;
+    beginReply(&reply);
+    LC3_Unit *unit = &doc->unit;
+    size_t count = 0;
+
+    fprintf(reply.fp, "\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    writeString(reply.fp, doc->uri);
+    fprintf(reply.fp, ",\"diagnostics\":[");
+
+    for (size_t i = 0; i < doc->lines.sz; i++) {
+        const LineInfo *line = &doc->lines.ptr[i];
+
+        for (size_t j = 0; j < line->diag.sz; j++) {
+            const LC3_Diagnostic *diag = &line->diag.ptr[j];
+            writeDiagnostic(reply.fp, &count, doc, i, diag->tk, SEVERITY_ERROR, diag->message, (diag->flags & LC3_ERR_SHOW_TK) ? diag->token : NULL);
+        }
+
+        if (line->addrError != NULL) {
+            writeDiagnostic(reply.fp, &count, doc, i, line->stmt.orig, SEVERITY_ERROR, line->addrError, NULL);
+        }
+
+        writeLabelDiagnostics(server, reply.fp, &count, doc, i);
+    }
+
+    // Like objectify, every label after the first with the same name is a redefinition
+    for (size_t i = 1; i < unit->symb.sz; i++) {
+        const Symbol *current = &unit->symb.ptr[i], *previous = &unit->symb.ptr[i - 1];
+        String str = unit->buf.ptr[current->loc.line];
+
+        if (tokenCaseCmp(current->loc.tk, previous->loc.tk, str, unit->buf.ptr[previous->loc.line]) == 0) {
+            char *name = tokenString(current->loc.tk, str);
+            writeDiagnostic(reply.fp, &count, doc, current->loc.line, current->loc.tk, SEVERITY_ERROR, "redefinition of label", name);
+            free(name);
+        }
+    }
+
+    fprintf(reply.fp, "]}");
+    sendReply(server, &reply);
+}
+
+
+static void sendEmptyDiagnostics(Server *server, const char *uri) {
+    Reply reply;
+    beginReply(&reply);
+
+    fprintf(reply.fp, "\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    writeString(reply.fp, uri);
+    fprintf(reply.fp, ",\"diagnostics\":[]}");
+    sendReply(server, &reply);
+}
+
+
+// Labels of a document are accepted in the others, which are checked again when documents are opened or closed
+static void publishAll(Server *server) {
+    for (size_t i = 0; i < server->docs.sz; i++) {
+        publishDiagnostics(server, server->docs.ptr[i]);
+    }
+}
+
+
+/* == Requests == */
+
+
+// Finds the label defined or used at the position of a request, returns NULL if there is none
+static Document *labelAt(const Server *server, const Message *msg, size_t params, size_t *line, Token *tk) {
+    char *uri = jsonString(msg, jsonPath(msg, params, "textDocument", "uri", NULL), NULL);
+    size_t index = findDocument(server, uri);
+    vaFree(uri);
+
+    if (index == JSON_NONE) {
+        return NULL;
+    }
+
+    Document *doc = server->docs.ptr[index];
+    (*line) = jsonInteger(msg, jsonPath(msg, params, "position", "line", NULL));
+
+    if (*line >= doc->lines.sz) {
+        return NULL;
+    }
+
+    const LineInfo *info = &doc->lines.ptr[*line];
+    size_t column = byteColumn(info->raw, jsonInteger(msg, jsonPath(msg, params, "position", "character", NULL)));
+    Token candidates[] = {info->stmt.label, info->ref.label.tk};
+
+    // The cursor may be right after the label as well
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        if (candidates[i].sz > 0 && candidates[i].start <= column && column <= (size_t)(candidates[i].start + candidates[i].sz)) {
+            (*tk) = candidates[i];
+            return doc;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void handleDefinition(Server *server, const Message *msg, size_t id, size_t params) {
+    Reply reply;
+    beginResponse(&reply, msg, id);
+    Document *doc, *found;
+    size_t line;
+    Token tk;
+    const Symbol *symbol = NULL;
+
+    if ((doc = labelAt(server, msg, params, &line, &tk)) != NULL) {
+        symbol = findLabel(server, doc, tk, doc->unit.buf.ptr[line], &found);
+    }
+
+    if (symbol != NULL) {
+        fprintf(reply.fp, "{\"uri\":");
+        writeString(reply.fp, found->uri);
+        fprintf(reply.fp, ",\"range\":");
+        writeRange(reply.fp, found, symbol->loc.line, symbol->loc.tk);
+        putc('}', reply.fp);
+    } else {
+        fprintf(reply.fp, "null");
+    }
+
+    sendReply(server, &reply);
+}
+
+
+static void handleHover(Server *server, const Message *msg, size_t id, size_t params) {
+    Reply reply;
+    beginResponse(&reply, msg, id);
+    Document *doc, *found;
+    size_t line;
+    Token tk;
+    const Symbol *symbol = NULL;
+
+    if ((doc = labelAt(server, msg, params, &line, &tk)) != NULL) {
+        symbol = findLabel(server, doc, tk, doc->unit.buf.ptr[line], &found);
+    }
+
+    if (symbol != NULL) {
+        OptInt addr = found->lines.ptr[symbol->loc.line].addr;
+        String str = found->unit.buf.ptr[symbol->loc.line];
+
+        fprintf(reply.fp, "{\"contents\":{\"kind\":\"plaintext\",\"value\":\"");
+        writeEscaped(reply.fp, str.ptr + symbol->loc.tk.start, symbol->loc.tk.sz);
+
+        if (addr.set) {
+            fprintf(reply.fp, " = x%04X", (uint16_t)addr.value);
+        } else {
+            fprintf(reply.fp, " has no address, it is not in between .ORIG and .END");
+        }
+
+        if (found != doc) {
+            const char *name = strrchr(found->uri, '/');
+            fprintf(reply.fp, " (in ");
+            writeEscaped(reply.fp, (name != NULL) ? name + 1 : found->uri, strlen((name != NULL) ? name + 1 : found->uri));
+            putc(')', reply.fp);
+        }
+
+        fprintf(reply.fp, "\"},\"range\":");
+        writeRange(reply.fp, doc, line, tk);
+        putc('}', reply.fp);
+    } else {
+        fprintf(reply.fp, "null");
+    }
+
+    sendReply(server, &reply);
+}
+
+
+static void handleInitialize(Server *server, const Message *msg, size_t id) {
+    Reply reply;
+    beginResponse(&reply, msg, id);
+
+    // Changes are sent as ranges (incremental sync)
+    fprintf(reply.fp,
+        "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+        "\"definitionProvider\":true,\"hoverProvider\":true},\"serverInfo\":{\"name\":\"lc3a\"}}"
+    );
+
+    sendReply(server, &reply);
+}
+
+
+// Later requests are refused by the editor itself, the server keeps running until exit
+static void handleShutdown(Server *server, const Message *msg, size_t id) {
+    Reply reply;
+    beginResponse(&reply, msg, id);
+
+    server->shutdown = true;
+    fprintf(reply.fp, "null");
+    sendReply(server, &reply);
+}
+
+
+static void handleMessage(Server *server, const Message *msg) {
+    size_t id = jsonMember(msg, 0, "id");
+    size_t params = jsonMember(msg, 0, "params");
+    char *method = jsonString(msg, jsonMember(msg, 0, "method"), NULL);
+    char *uri = jsonString(msg, jsonPath(msg, params, "textDocument", "uri", NULL), NULL);
+    size_t doc = findDocument(server, uri);
+
+    // Responses to requests of the server, which it does not send
+    if (method == NULL) {
+        vaFree(uri);
+        return;
+    }
+
+    // Requests without an id are notifications, which never get a response
+    if (strcmp(method, "initialize") == 0 && id != JSON_NONE) {
+        handleInitialize(server, msg, id);
+    } else if (strcmp(method, "shutdown") == 0 && id != JSON_NONE) {
+        handleShutdown(server, msg, id);
+    } else if (strcmp(method, "exit") == 0) {
+        server->exiting = true;
+    } else if (strcmp(method, "textDocument/didOpen") == 0 && uri != NULL) {
+        // Opening a document again replaces it
+        if (doc != JSON_NONE) {
+            closeDocument(server, doc);
+        }
+
+        Document *opened = openDocument(server, uri);
+        applyChange(opened, msg, jsonMember(msg, params, "textDocument"));
+        publishAll(server);
+    } else if (strcmp(method, "textDocument/didChange") == 0 && doc != JSON_NONE) {
+        size_t element;
+        size_t count = jsonElement(msg, jsonMember(msg, params, "contentChanges"), &element);
+
+        for (size_t i = 0; i < count; i++, element = msg->values.ptr[element].next) {
+            applyChange(server->docs.ptr[doc], msg, element);
+        }
+
+        publishDiagnostics(server, server->docs.ptr[doc]);
+    } else if (strcmp(method, "textDocument/didClose") == 0 && doc != JSON_NONE) {
+        closeDocument(server, doc);
+        sendEmptyDiagnostics(server, uri);
+        publishAll(server);
+    } else if (strcmp(method, "textDocument/definition") == 0 && id != JSON_NONE) {
+        handleDefinition(server, msg, id, params);
+    } else if (strcmp(method, "textDocument/hover") == 0 && id != JSON_NONE) {
+        handleHover(server, msg, id, params);
+    } else if (id != JSON_NONE) {
+        sendError(server, msg, id, RPC_METHOD_NOT_FOUND, "method not supported");
+    }
+
+    vaFree(uri);
+    vaFree(method);
+}
+
+
+int LC3_LanguageServer(FILE *in, FILE *out) {
+    Server server = {
+        .in   = in,
+        .out  = out,
+        .ctx  = {.keepGoing = true},
+        .docs = newDocumentArray(),
+    };
+
+    Message msg = {
+        .text   = vaMalloc("LC3_Lsp", 1),
+        .values = newJsonValues(),
+    };
+
+    while (!server.exiting && readMessage(&server, &msg)) {
+        if (parseMessage(&msg)) {
+            handleMessage(&server, &msg);
+        } else {
+            sendError(&server, &msg, JSON_NONE, RPC_PARSE_ERROR, "message is not a valid JSON object");
+        }
+    }
+
+    while (server.docs.sz > 0) {
+        closeDocument(&server, server.docs.sz - 1);
+    }
+
+    vaFree(server.docs.ptr);
+    vaFree(msg.values.ptr);
+    vaFree(msg.text);
+    return server.shutdown ? 0 : 1;
+}
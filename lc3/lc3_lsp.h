@@ -0,0 +1,14 @@
+/*
+ * Description:
+ * Language server for editors, speaking the Language Server Protocol over stdio.
+ * Every line of an open document is parsed on its own and kept, so an edit only parses the lines it touches. Label
+ * addresses follow from the lines before them, and are updated from the first edited line until they match again
+ */
+
+#pragma once
+#include <stdio.h>
+
+
+// Serves diagnostics, go to definition and hover for label addresses to the editor on in and out, until it exits.
+// Returns the exit status the protocol asks for, 0 if the editor shut the server down first and 1 otherwise
+int LC3_LanguageServer(FILE *in, FILE *out);
@@ -0,0 +1,118 @@
+#include "lc3_mem.h"
+#include "lc3_str.h"
+#include "lib/va_alloc.h"
+#include <string.h>
+
+
+// Maps va tags (mostly array type names) onto categories
+static const struct {
+    const char *tag;
+    const char *category;
+} CATEGORY_MAP[] = {
+    {"String",             "source"},
+    {"StringArray",        "source"},
+    {"SymbolTable",        "symbols"},
+    {"StatementArray",     "objects"},
+    {"WordArray",          "objects"},
+    {"RelocationArray",    "objects"},
+    {"DebugTable",         "objects"},
+    {"ObjectSectionArray", "objects"},
+    {"IntervalArray",      "intervals"},
+    {"LC3_AddressSpace",   "intervals"},
+    {"LC3_OverlapArray",   "intervals"},
+    {"DebugStrings",       "debug"},
+    {"DiagnosticArray",    "diagnostics"},
+    {"LC3_Diagnostic",     "diagnostics"},
+    {"LC3_Archive",        "archives"},
+    {"LC3_Cache",          "cache"},
+    {"cmdarg",             "cmdarg"},
+    {"_ca_fe_arr",         "cmdarg"},
+    {"_ca_str_arr",        "cmdarg"},
+};
+
+
+static const char *getCategory(const char *tag) {
+    for (size_t i = 0; i < sizeof(CATEGORY_MAP) / sizeof(CATEGORY_MAP[0]); i++) {
+        if (strcmp(tag, CATEGORY_MAP[i].tag) == 0) {
+            return CATEGORY_MAP[i].category;
+        }
+    }
+
+    return "other";
+}
+
+
+void LC3_TrackMemory() {
+    vaMemSetClassifier(getCategory);
+    vaMemTrack(true);
+}
+
+
+// State while writing the report
+typedef struct ReportState {
+    FILE *fp;
+    const char *owner;
+    bool first;
+} ReportState;
+
+
+static const char *ownerName(const char *owner) {
+    return (owner == NULL) ? "(global)" : owner;
+}
+
+
+static void writeTableLine(const vaMemStat *stat, void *data) {
+    ReportState *state = data;
+
+    fprintf(state->fp, "%-24s %-10s %12zu %12zu %10zu %10zu\n",
+        (state->first || stat->owner != state->owner) ? ownerName(stat->owner) : "",
+        stat->category, stat->current, stat->peak, stat->allocs, stat->reallocs
+    );
+
+    state->owner = stat->owner;
+    state->first = false;
+}
+
+
+static void writeJsonLine(const vaMemStat *stat, void *data) {
+    ReportState *state = data;
+
+    if (state->first || stat->owner != state->owner) {
+        fprintf(state->fp, state->first ? "\n    {\"unit\": " : "\n    }},\n    {\"unit\": ");
+
+        if (stat->owner == NULL) {
+            fprintf(state->fp, "null");
+        } else {
+            writeJsonString(state->fp, stat->owner);
+        }
+
+        fprintf(state->fp, ", \"categories\": {");
+    } else {
+        putc(',', state->fp);
+    }
+
+    fprintf(state->fp, "\n      \"%s\": {\"current\": %zu, \"peak\": %zu, \"allocs\": %zu, \"reallocs\": %zu, \"frees\": %zu}",
+        stat->category, stat->current, stat->peak, stat->allocs, stat->reallocs, stat->frees
+    );
+
+    state->owner = stat->owner;
+    state->first = false;
+}
+
+
+void LC3_WriteMemoryReport(FILE *fp, bool json) {
+    ReportState state = {fp, NULL, true};
+    size_t current, peak;
+    vaMemTotal(&current, &peak);
+
+    if (!json) {
+        fprintf(fp, "%-24s %-10s %12s %12s %10s %10s\n", "unit", "category", "current", "peak", "allocs", "reallocs");
+        vaMemForEach(writeTableLine, &state);
+        fprintf(fp, "%-24s %-10s %12zu %12zu\n", "total", "", current, peak);
+        return;
+    }
+
+    fprintf(fp, "{\n  \"current\": %zu,\n  \"peak\": %zu,\n  \"units\": [", current, peak);
+    vaMemForEach(writeJsonLine, &state);
+    fprintf(fp, state.first ? "]\n}\n" : "\n    }}\n  ]\n}\n");
+}
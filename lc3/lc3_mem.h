@@ -0,0 +1,15 @@
+/* 
+ * Description: 
+ * Memory accounting for the LC3 assembler, built on top of the va allocation functions
+ */
+
+#pragma once
+#include <stdbool.h>
+#include <stdio.h>
+
+
+// Start accounting for all following allocations, grouped into assembler categories
+void LC3_TrackMemory();
+
+// Writes peak and current memory use per unit and category, as a table or as JSON
+void LC3_WriteMemoryReport(FILE *fp, bool json);
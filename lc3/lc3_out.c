@@ -0,0 +1,193 @@
+#include "lc3_out.h"
+#include "lib/va_alloc.h"
+#include <string.h>
+
+// Words converted at once
+#define CHUNK_SIZE (256)
+
+// Bytes per Intel HEX data record
+#define HEX_RECORD_SIZE (16)
+
+
+// Writes words in big endian byte order
+static void writeBigEndian(FILE *fp, const uint16_t *words, size_t size) {
+    uint8_t chunk[2 * CHUNK_SIZE];
+
+    while (size > 0) {
+        size_t count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
+
+        for (size_t i = 0; i < count; i++) {
+            chunk[2 * i]     = words[i] >> 8;
+            chunk[2 * i + 1] = words[i] & 0xFF;
+        }
+
+        fwrite(chunk, 2, count, fp);
+        words += count;
+        size -= count;
+    }
+}
+
+
+static void writeZeroes(FILE *fp, size_t size) {
+    static const uint16_t zeroes[CHUNK_SIZE] = {0};
+
+    while (size > 0) {
+        size_t count = (size < CHUNK_SIZE) ? size : CHUNK_SIZE;
+        fwrite(zeroes, 2, count, fp);
+        size -= count;
+    }
+}
+
+
+// Classic object file and raw binary are a single block of memory, gaps between sections are filled with zeroes
+typedef struct BlockState {
+    bool started;
+    uint32_t next;
+} BlockState;
+
+
+static void writeBlock(BlockState *state, FILE *fp, uint16_t origin, const uint16_t *words, size_t size) {
+    if (state->started && origin > state->next) {
+        writeZeroes(fp, origin - state->next);
+    }
+
+    writeBigEndian(fp, words, size);
+    state->started = true;
+    state->next = origin + size;
+}
+
+
+static void writeObjSection(void *state, FILE *fp, uint16_t origin, const uint16_t *words, size_t size) {
+    // The origin is only stored once, at the start of the file
+    if (!((BlockState *)state)->started) {
+        writeBigEndian(fp, &origin, 1);
+    }
+
+    writeBlock(state, fp, origin, words, size);
+}
+
+
+static void writeBinSection(void *state, FILE *fp, uint16_t origin, const uint16_t *words, size_t size) {
+    writeBlock(state, fp, origin, words, size);
+}
+
+
+// Intel HEX, with byte addresses (two per word) and extended linear address records above 64 KB
+typedef struct HexState {
+    uint16_t upper;
+} HexState;
+
+
+static void writeHexRecord(FILE *fp, uint8_t type, uint16_t address, const uint8_t *data, size_t size) {
+    uint8_t sum = size + (address >> 8) + (address & 0xFF) + type;
+    fprintf(fp, ":%02X%04X%02X", (unsigned)size, address, type);
+
+    for (size_t i = 0; i < size; i++) {
+        fprintf(fp, "%02X", data[i]);
+        sum += data[i];
+    }
+
+    fprintf(fp, "%02X\n", (uint8_t)-sum);
+}
+
+
+static void writeHexSection(void *state, FILE *fp, uint16_t origin, const uint16_t *words, size_t size) {
+    HexState *hex = state;
+    uint8_t record[HEX_RECORD_SIZE];
+    uint32_t address = (uint32_t)origin * 2;
+    size_t i = 0;
+
+    while (i < size) {
+        // Records may not cross a 64 KB boundary
+        uint32_t room = 0x10000 - (address & 0xFFFF);
+        size_t count = 0;
+
+        if ((address >> 16) != hex->upper) {
+            uint8_t upper[2] = {0, address >> 16};
+            hex->upper = address >> 16;
+            writeHexRecord(fp, 0x04, 0, upper, 2);
+        }
+
+        for (; i < size && count + 2 <= HEX_RECORD_SIZE && count + 2 <= room; i++) {
+            record[count++] = words[i] >> 8;
+            record[count++] = words[i] & 0xFF;
+        }
+
+        writeHexRecord(fp, 0x00, address & 0xFFFF, record, count);
+        address = (address + count) & 0x1FFFF;
+    }
+}
+
+
+static void finishHex(void *state, FILE *fp) {
+    writeHexRecord(fp, 0x01, 0, NULL, 0);
+}
+
+
+static const LC3_OutputBackend BACKENDS[] = {
+    {"obj", "out.obj", sizeof(BlockState), writeObjSection, NULL},
+    {"bin", "out.bin", sizeof(BlockState), writeBinSection, NULL},
+    {"hex", "out.hex", sizeof(HexState),   writeHexSection, finishHex},
+};
+
+
+const LC3_OutputBackend *LC3_FindOutputBackend(const char *name) {
+    for (size_t i = 0; i < sizeof(BACKENDS) / sizeof(BACKENDS[0]); i++) {
+        if (strcmp(BACKENDS[i].name, name) == 0) {
+            return &BACKENDS[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static int sectionOriginCmp(const void *s1, const void *s2) {
+    const ObjectSection *a = *(const ObjectSection **)s1, *b = *(const ObjectSection **)s2;
+    return (a->origin != b->origin) ? ((a->origin < b->origin) ? -1 : 1) : ((a < b) ? -1 : (a > b));
+}
+
+
+void LC3_WriteOutput(const LC3_OutputBackend *backend, size_t unitCount, LC3_Unit *units, const char *filename) {
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", filename);
+        return;
+    }
+
+    size_t sectionCount = 0;
+
+    for (size_t i = 0; i < unitCount; i++) {
+        sectionCount += units[i].obj.sz;
+    }
+
+    // Sections are only reordered, the words are written straight from them
+    const ObjectSection **sections = vaMalloc("LC3_Output", (sectionCount + 1) * sizeof(ObjectSection *));
+    void *state = vaMalloc("LC3_Output", backend->stateSize);
+    size_t count = 0;
+
+    memset(state, 0, backend->stateSize);
+
+    for (size_t i = 0; i < unitCount; i++) {
+        for (size_t section = 0; section < units[i].obj.sz; section++) {
+            if (units[i].obj.ptr[section].words.sz > 0) {
+                sections[count++] = &units[i].obj.ptr[section];
+            }
+        }
+    }
+
+    qsort(sections, count, sizeof(ObjectSection *), sectionOriginCmp);
+
+    for (size_t i = 0; i < count; i++) {
+        backend->section(state, fp, sections[i]->origin, sections[i]->words.ptr, sections[i]->words.sz);
+    }
+
+    if (backend->finish != NULL) {
+        backend->finish(state, fp);
+    }
+
+    fclose(fp);
+    vaFree(state);
+    vaFree(sections);
+}
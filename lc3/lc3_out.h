@@ -0,0 +1,25 @@
+/*
+ * Description:
+ * Output backends for formats used by other LC3 tools, fed with the resolved sections in order of address
+ */
+
+#pragma once
+#include "lc3_asm.h"
+
+
+typedef struct LC3_OutputBackend {
+    const char *name;
+    const char *defaultOutput;
+    size_t stateSize; // Bytes of zeroed state passed to every call
+
+    // Called for every non-empty section, in order of origin
+    void (*section)(void *state, FILE *fp, uint16_t origin, const uint16_t *words, size_t size);
+    void (*finish)(void *state, FILE *fp);
+} LC3_OutputBackend;
+
+
+// Backend with the given name, NULL if there is none
+const LC3_OutputBackend *LC3_FindOutputBackend(const char *name);
+
+// Writes the sections of all units using backend
+void LC3_WriteOutput(const LC3_OutputBackend *backend, size_t unitCount, LC3_Unit *units, const char *filename);
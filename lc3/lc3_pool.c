@@ -0,0 +1,358 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_pool.h"
+#include "lib/va_alloc.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Indices dealt to a worker, most costly first. The owner takes from the front, other workers steal from the back
+typedef struct JobDeque {
+    pthread_mutex_t mutex;
+    size_t *items;
+    size_t head, tail;
+} JobDeque;
+
+
+// Shared between all workers of a single LC3_RunWeightedJobs call
+typedef struct JobQueue {
+    JobDeque *deques;
+    size_t workerCount;
+    LC3_Job job;
+    void *data;
+} JobQueue;
+
+
+typedef struct Worker {
+    pthread_t thread;
+    JobQueue *queue;
+    size_t index;
+    LC3_WorkerStats stats;
+} Worker;
+
+
+typedef struct WeightedJob {
+    uint64_t cost;
+    size_t index;
+} WeightedJob;
+
+
+static int weightedJobCmp(const void *j1, const void *j2) {
+    const WeightedJob *a = j1, *b = j2;
+
+    if (a->cost != b->cost) {
+        return (a->cost > b->cost) ? -1 : 1;
+    }
+
+    return (a->index > b->index) - (a->index < b->index);
+}
+
+
+double LC3_Seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+// Takes the next index of worker, from its own deque or stolen from another one. Returns false once all are empty
+static bool takeJob(Worker *worker, size_t *index) {
+    JobQueue *queue = worker->queue;
+
+    for (size_t i = 0; i < queue->workerCount; i++) {
+        JobDeque *deque = &queue->deques[(worker->index + i) % queue->workerCount];
+        bool found;
+
+        pthread_mutex_lock(&deque->mutex);
+        found = (deque->head < deque->tail);
+
+        if (found) {
+            (*index) = (i == 0) ? deque->items[deque->head++] : deque->items[--deque->tail];
+        }
+
+        pthread_mutex_unlock(&deque->mutex);
+
+        // Jobs are never added, so empty deques stay empty
+        if (found) {
+            worker->stats.stolen += (i > 0);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void *runWorker(void *arg) {
+    Worker *worker = arg;
+    size_t index;
+
+    while (takeJob(worker, &index)) {
+        double start = LC3_Seconds();
+        worker->queue->job(worker->queue->data, index, worker->index);
+        worker->stats.busy += LC3_Seconds() - start;
+        worker->stats.jobs++;
+    }
+
+    return NULL;
+}
+
+
+size_t LC3_ProcessorCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count < 1) ? 1 : (size_t)count;
+}
+
+
+void LC3_RunJobs(size_t count, size_t workerCount, LC3_Job job, void *data) {
+    LC3_RunWeightedJobs(count, workerCount, job, data, NULL, NULL);
+}
+
+
+size_t LC3_RunWeightedJobs(size_t count, size_t workerCount, LC3_Job job, void *data, const uint64_t *costs, LC3_WorkerStats *stats) {
+    if (workerCount > count) {
+        workerCount = count;
+    }
+
+    // Not worth starting threads for
+    if (workerCount <= 1) {
+        double start = LC3_Seconds();
+
+        for (size_t i = 0; i < count; i++) {
+            job(data, i, 0);
+        }
+
+        if (stats != NULL && count > 0) {
+            stats[0] = (LC3_WorkerStats){.busy = LC3_Seconds() - start, .idle = 0, .jobs = count, .stolen = 0};
+        }
+
+        return (count > 0);
+    }
+
+    WeightedJob *order = vaMalloc("Worker", count * sizeof(WeightedJob));
+    size_t *items = vaMalloc("Worker", count * sizeof(size_t));
+    JobDeque *deques = vaMalloc("Worker", workerCount * sizeof(JobDeque));
+    Worker *workers = vaMalloc("Worker", workerCount * sizeof(Worker));
+
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (WeightedJob){(costs != NULL) ? costs[i] : 0, i};
+    }
+
+    if (costs != NULL) {
+        qsort(order, count, sizeof(WeightedJob), weightedJobCmp);
+    }
+
+    // Jobs are dealt round robin, so every worker starts with one of the most costly ones
+    for (size_t w = 0, start = 0; w < workerCount; w++) {
+        deques[w].items = &items[start];
+        deques[w].head  = 0;
+        deques[w].tail  = 0;
+        pthread_mutex_init(&deques[w].mutex, NULL);
+
+        for (size_t i = w; i < count; i += workerCount) {
+            deques[w].items[deques[w].tail++] = order[i].index;
+        }
+
+        start += deques[w].tail;
+    }
+
+    JobQueue queue = {
+        .deques      = deques,
+        .workerCount = workerCount,
+        .job         = job,
+        .data        = data,
+    };
+
+    for (size_t i = 0; i < workerCount; i++) {
+        workers[i].queue = &queue;
+        workers[i].index = i;
+        memset(&workers[i].stats, 0, sizeof(LC3_WorkerStats));
+    }
+
+    double start = LC3_Seconds();
+
+    // The calling thread is worker 0
+    for (size_t i = 1; i < workerCount; i++) {
+        pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]);
+    }
+
+    runWorker(&workers[0]);
+
+    for (size_t i = 1; i < workerCount; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    double elapsed = LC3_Seconds() - start;
+
+    for (size_t i = 0; i < workerCount; i++) {
+        if (stats != NULL) {
+            stats[i] = workers[i].stats;
+            stats[i].idle = (elapsed > stats[i].busy) ? elapsed - stats[i].busy : 0;
+        }
+
+        pthread_mutex_destroy(&deques[i].mutex);
+    }
+
+    vaFree(workers);
+    vaFree(deques);
+    vaFree(items);
+    vaFree(order);
+    return workerCount;
+}
+
+
+// Shared between all workers of a single LC3_RunJobGraph call
+typedef struct JobGraph {
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    LC3_Job job;
+    void *data;
+    const uint64_t *costs;
+    size_t *waiting;    // Unfinished dependencies of every job
+    size_t *nextStart;  // Jobs that depend on job i are next[nextStart[i]] up to next[nextStart[i + 1]]
+    size_t *next;
+    size_t *ready;
+    size_t readyCount;
+    size_t running;
+} JobGraph;
+
+
+typedef struct GraphWorker {
+    pthread_t thread;
+    JobGraph *graph;
+    size_t index;
+} GraphWorker;
+
+
+// Takes the ready job with the highest cost, the graph must be locked
+static size_t takeReadyJob(JobGraph *graph) {
+    size_t best = 0;
+
+    for (size_t i = 1; graph->costs != NULL && i < graph->readyCount; i++) {
+        if (graph->costs[graph->ready[i]] > graph->costs[graph->ready[best]]) {
+            best = i;
+        }
+    }
+
+    size_t index = graph->ready[best];
+    graph->ready[best] = graph->ready[--graph->readyCount];
+    return index;
+}
+
+
+static void *runGraphWorker(void *arg) {
+    GraphWorker *worker = arg;
+    JobGraph *graph = worker->graph;
+
+    pthread_mutex_lock(&graph->mutex);
+
+    // Nothing ready and nothing running means that every job that can run is done
+    while (graph->readyCount > 0 || graph->running > 0) {
+        if (graph->readyCount == 0) {
+            pthread_cond_wait(&graph->changed, &graph->mutex);
+            continue;
+        }
+
+        size_t index = takeReadyJob(graph);
+        graph->running++;
+        pthread_mutex_unlock(&graph->mutex);
+
+        graph->job(graph->data, index, worker->index);
+
+        pthread_mutex_lock(&graph->mutex);
+        graph->running--;
+
+        for (size_t i = graph->nextStart[index]; i < graph->nextStart[index + 1]; i++) {
+            if (--graph->waiting[graph->next[i]] == 0) {
+                graph->ready[graph->readyCount++] = graph->next[i];
+            }
+        }
+
+        pthread_cond_broadcast(&graph->changed);
+    }
+
+    pthread_mutex_unlock(&graph->mutex);
+    return NULL;
+}
+
+
+void LC3_RunJobGraph(size_t count, size_t workerCount, LC3_Job job, void *data, const uint64_t *costs, const size_t *depStart, const size_t *deps) {
+    size_t edgeCount = depStart[count];
+    size_t *waiting = vaMalloc("Worker", (count + 1) * sizeof(size_t));
+    size_t *nextStart = vaMalloc("Worker", (count + 2) * sizeof(size_t));
+    size_t *next = vaMalloc("Worker", (edgeCount + 1) * sizeof(size_t));
+    size_t *ready = vaMalloc("Worker", (count + 1) * sizeof(size_t));
+    GraphWorker *workers = vaMalloc("Worker", (workerCount + 1) * sizeof(GraphWorker));
+
+    // Reverse the edges, counting first so every job gets a contiguous range
+    memset(nextStart, 0, (count + 2) * sizeof(size_t));
+
+    for (size_t i = 0; i < edgeCount; i++) {
+        nextStart[deps[i] + 2]++;
+    }
+
+    for (size_t i = 2; i < count + 2; i++) {
+        nextStart[i] += nextStart[i - 1];
+    }
+
+    JobGraph graph = {
+        .job        = job,
+        .data       = data,
+        .costs      = costs,
+        .waiting    = waiting,
+        .nextStart  = nextStart,
+        .next       = next,
+        .ready      = ready,
+        .readyCount = 0,
+        .running    = 0,
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        waiting[i] = depStart[i + 1] - depStart[i];
+
+        for (size_t d = depStart[i]; d < depStart[i + 1]; d++) {
+            next[nextStart[deps[d] + 1]++] = i;
+        }
+
+        if (waiting[i] == 0) {
+            ready[graph.readyCount++] = i;
+        }
+    }
+
+    pthread_mutex_init(&graph.mutex, NULL);
+    pthread_cond_init(&graph.changed, NULL);
+
+    if (workerCount > count) {
+        workerCount = count;
+    }
+
+    if (workerCount < 1) {
+        workerCount = 1;
+    }
+
+    // The calling thread is worker 0
+    for (size_t i = 0; i < workerCount; i++) {
+        workers[i] = (GraphWorker){.graph = &graph, .index = i};
+
+        if (i > 0) {
+            pthread_create(&workers[i].thread, NULL, runGraphWorker, &workers[i]);
+        }
+    }
+
+    runGraphWorker(&workers[0]);
+
+    for (size_t i = 1; i < workerCount; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&graph.changed);
+    pthread_mutex_destroy(&graph.mutex);
+    vaFree(workers);
+    vaFree(ready);
+    vaFree(next);
+    vaFree(nextStart);
+    vaFree(waiting);
+}
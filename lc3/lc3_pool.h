@@ -0,0 +1,37 @@
+/* 
+ * Description: 
+ * Small worker pool, runs a job for a range of indices on multiple threads
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Called once for every index, worker is the index of the calling worker (always < workerCount)
+typedef void (*LC3_Job)(void *data, size_t index, size_t worker);
+
+// Time a worker spent running jobs, and waiting for the other workers to finish
+typedef struct LC3_WorkerStats {
+    double busy, idle; // Seconds
+    size_t jobs;
+    size_t stolen;     // Jobs taken from another worker
+} LC3_WorkerStats;
+
+
+// Amount of online processors, at least 1
+size_t LC3_ProcessorCount();
+
+// Monotonic clock in seconds, for measuring how long something took
+double LC3_Seconds();
+
+// Runs job for every index in [0, count) on workerCount threads (including the calling thread), returns when all are done
+void LC3_RunJobs(size_t count, size_t workerCount, LC3_Job job, void *data);
+
+// Like LC3_RunJobs, but starts the jobs with the highest cost first (costs may be NULL) and lets workers that run out of
+// jobs steal them from the others. Fills stats for every worker that was used if not NULL, and returns how many were used
+size_t LC3_RunWeightedJobs(size_t count, size_t workerCount, LC3_Job job, void *data, const uint64_t *costs, LC3_WorkerStats *stats);
+
+// Like LC3_RunWeightedJobs, but a job only starts once all of its dependencies are done. The dependencies of job i are
+// deps[depStart[i]] up to deps[depStart[i + 1]]. Ready jobs with the highest cost are started first, jobs in a cycle never run
+void LC3_RunJobGraph(size_t count, size_t workerCount, LC3_Job job, void *data, const uint64_t *costs, const size_t *depStart, const size_t *deps);
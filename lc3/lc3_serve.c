@@ -0,0 +1,520 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_serve.h"
+#include "lc3_cache.h"
+#include "lc3_cmd.h"
+#include "lc3_pool.h"
+#include "lib/va_alloc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Request: magic, argument count, payload size, then the working directory and every argument, null-terminated.
+// Reply: magic, exit status, output size, output
+#define REQUEST_MAGIC "LC3Q"
+#define REPLY_MAGIC   "LC3R"
+#define REQUEST_MAX   (1 << 20)
+#define REQUEST_HEAD  (12)
+#define REPLY_HEAD    (16)
+
+// Objects of every assembled source are kept, until they take up this much memory
+#define SERVER_CACHE_LIMIT (256 << 20)
+
+// Clients that stop sending or reading for this long are dropped, the others are served in the meantime
+#define CLIENT_TIMEOUT (10)
+#define CLIENT_MAX     (64)
+
+
+typedef struct Server {
+    char *cwd;
+    size_t requests;
+    double total, slowest; // Seconds
+} Server;
+
+
+// Connection that is read until its request is complete, then written until its reply is sent
+typedef struct Client {
+    int fd;
+    double active;           // Last time anything was read or written
+    char head[REQUEST_HEAD]; // Magic, argument count and payload size
+    char *payload;
+    size_t received, size;   // Of head and payload, the size is known once the head is complete
+    FILE *reply;             // Reply head and output, once the request has run
+    size_t replySize, sent;
+} Client;
+
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig) {
+    stopping = 1;
+}
+
+
+static bool readAll(int fd, void *data, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t count = read(fd, (char *)data + done, size - done);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            return false;
+        }
+
+        done += count;
+    }
+
+    return true;
+}
+
+
+static bool writeAll(int fd, const void *data, size_t size) {
+    for (size_t done = 0; done < size;) {
+        ssize_t count = write(fd, (const char *)data + done, size - done);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            return false;
+        }
+
+        done += count;
+    }
+
+    return true;
+}
+
+
+static char *currentDirectory() {
+    size_t size = 256;
+    char *cwd = vaMalloc("LC3_Serve", size);
+
+    while (getcwd(cwd, size) == NULL && errno == ERANGE) {
+        size *= 2;
+        cwd = vaRealloc("LC3_Serve", cwd, size);
+    }
+
+    return cwd;
+}
+
+
+static bool socketAddress(const char *socketPath, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(socketPath) >= sizeof(addr->sun_path)) {
+        printf("\x1b[1;31mfatal error:\x1b[0m socket path %s is too long\nassembly terminated.\n", socketPath);
+        return false;
+    }
+
+    strcpy(addr->sun_path, socketPath);
+    return true;
+}
+
+
+// A socket left behind by a server that is gone is replaced, one that still accepts connections is not
+static int listenOn(const char *socketPath) {
+    struct sockaddr_un addr;
+    struct stat info;
+
+    if (!socketAddress(socketPath, &addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m a server is already listening on %s\nassembly terminated.\n", socketPath);
+        close(fd);
+        return -1;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (stat(socketPath, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(socketPath);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m failed to listen on %s\nassembly terminated.\n", socketPath);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    return fd;
+}
+
+
+// Options that would keep the server busy or change it for all following requests
+static const char *rejectedOption(int argc, char **argv) {
+    static const char *rejected[] = {"--serve", "--connect", "--watch", "--lsp", "--mem-report"};
+
+    for (int i = 1; i < argc; i++) {
+        for (size_t j = 0; j < sizeof(rejected) / sizeof(rejected[0]); j++) {
+            size_t len = strlen(rejected[j]);
+
+            if (strncmp(argv[i], rejected[j], len) == 0 && (argv[i][len] == '\0' || argv[i][len] == '=')) {
+                return rejected[j];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+// Runs a command line in the working directory of the client, with its output written to capture
+static int runCommand(Server *server, int argc, char **argv, const char *cwd, int capture) {
+    const char *option = rejectedOption(argc, argv);
+    int status = 1;
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(capture, STDOUT_FILENO);
+
+    if (option != NULL) {
+        printf("\x1b[1;31mfatal error:\x1b[0m '%s' can not be used through a server\nassembly terminated.\n", option);
+    } else if (chdir(cwd) != 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m failed to change to directory %s\nassembly terminated.\n", cwd);
+    } else {
+        status = LC3_AssemblyCommand(argc, argv);
+    }
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    if (chdir(server->cwd) != 0) {
+        printf("\x1b[1;31merror:\x1b[0m failed to change back to directory %s\n", server->cwd);
+    }
+
+    return status;
+}
+
+
+static void logRequest(Server *server, int argc, char **argv, const char *cwd, int status, double elapsed, const LC3_MemoryCacheStats *before) {
+    LC3_MemoryCacheStats after;
+    LC3_GetMemoryCacheStats(&after);
+
+    size_t hits = after.hits - before->hits, lookups = hits + after.misses - before->misses;
+
+    server->requests++;
+    server->total += elapsed;
+    server->slowest = (elapsed > server->slowest) ? elapsed : server->slowest;
+
+    printf("#%zu %.3f ms, status %d, %zu/%zu units from memory, in %s:", server->requests, elapsed * 1e3, status, hits, lookups, cwd);
+
+    for (int i = 1; i < argc; i++) {
+        printf(" %s", argv[i]);
+    }
+
+    printf("\n");
+    fflush(stdout);
+}
+
+
+// Reads what has arrived of the request without blocking, returns false if the client is dropped
+static bool readRequest(Client *client) {
+    while (client->received < client->size) {
+        bool head = (client->received < REQUEST_HEAD);
+        char *dest = head ? client->head + client->received : client->payload + (client->received - REQUEST_HEAD);
+        ssize_t count = read(client->fd, dest, (head ? REQUEST_HEAD : client->size) - client->received);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else if (count <= 0) {
+            return false;
+        }
+
+        client->received += count;
+
+        // The payload size is known once the head is complete
+        if (client->received == REQUEST_HEAD) {
+            uint32_t header[2];
+            memcpy(header, client->head + 4, sizeof(header));
+
+            if (memcmp(client->head, REQUEST_MAGIC, 4) != 0 || header[1] == 0 || header[1] > REQUEST_MAX || header[0] > header[1]) {
+                return false;
+            }
+
+            client->payload = vaMalloc("LC3_Serve", header[1]);
+            client->size = REQUEST_HEAD + header[1];
+        }
+    }
+
+    return true;
+}
+
+
+// Writes what fits of the reply without blocking, returns false if the client is dropped
+static bool writeReply(Client *client) {
+    char chunk[4096];
+
+    while (client->sent < client->replySize) {
+        size_t size = (client->replySize - client->sent < sizeof(chunk)) ? client->replySize - client->sent : sizeof(chunk);
+        ssize_t count = pread(fileno(client->reply), chunk, size, client->sent);
+
+        if (count <= 0) {
+            return false;
+        }
+
+        count = write(client->fd, chunk, count);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else if (count <= 0) {
+            return false;
+        }
+
+        client->sent += count;
+    }
+
+    return true;
+}
+
+
+// Runs a complete request, its output and exit status become the reply. Malformed requests are dropped without a reply
+static bool runRequest(Server *server, Client *client) {
+    double start = LC3_Seconds();
+    uint32_t header[2];
+    memcpy(header, client->head + 4, sizeof(header));
+
+    char *payload = client->payload;
+    char **argv = vaMalloc("LC3_Serve", (header[0] + 2) * sizeof(char *));
+    int argc = 1;
+    bool valid = (payload[header[1] - 1] == '\0');
+
+    // The working directory comes first, the program name is not sent
+    if (valid) {
+        size_t pos = strlen(payload) + 1;
+
+        for (argv[0] = "lc3a"; pos < header[1] && argc <= (int)header[0]; pos += strlen(payload + pos) + 1) {
+            argv[argc++] = payload + pos;
+        }
+
+        argv[argc] = NULL;
+        valid = (argc == (int)header[0] + 1 && pos == header[1]);
+    }
+
+    // Output goes after room for the reply head, which is filled in once the status is known
+    client->reply = valid ? tmpfile() : NULL;
+    char head[REPLY_HEAD] = {0};
+
+    if (client->reply != NULL && write(fileno(client->reply), head, REPLY_HEAD) == REPLY_HEAD) {
+        LC3_MemoryCacheStats before;
+        LC3_GetMemoryCacheStats(&before);
+
+        int32_t status = runCommand(server, argc, argv, payload, fileno(client->reply));
+        off_t end = lseek(fileno(client->reply), 0, SEEK_END);
+        uint64_t outputSize = (end > REPLY_HEAD) ? end - REPLY_HEAD : 0;
+
+        memcpy(head, REPLY_MAGIC, 4);
+        memcpy(head + 4, &status, 4);
+        memcpy(head + 8, &outputSize, 8);
+
+        valid = (pwrite(fileno(client->reply), head, REPLY_HEAD, 0) == REPLY_HEAD);
+        client->replySize = REPLY_HEAD + outputSize;
+        logRequest(server, argc, argv, payload, status, LC3_Seconds() - start, &before);
+    } else {
+        valid = false;
+    }
+
+    vaFree(argv);
+    return valid;
+}
+
+
+static void closeClient(Client *client) {
+    if (client->reply != NULL) {
+        fclose(client->reply);
+    }
+
+    vaFree(client->payload);
+    close(client->fd);
+}
+
+
+int LC3_Serve(const char *socketPath) {
+    int fd = listenOn(socketPath);
+
+    if (fd < 0) {
+        return 1;
+    }
+
+    Server server = {.cwd = currentDirectory()};
+    struct sigaction action = {.sa_handler = stop}, ignore = {.sa_handler = SIG_IGN}, previous[3];
+
+    // Without SA_RESTART, so poll returns once stopped
+    sigemptyset(&action.sa_mask);
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGINT, &action, &previous[0]);
+    sigaction(SIGTERM, &action, &previous[1]);
+    sigaction(SIGPIPE, &ignore, &previous[2]);
+    stopping = 0;
+
+    LC3_KeepCacheInMemory(SERVER_CACHE_LIMIT);
+    printf("listening on %s, press Ctrl-C to stop\n", socketPath);
+    fflush(stdout);
+
+    Client clients[CLIENT_MAX];
+    size_t clientCount = 0;
+
+    // Requests are read and replies written for all clients at once, but requests only run one at a time
+    while (!stopping) {
+        struct pollfd fds[CLIENT_MAX + 1] = {{fd, (clientCount < CLIENT_MAX) ? POLLIN : 0, 0}};
+
+        for (size_t i = 0; i < clientCount; i++) {
+            fds[i + 1] = (struct pollfd){clients[i].fd, (clients[i].reply == NULL) ? POLLIN : POLLOUT, 0};
+        }
+
+        // Wakes up every second to drop clients that stalled
+        if (poll(fds, clientCount + 1, 1000) < 0) {
+            continue;
+        }
+
+        double now = LC3_Seconds();
+
+        // Backwards, so removed clients can be replaced by the last one
+        for (size_t i = clientCount; i-- > 0;) {
+            Client *client = &clients[i];
+            size_t progress = client->received + client->sent;
+            bool keep = true;
+
+            if (fds[i + 1].revents != 0) {
+                keep = (client->reply == NULL) ? readRequest(client) : writeReply(client);
+            }
+
+            if (client->received + client->sent != progress) {
+                client->active = now;
+            }
+
+            // Other clients are checked against the time of the poll, their data may have arrived while this one ran
+            if (keep && client->reply == NULL && client->payload != NULL && client->received == client->size) {
+                keep = runRequest(&server, client) && writeReply(client);
+                client->active = LC3_Seconds();
+            }
+
+            if (!keep || (client->reply != NULL && client->sent == client->replySize) || now - client->active > CLIENT_TIMEOUT) {
+                closeClient(client);
+                clients[i] = clients[--clientCount];
+            }
+        }
+
+        // New connections wait in the backlog while every slot is taken
+        int client = (fds[0].revents & POLLIN) ? accept(fd, NULL, NULL) : -1;
+
+        if (client >= 0 && fcntl(client, F_SETFL, O_NONBLOCK) == 0) {
+            clients[clientCount++] = (Client){.fd = client, .active = LC3_Seconds(), .size = REQUEST_HEAD};
+        } else if (client >= 0) {
+            close(client);
+        }
+    }
+
+    // Clients still connected when the server stops get no reply
+    for (size_t i = 0; i < clientCount; i++) {
+        closeClient(&clients[i]);
+    }
+
+    LC3_MemoryCacheStats stats;
+    LC3_GetMemoryCacheStats(&stats);
+
+    printf("%zu requests", server.requests);
+
+    if (server.requests > 0) {
+        printf(", %.3f ms on average, %.3f ms at most", server.total / server.requests * 1e3, server.slowest * 1e3);
+    }
+
+    printf("\nmemory cache: %zu units in %zu KB, %zu hits, %zu misses\n", stats.entries, stats.bytes / 1024, stats.hits, stats.misses);
+
+    LC3_KeepCacheInMemory(0);
+    sigaction(SIGINT, &previous[0], NULL);
+    sigaction(SIGTERM, &previous[1], NULL);
+    sigaction(SIGPIPE, &previous[2], NULL);
+
+    close(fd);
+    unlink(socketPath);
+    vaFree(server.cwd);
+    return 0;
+}
+
+
+int LC3_Connect(const char *socketPath, int argc, char **argv) {
+    struct sockaddr_un addr;
+
+    if (!socketAddress(socketPath, &addr)) {
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m failed to connect to server %s\nassembly terminated.\n", socketPath);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return 1;
+    }
+
+    char *cwd = currentDirectory();
+    size_t size = strlen(cwd) + 1;
+
+    for (int i = 0; i < argc; i++) {
+        size += strlen(argv[i]) + 1;
+    }
+
+    char *payload = vaMalloc("LC3_Serve", size);
+    uint32_t header[2] = {argc, size};
+    size_t pos = strlen(cwd) + 1;
+
+    memcpy(payload, cwd, pos);
+
+    for (int i = 0; i < argc; i++) {
+        memcpy(payload + pos, argv[i], strlen(argv[i]) + 1);
+        pos += strlen(argv[i]) + 1;
+    }
+
+    char magic[4];
+    int32_t status = 1;
+    uint64_t outputSize = 0;
+    bool received = (size <= REQUEST_MAX) && writeAll(fd, REQUEST_MAGIC, 4) && writeAll(fd, header, sizeof(header)) &&
+        writeAll(fd, payload, size) && readAll(fd, magic, 4) && memcmp(magic, REPLY_MAGIC, 4) == 0 &&
+        readAll(fd, &status, 4) && readAll(fd, &outputSize, 8);
+
+    // Output is passed on as it arrives
+    for (char chunk[4096]; received && outputSize > 0;) {
+        size_t count = (outputSize < sizeof(chunk)) ? outputSize : sizeof(chunk);
+        received = readAll(fd, chunk, count);
+        fwrite(chunk, 1, received ? count : 0, stdout);
+        outputSize -= count;
+    }
+
+    if (!received) {
+        printf("\x1b[1;31mfatal error:\x1b[0m no reply from server %s\nassembly terminated.\n", socketPath);
+        status = 1;
+    }
+
+    close(fd);
+    vaFree(payload);
+    vaFree(cwd);
+    return status;
+}
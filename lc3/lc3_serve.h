@@ -0,0 +1,19 @@
+/*
+ * Description:
+ * Assembler server on a Unix domain socket, and the client that forwards a command line to it.
+ * The server stays running with a warm object cache in memory, so sources that many requests share (like libraries)
+ * are only assembled once, and requests do not pay for starting a process.
+ * Requests run one after another in the server, each in the working directory of its client. Requests are read and
+ * replies written without blocking, so a client that stalls is dropped after a timeout without delaying the others
+ */
+
+#pragma once
+
+
+// Listens on socketPath and runs every request like LC3_AssemblyCommand would, until interrupted (SIGINT or SIGTERM).
+// Prints how long every request took. Returns the exit status of the server
+int LC3_Serve(const char *socketPath);
+
+// Sends the command line argv (without the program name) to the server at socketPath and shows its output.
+// Returns the exit status of the command, or 1 if the server could not be reached
+int LC3_Connect(const char *socketPath, int argc, char **argv);
@@ -0,0 +1,387 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_state.h"
+#include "lc3_str.h"
+#include "lib/va_alloc.h"
+#include <string.h>
+#include <sys/stat.h>
+
+#define STATE_MAGIC "LC3S"
+
+#define FNV_PRIME (0x100000001B3ULL)
+
+
+enum StateFlag {
+    LC3_STATE_DEBUG  = 0x01,
+    LC3_STATE_INDENT = 0x02,
+};
+
+
+static uint16_t stateFlags(const LC3_Context *ctx) {
+    return (ctx->storeDebug ? LC3_STATE_DEBUG : 0) | (ctx->storeIndent ? LC3_STATE_INDENT : 0);
+}
+
+
+uint64_t LC3_HashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+uint64_t LC3_HashFile(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    uint64_t hash = LC3_HASH_INIT;
+    unsigned char chunk[4096];
+    size_t count;
+
+    if (fp == NULL) {
+        return 0;
+    }
+
+    while ((count = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        hash = LC3_HashBytes(hash, chunk, count);
+    }
+
+    fclose(fp);
+    return hash;
+}
+
+
+uint64_t LC3_FileSize(const char *filename) {
+    struct stat info;
+    return (stat(filename, &info) == 0 && info.st_size > 0) ? info.st_size : 0;
+}
+
+
+static void writeName(FILE *fp, LC3_Unit *unit, BufferSegment seg) {
+    char terminator = '\0';
+    fwrite(unit->buf.ptr[seg.line].ptr + seg.tk.start, 1, seg.tk.sz, fp);
+    fwrite(&terminator, 1, 1, fp);
+}
+
+
+void LC3_WriteLinkState(size_t unitCount, LC3_Unit *units, const char *output, const char *stateFile) {
+    FILE *fp = fopen(stateFile, "wb");
+
+    if (fp == NULL) {
+        printf("\x1b[1;31merror:\x1b[0m failed to open file %s\n", stateFile);
+        return;
+    }
+
+    uint16_t flags = (unitCount > 0) ? stateFlags(units[0].ctx) : 0;
+    uint32_t count = unitCount;
+    uint64_t total = 0;
+    uint64_t outputHash = LC3_HashFile(output);
+
+    for (size_t i = 0; i < unitCount; i++) {
+        total += units[i].outputSize;
+    }
+
+    fwrite(STATE_MAGIC, 1, 4, fp);
+    fwrite(&flags, 2, 1, fp);
+    fwrite(&count, 4, 1, fp);
+    fwrite(&total, 8, 1, fp);
+    fwrite(&outputHash, 8, 1, fp);
+
+    for (size_t i = 0; i < unitCount; i++) {
+        LC3_Unit *unit = &units[i];
+        uint64_t header[3] = {LC3_HashFile(unit->filename), unit->outputStart, unit->outputSize};
+        uint32_t counts[2] = {unit->obj.sz, unit->symb.sz};
+
+        fwrite(unit->filename, 1, strlen(unit->filename) + 1, fp);
+        fwrite(header, 8, 3, fp);
+        fwrite(counts, 4, 2, fp);
+
+        for (size_t s = 0; s < unit->symb.sz; s++) {
+            uint16_t value = unit->symb.ptr[s].value;
+            fwrite(&value, 2, 1, fp);
+            writeName(fp, unit, unit->symb.ptr[s].loc);
+        }
+
+        // Relocation sites are stored without their label bits, so they can be resolved again
+        for (size_t s = 0; s < unit->obj.sz; s++) {
+            ObjectSection *section = &unit->obj.ptr[s];
+            uint16_t size = section->words.sz;
+            uint64_t offset = section->offset;
+            uint32_t relocCount = section->reloc.sz;
+
+            fwrite(&section->origin, 2, 1, fp);
+            fwrite(&size, 2, 1, fp);
+            fwrite(&offset, 8, 1, fp);
+            fwrite(&relocCount, 4, 1, fp);
+
+            for (size_t r = 0; r < section->reloc.sz; r++) {
+                Relocation *reloc = &section->reloc.ptr[r];
+                uint16_t base = section->words.ptr[reloc->index] & ~relocationMask(reloc->kind);
+                uint8_t kind = reloc->kind;
+
+                fwrite(&reloc->index, 2, 1, fp);
+                fwrite(&kind, 1, 1, fp);
+                fwrite(&base, 2, 1, fp);
+                fwrite(&reloc->value, 2, 1, fp);
+                writeName(fp, unit, reloc->label);
+            }
+        }
+    }
+
+    fclose(fp);
+}
+
+
+// Reads a null-terminated string, returns false on failure
+static bool readName(FILE *fp, String *str) {
+    int c;
+
+    while ((c = fgetc(fp)) != EOF && c != '\0') {
+        addchar(str, c);
+    }
+
+    return (c == '\0');
+}
+
+
+// Adds a name from the state file to the unit buffer as its own line
+static bool readLine(FILE *fp, LC3_Unit *unit, BufferSegment *seg) {
+    String line = newString();
+
+    if (!readName(fp, &line)) {
+        vaFree(line.ptr);
+        return false;
+    }
+
+    seg->unit  = unit;
+    seg->line  = unit->buf.sz;
+    seg->tk.start = 0;
+    seg->tk.sz = line.sz;
+
+    addString(&unit->buf, line);
+    return true;
+}
+
+
+// Restores a unit from the state file, sections only contain the words at relocation sites
+static bool readUnitState(FILE *fp, LC3_Unit *unit, uint64_t *hash, WordArray *previous) {
+    uint64_t header[3];
+    uint32_t counts[2];
+
+    if (fread(header, 8, 3, fp) != 3 || fread(counts, 4, 2, fp) != 2) {
+        return false;
+    }
+
+    (*hash) = header[0];
+    unit->outputStart = header[1];
+    unit->outputSize  = header[2];
+
+    for (uint32_t i = 0; i < counts[1]; i++) {
+        uint16_t value;
+        BufferSegment seg;
+
+        if (fread(&value, 2, 1, fp) != 1 || !readLine(fp, unit, &seg)) {
+            return false;
+        }
+
+        addSymbol(unit, seg.line, seg.tk, unit->buf.ptr[seg.line], value);
+    }
+
+    for (uint32_t i = 0; i < counts[0]; i++) {
+        uint16_t origin, size;
+        uint64_t offset;
+        uint32_t relocCount;
+
+        if (fread(&origin, 2, 1, fp) != 1 || fread(&size, 2, 1, fp) != 1 ||
+            fread(&offset, 8, 1, fp) != 1 || fread(&relocCount, 4, 1, fp) != 1 || relocCount > size) {
+            return false;
+        }
+
+        addObjectSection(&unit->obj, newObjectSection(size, relocCount, 0));
+        ObjectSection *section = &unit->obj.ptr[unit->obj.sz - 1];
+        section->origin = origin;
+        section->offset = offset;
+        section->words.sz = size;
+        memset(section->words.ptr, 0, size * sizeof(uint16_t));
+
+        for (uint32_t r = 0; r < relocCount; r++) {
+            Relocation reloc = {0};
+            uint8_t kind;
+
+            if (fread(&reloc.index, 2, 1, fp) != 1 || fread(&kind, 1, 1, fp) != 1 || reloc.index >= size ||
+                fread(&section->words.ptr[reloc.index], 2, 1, fp) != 1 ||
+                fread(&reloc.value, 2, 1, fp) != 1 || !readLine(fp, unit, &reloc.label)) {
+                return false;
+            }
+
+            reloc.kind = kind;
+            addRelocation(&section->reloc, reloc);
+            addWord(previous, reloc.value);
+        }
+    }
+
+    return true;
+}
+
+
+// Changed units can only replace their old bytes if they keep the same layout
+static bool sameLayout(LC3_Unit *old, LC3_Unit *unit, bool header) {
+    if (old->obj.sz != unit->obj.sz || LC3_ExecutableSize(unit, header) != old->outputSize) {
+        return false;
+    }
+
+    for (size_t i = 0; i < unit->obj.sz; i++) {
+        if (old->obj.ptr[i].origin != unit->obj.ptr[i].origin || old->obj.ptr[i].words.sz != unit->obj.ptr[i].words.sz) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Rewrites changed units in place, and patches relocation sites of unchanged units that now resolve differently
+static void patchExecutable(size_t unitCount, LC3_Unit *units, const bool *changed, WordArray *previous, const char *output) {
+    FILE *fp = fopen(output, "r+b");
+
+    for (size_t i = 0; i < unitCount; i++) {
+        if (changed[i]) {
+            fseek(fp, units[i].outputStart, SEEK_SET);
+            LC3_WriteExecutableUnit(&units[i], fp, (i == 0));
+            continue;
+        }
+
+        size_t site = 0;
+
+        for (size_t s = 0; s < units[i].obj.sz; s++) {
+            ObjectSection *section = &units[i].obj.ptr[s];
+
+            for (size_t r = 0; r < section->reloc.sz; r++, site++) {
+                Relocation *reloc = &section->reloc.ptr[r];
+
+                if (reloc->value != previous[i].ptr[site]) {
+                    fseek(fp, section->offset + 2 * reloc->index, SEEK_SET);
+                    fwrite(&section->words.ptr[reloc->index], 2, 1, fp);
+                }
+            }
+        }
+    }
+
+    fclose(fp);
+}
+
+
+LC3_RelinkResult LC3_Relink(LC3_Context *ctx, size_t unitCount, const char **inputs, const char *output, const char *stateFile) {
+    FILE *fp = fopen(stateFile, "rb");
+
+    if (fp == NULL) {
+        return LC3_RELINK_UNAVAILABLE;
+    }
+
+    char magic[4];
+    uint16_t flags = 0;
+    uint32_t count = 0;
+    uint64_t total = 0, outputHash = 0;
+
+    // The output has to be exactly the one that was written with the state, not rebuilt or edited since
+    if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, STATE_MAGIC, 4) != 0 ||
+        fread(&flags, 2, 1, fp) != 1 || fread(&count, 4, 1, fp) != 1 || fread(&total, 8, 1, fp) != 1 ||
+        fread(&outputHash, 8, 1, fp) != 1 || flags != stateFlags(ctx) || count != unitCount ||
+        LC3_FileSize(output) != total || LC3_HashFile(output) != outputHash) {
+        fclose(fp);
+        return LC3_RELINK_UNAVAILABLE;
+    }
+
+    LC3_Unit *units = vaMalloc("LC3_Unit", unitCount * sizeof(LC3_Unit));
+    LC3_Unit *old = vaMalloc("LC3_Unit", unitCount * sizeof(LC3_Unit));
+    WordArray *previous = vaMalloc("WordArray", unitCount * sizeof(WordArray));
+    bool *changed = vaMalloc("bool", unitCount * sizeof(bool));
+    size_t *changedList = vaMalloc("size_t", unitCount * sizeof(size_t));
+    size_t changedCount = 0, loaded = 0;
+    LC3_RelinkResult result = LC3_RELINK_UNAVAILABLE;
+
+    // Inputs have to be the same files in the same order
+    for (size_t i = 0; i < unitCount; i++) {
+        String name = newString();
+        uint64_t hash = 0;
+
+        units[i] = LC3_CreateUnit(ctx, inputs[i]);
+        previous[i] = newWordArray(VA_BASE_CAP);
+        loaded = i + 1;
+
+        bool valid = readName(fp, &name) && strcmp(name.ptr, inputs[i]) == 0 &&
+            readUnitState(fp, &units[i], &hash, &previous[i]);
+
+        vaFree(name.ptr);
+
+        if (!valid) {
+            fclose(fp);
+            goto cleanup;
+        }
+
+        changed[i] = (LC3_HashFile(inputs[i]) != hash);
+
+        if (changed[i]) {
+            changedList[changedCount++] = i;
+        }
+    }
+
+    fclose(fp);
+
+    if (changedCount == 0) {
+        result = LC3_RELINK_DONE;
+        goto cleanup;
+    }
+
+    // Changed units are assembled from scratch, their restored versions are kept to compare layouts
+    for (size_t i = 0; i < changedCount; i++) {
+        LC3_Unit *unit = &units[changedList[i]];
+
+        old[i] = (*unit);
+        (*unit) = LC3_CreateUnit(ctx, unit->filename);
+        unit->outputStart = old[i].outputStart;
+        unit->outputSize  = old[i].outputSize;
+    }
+
+    LC3_AssembleSelected(units, changedList, changedCount);
+
+    bool layout = true;
+
+    for (size_t i = 0; i < changedCount; i++) {
+        layout = layout && sameLayout(&old[i], &units[changedList[i]], (changedList[i] == 0));
+        LC3_DestroyUnit(old[i]);
+    }
+
+    if (ctx->error) {
+        result = LC3_RELINK_FAILED;
+        goto cleanup;
+    }
+
+    if (!layout) {
+        goto cleanup;
+    }
+
+    LC3_LinkUnits(unitCount, units);
+
+    if (ctx->error) {
+        result = LC3_RELINK_FAILED;
+        goto cleanup;
+    }
+
+    patchExecutable(unitCount, units, changed, previous, output);
+    LC3_WriteLinkState(unitCount, units, output, stateFile);
+    result = LC3_RELINK_DONE;
+
+cleanup:
+    for (size_t i = 0; i < loaded; i++) {
+        LC3_DestroyUnit(units[i]);
+        vaFree(previous[i].ptr);
+    }
+
+    vaFree(changedList);
+    vaFree(changed);
+    vaFree(previous);
+    vaFree(old);
+    vaFree(units);
+    return result;
+}
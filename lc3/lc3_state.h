@@ -0,0 +1,33 @@
+/*
+ * Description:
+ * Incremental relinking, only reassembles inputs that changed since the previous link
+ */
+
+#pragma once
+#include "lc3_asm.h"
+
+
+typedef enum LC3_RelinkResult {
+    LC3_RELINK_DONE,        // Executable is up to date
+    LC3_RELINK_FAILED,      // Changed inputs contain errors, these have been shown
+    LC3_RELINK_UNAVAILABLE, // Previous state can not be reused, a full link is needed
+} LC3_RelinkResult;
+
+
+// Reassembles changed inputs and patches them into output, using the state saved by LC3_WriteLinkState
+LC3_RelinkResult LC3_Relink(LC3_Context *ctx, size_t unitCount, const char **inputs, const char *output, const char *stateFile);
+
+// Start value for LC3_HashBytes
+#define LC3_HASH_INIT (0xCBF29CE484222325ULL)
+
+// Continues the 64-bit FNV-1a hash with size bytes of data
+uint64_t LC3_HashBytes(uint64_t hash, const void *data, size_t size);
+
+// FNV-1a hash of the file contents, 0 if it can not be read
+uint64_t LC3_HashFile(const char *filename);
+
+// Size of the file in bytes, 0 if it can not be found
+uint64_t LC3_FileSize(const char *filename);
+
+// Saves the state of linked units, must be called directly after they are written as executable output
+void LC3_WriteLinkState(size_t unitCount, LC3_Unit *units, const char *output, const char *stateFile);
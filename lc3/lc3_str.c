@@ -0,0 +1,79 @@
+#include "lc3_str.h"
+#include "lib/va_alloc.h"
+#include <ctype.h>
+#include <string.h>
+
+
+// Terminal colors are "\x1b[" up to a letter. If one starts at i, moves i to its letter and returns true
+static bool skipColor(const char *text, size_t len, size_t *i) {
+    if (text[*i] != '\x1b' || *i + 1 >= len || text[*i + 1] != '[') {
+        return false;
+    }
+
+    for ((*i) += 2; *i < len && !isalpha((unsigned char)text[*i]); (*i)++);
+    return true;
+}
+
+
+// Index after the last character of text that is not a newline or part of a terminal color
+static size_t plainEnd(const char *text, size_t len) {
+    size_t end = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (!skipColor(text, len, &i) && text[i] != '\n') {
+            end = i + 1;
+        }
+    }
+
+    return end;
+}
+
+
+char *copyText(const char *tag, const char *text, size_t len) {
+    char *ret = vaMalloc(tag, len + 1);
+    memcpy(ret, text, len);
+    ret[len] = '\0';
+    return ret;
+}
+
+
+char *copyWord(const char *tag, const char *word) {
+    return copyText(tag, word, strlen(word));
+}
+
+
+char *copyPlainText(const char *tag, const char *text) {
+    size_t len = strlen(text), end = plainEnd(text, len), size = 0;
+    char *ret = vaMalloc(tag, end + 1);
+
+    for (size_t i = 0; i < end; i++) {
+        if (!skipColor(text, len, &i)) {
+            ret[size++] = text[i];
+        }
+    }
+
+    ret[size] = '\0';
+    return ret;
+}
+
+
+void writeJsonString(FILE *fp, const char *str) {
+    size_t len = strlen(str);
+    size_t end = plainEnd(str, len);
+
+    putc('"', fp);
+
+    for (size_t i = 0; i < end; i++) {
+        if (skipColor(str, len, &i)) {
+            continue;
+        } else if (str[i] == '"' || str[i] == '\\') {
+            fprintf(fp, "\\%c", str[i]);
+        } else if ((unsigned char)str[i] < 0x20) {
+            fprintf(fp, "\\u%04x", str[i]);
+        } else {
+            putc(str[i], fp);
+        }
+    }
+
+    putc('"', fp);
+}
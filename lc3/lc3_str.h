@@ -10,6 +10,7 @@
  */
 
 #pragma once
+#include <stdio.h>
 #include "lib/va_template.h"
 
 // String-related stuff
@@ -19,3 +20,21 @@ vaTypedef(String, StringArray);
 // String functions
 vaAllocFunctionDefine(String, newString);
 vaAppendFunctionDefine(String, char, addchar);
+vaClearFunctionDefine(String, clearString);
+
+// String array functions
+vaAllocFunctionDefine(StringArray, newStringArray);
+vaAppendFunctionDefine(StringArray, String, addString);
+vaReserveFunctionDefine(StringArray, reserveStringArray);
+
+// Copies len characters of text into a null-terminated string, allocated under tag
+char *copyText(const char *tag, const char *text, size_t len);
+
+// Copies a null-terminated word, allocated under tag
+char *copyWord(const char *tag, const char *word);
+
+// Copies text without terminal colors and trailing newlines, allocated under tag
+char *copyPlainText(const char *tag, const char *text);
+
+// Writes str as a JSON string, leaving out terminal colors and trailing newlines
+void writeJsonString(FILE *fp, const char *str);
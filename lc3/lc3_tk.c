@@ -30,7 +30,7 @@ bool isTokenChar(char c) {
         true , true , true , true , true , true , true , true , true , true , true , true , true , true , true , true , 
     };
 
-    return VALID_CHAR_MAP[(int)c];
+    return VALID_CHAR_MAP[(unsigned char)c];
 }
 
 
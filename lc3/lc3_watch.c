@@ -0,0 +1,300 @@
+#define _POSIX_C_SOURCE 200809L
+#include "lc3_watch.h"
+#include "lc3_err.h"
+#include "lc3_pool.h"
+#include "lib/va_alloc.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// A file has new contents once it is written and closed, or when another file is renamed over it
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+
+typedef struct Watch {
+    LC3_Context *ctx;
+    LC3_Unit *units;
+    size_t unitCount;
+    const char *output;
+    bool *broken;        // Failed to assemble, left out until its input changes again
+    bool *changed;
+    size_t *changedList;
+    int *dirs;           // Watch descriptor of the directory of every input
+    char **names;        // Name of every input within its directory
+    SymbolTable symbols; // Symbols of all units that assembled, kept sorted between links
+} Watch;
+
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int sig) {
+    interrupted = 1;
+}
+
+
+// Inputs are matched by name in the events of their directory, editors often save by replacing the file
+static int watchDirectory(int fd, const char *path, char **name) {
+    const char *slash = strrchr(path, '/');
+    size_t len = (slash == NULL || slash == path) ? 1 : (size_t)(slash - path);
+    char *dir = vaMalloc("LC3_Watch", len + 1);
+
+    memcpy(dir, (slash == NULL) ? "." : path, len);
+    dir[len] = '\0';
+
+    int wd = inotify_add_watch(fd, dir, WATCH_EVENTS);
+
+    if (wd < 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m failed to watch directory %s\nassembly terminated.\n", dir);
+    }
+
+    const char *base = (slash == NULL) ? path : slash + 1;
+    (*name) = vaMalloc("LC3_Watch", strlen(base) + 1);
+    memcpy(*name, base, strlen(base) + 1);
+
+    vaFree(dir);
+    return wd;
+}
+
+
+// Clears the relocation sites of a linked unit, linking combines them with the label address instead of replacing it
+static void unlinkUnit(LC3_Unit *unit) {
+    for (size_t section = 0; section < unit->obj.sz; section++) {
+        ObjectSection *current = &unit->obj.ptr[section];
+
+        for (size_t i = 0; i < current->reloc.sz; i++) {
+            current->words.ptr[current->reloc.ptr[i].index] &= ~relocationMask(current->reloc.ptr[i].kind);
+        }
+    }
+
+    unit->error = false;
+}
+
+
+// Sorting the symbols of all units takes longer than anything else when relinking after a small change. Instead, the
+// symbols of changed units are removed and their new ones, sorted by objectify, are merged in
+static void updateSymbols(Watch *watch, size_t changedCount) {
+    SymbolTable *symbols = &watch->symbols;
+    SymbolTable added = newSymbolTable();
+    size_t kept = 0;
+
+    for (size_t i = 0; i < symbols->sz; i++) {
+        if (!watch->changed[symbols->ptr[i].loc.unit - watch->units]) {
+            symbols->ptr[kept++] = symbols->ptr[i];
+        }
+    }
+
+    for (size_t i = 0; i < changedCount; i++) {
+        LC3_Unit *unit = &watch->units[watch->changedList[i]];
+
+        for (size_t j = 0; !unit->error && j < unit->symb.sz; j++) {
+            addSymbolHelper(&added, unit->symb.ptr[j]);
+        }
+    }
+
+    // Symbols of a single unit are sorted already
+    if (changedCount > 1) {
+        sortSymbolTable(&added);
+    }
+
+    mergeSymbolTable(symbols, kept, &added);
+    vaFree(added.ptr);
+}
+
+
+// Assembles the changed units again and links them with the others, returns false if there were errors
+static bool rebuild(Watch *watch, size_t changedCount) {
+    LC3_Context *ctx = watch->ctx;
+    size_t brokenCount = 0;
+
+    ctx->error = false;
+
+    for (size_t i = 0; i < changedCount; i++) {
+        LC3_Unit *unit = &watch->units[watch->changedList[i]];
+        const char *filename = unit->filename;
+
+        LC3_DestroyUnit(*unit);
+        (*unit) = LC3_CreateUnit(ctx, filename);
+    }
+
+    if (changedCount == watch->unitCount) {
+        LC3_AssembleUnits(watch->unitCount, watch->units);
+    } else {
+        LC3_AssembleSelected(watch->units, watch->changedList, changedCount);
+    }
+
+    for (size_t i = 0; i < watch->unitCount; i++) {
+        if (watch->changed[i]) {
+            watch->broken[i] = watch->units[i].error;
+        } else if (watch->broken[i]) {
+            printf("\x1b[1;31merror:\x1b[0m %s still contains errors\n", watch->units[i].filename);
+        } else {
+            unlinkUnit(&watch->units[i]);
+        }
+
+        brokenCount += watch->broken[i];
+    }
+
+    updateSymbols(watch, changedCount);
+
+    if (brokenCount > 0) {
+        return false;
+    }
+
+    LC3_LinkSortedUnits(watch->unitCount, watch->units, &watch->symbols);
+
+    if (!ctx->error) {
+        LC3_WriteExecutable(watch->unitCount, watch->units, watch->output);
+    }
+
+    return !ctx->error;
+}
+
+
+// Blocks until an input changed, then collects all events that are already queued as well.
+// Returns the number of changed inputs and when the first was noticed, or 0 once interrupted
+static size_t waitForChanges(Watch *watch, int fd, double *noticed) {
+    uint64_t events[512]; // Aligned for struct inotify_event
+    size_t changedCount = 0;
+
+    memset(watch->changed, 0, watch->unitCount * sizeof(bool));
+
+    while (!interrupted) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, (changedCount == 0) ? -1 : 0);
+
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        } else if (ready <= 0) {
+            break;
+        }
+
+        ssize_t len = read(fd, events, sizeof(events));
+
+        if (len <= 0) {
+            continue;
+        }
+
+        if (changedCount == 0) {
+            (*noticed) = LC3_Seconds();
+        }
+
+        for (char *ptr = (char *)events; ptr < (char *)events + len;) {
+            const struct inotify_event *event = (const struct inotify_event *)ptr;
+
+            for (size_t i = 0; i < watch->unitCount; i++) {
+                bool match = (event->mask & IN_Q_OVERFLOW) ||
+                    (event->wd == watch->dirs[i] && event->len > 0 && strcmp(event->name, watch->names[i]) == 0);
+
+                if (match && !watch->changed[i]) {
+                    watch->changed[i] = true;
+                    watch->changedList[changedCount++] = i;
+                }
+            }
+
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return interrupted ? 0 : changedCount;
+}
+
+
+static void printStatus(const Watch *watch, size_t changedCount, bool ok, double elapsed) {
+    const char *first = watch->units[watch->changedList[0]].filename;
+
+    if (changedCount == watch->unitCount) {
+        printf("\x1b[1m%zu files\x1b[0m assembled: ", changedCount);
+    } else if (changedCount > 1) {
+        printf("\x1b[1m%s\x1b[0m and %zu more changed: ", first, changedCount - 1);
+    } else {
+        printf("\x1b[1m%s\x1b[0m changed: ", first);
+    }
+
+    if (ok) {
+        printf("wrote %s in %.3f ms\n", watch->output, elapsed * 1e3);
+    } else {
+        printf("\x1b[1;31mfailed\x1b[0m after %.3f ms\n", elapsed * 1e3);
+    }
+
+    // Output is usually followed by a tool reading the log
+    fflush(stdout);
+}
+
+
+bool LC3_Watch(LC3_Context *ctx, size_t inputCount, const char **inputs, const char *output) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0) {
+        printf("\x1b[1;31mfatal error:\x1b[0m failed to start watching files\nassembly terminated.\n");
+        return false;
+    }
+
+    Watch watch = {
+        .ctx         = ctx,
+        .units       = vaMalloc("LC3_Unit", inputCount * sizeof(LC3_Unit)),
+        .unitCount   = inputCount,
+        .output      = output,
+        .broken      = vaMalloc("LC3_Watch", inputCount * sizeof(bool)),
+        .changed     = vaMalloc("LC3_Watch", inputCount * sizeof(bool)),
+        .changedList = vaMalloc("LC3_Watch", inputCount * sizeof(size_t)),
+        .dirs        = vaMalloc("LC3_Watch", inputCount * sizeof(int)),
+        .names       = vaMalloc("LC3_Watch", inputCount * sizeof(char *)),
+        .symbols     = newSymbolTable(),
+    };
+
+    bool watching = true;
+
+    for (size_t i = 0; i < inputCount; i++) {
+        watch.units[i] = LC3_CreateUnit(ctx, inputs[i]);
+        watch.broken[i] = false;
+        watch.changed[i] = true;
+        watch.changedList[i] = i;
+        watch.names[i] = NULL;
+        watch.dirs[i] = watching ? watchDirectory(fd, inputs[i], &watch.names[i]) : -1;
+        watching = (watch.dirs[i] >= 0);
+    }
+
+    if (watching) {
+        struct sigaction action = {.sa_handler = interrupt}, previous;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, &previous);
+        interrupted = 0;
+
+        // Every changed unit is assembled, so all of its errors are shown at once
+        ctx->keepGoing = true;
+
+        double start = LC3_Seconds();
+        bool ok = rebuild(&watch, inputCount);
+        size_t changedCount;
+
+        printStatus(&watch, inputCount, ok, LC3_Seconds() - start);
+        printf("watching %zu files for changes, press Ctrl-C to stop\n", inputCount);
+        fflush(stdout);
+
+        while ((changedCount = waitForChanges(&watch, fd, &start)) > 0) {
+            ok = rebuild(&watch, changedCount);
+            printStatus(&watch, changedCount, ok, LC3_Seconds() - start);
+        }
+
+        sigaction(SIGINT, &previous, NULL);
+    }
+
+    for (size_t i = 0; i < inputCount; i++) {
+        LC3_FlushDiagnostics(&watch.units[i]);
+        LC3_DestroyUnit(watch.units[i]);
+        vaFree(watch.names[i]);
+    }
+
+    close(fd);
+    vaFree(watch.symbols.ptr);
+    vaFree(watch.names);
+    vaFree(watch.dirs);
+    vaFree(watch.changedList);
+    vaFree(watch.changed);
+    vaFree(watch.broken);
+    vaFree(watch.units);
+    return watching;
+}
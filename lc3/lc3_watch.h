@@ -0,0 +1,15 @@
+/*
+ * Description:
+ * Watch mode, keeps assembled units in memory and relinks the executable whenever an input is saved.
+ * Only inputs that changed are assembled again, the other units are reused as they are
+ */
+
+#pragma once
+#include "lc3_asm.h"
+
+
+// Assembles and links inputs into output, then rebuilds it on every change of an input until interrupted (SIGINT).
+// Directories of the inputs are watched with inotify, so editors that save by replacing the file are noticed as well.
+// Every changed unit is assembled even after an error (ctx->keepGoing is set).
+// Prints how long every rebuild took from noticing the change. Returns false if the inputs could not be watched
+bool LC3_Watch(LC3_Context *ctx, size_t inputCount, const char **inputs, const char *output);
@@ -0,0 +1,215 @@
+#include "va_alloc.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Statistic with a link to the next one for the same owner
+typedef struct _va_record {
+    vaMemStat stat;
+    struct _va_record *next;
+} _va_record;
+
+
+// All statistics for a single owner
+typedef struct _va_owner {
+    const char *name;
+    _va_record *first;
+    struct _va_owner *next;
+} _va_owner;
+
+
+// Stored in front of every block, 16 bytes to keep the block aligned
+typedef struct _va_header {
+    size_t size;
+    _va_record *record; // NULL if not accounted for
+} _va_header;
+
+
+static pthread_mutex_t _va_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool _va_tracking = false;
+static const char *(*_va_classify)(const char *tag) = NULL;
+
+static _va_owner _va_no_owner = {NULL, NULL, NULL};
+static _va_owner *_va_last_owner = &_va_no_owner;
+static size_t _va_total_current = 0;
+static size_t _va_total_peak = 0;
+
+static __thread _va_owner *_va_thread_owner = &_va_no_owner;
+
+
+// Find or create record for category, mutex must be held
+static _va_record *_va_get_record(const char *tag) {
+    const char *category = _va_classify ? _va_classify(tag) : tag;
+    _va_record **rec;
+
+    for (rec = &_va_thread_owner->first; *rec != NULL; rec = &(*rec)->next) {
+        if ((*rec)->stat.category == category || strcmp((*rec)->stat.category, category) == 0) {
+            return *rec;
+        }
+    }
+
+    (*rec) = calloc(1, sizeof(_va_record));
+    (*rec)->stat.owner = _va_thread_owner->name;
+    (*rec)->stat.category = category;
+    return *rec;
+}
+
+
+// Add size to record, mutex must be held
+static void _va_account(_va_record *rec, size_t sz) {
+    rec->stat.current += sz;
+    _va_total_current += sz;
+
+    if (rec->stat.current > rec->stat.peak) {
+        rec->stat.peak = rec->stat.current;
+    }
+
+    if (_va_total_current > _va_total_peak) {
+        _va_total_peak = _va_total_current;
+    }
+}
+
+
+// Remove size from record, mutex must be held
+static void _va_release(_va_record *rec, size_t sz) {
+    rec->stat.current -= sz;
+    _va_total_current -= sz;
+}
+
+
+void *vaMalloc(const char *tag, size_t sz) {
+    _va_header *hdr = malloc(sizeof(_va_header) + sz);
+
+    if (hdr == NULL) {
+        return NULL;
+    }
+
+    hdr->size = sz;
+    hdr->record = NULL;
+
+    if (_va_tracking) {
+        pthread_mutex_lock(&_va_mutex);
+        hdr->record = _va_get_record(tag);
+        hdr->record->stat.allocs++;
+        _va_account(hdr->record, sz);
+        pthread_mutex_unlock(&_va_mutex);
+    }
+
+    return hdr + 1;
+}
+
+
+void *vaRealloc(const char *tag, void *ptr, size_t sz) {
+    if (ptr == NULL) {
+        return vaMalloc(tag, sz);
+    }
+
+    _va_header *hdr = (_va_header *)ptr - 1;
+    _va_record *old = hdr->record;
+    size_t oldSize = hdr->size;
+
+    hdr = realloc(hdr, sizeof(_va_header) + sz);
+
+    if (hdr == NULL) {
+        return NULL;
+    }
+
+    hdr->size = sz;
+    hdr->record = NULL;
+
+    if (_va_tracking || old != NULL) {
+        pthread_mutex_lock(&_va_mutex);
+
+        if (old != NULL) {
+            _va_release(old, oldSize);
+        }
+
+        if (_va_tracking) {
+            hdr->record = _va_get_record(tag);
+            hdr->record->stat.reallocs++;
+            _va_account(hdr->record, sz);
+        }
+
+        pthread_mutex_unlock(&_va_mutex);
+    }
+
+    return hdr + 1;
+}
+
+
+void vaFree(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+
+    _va_header *hdr = (_va_header *)ptr - 1;
+
+    if (hdr->record != NULL) {
+        pthread_mutex_lock(&_va_mutex);
+        _va_release(hdr->record, hdr->size);
+        hdr->record->stat.frees++;
+        pthread_mutex_unlock(&_va_mutex);
+    }
+
+    free(hdr);
+}
+
+
+void vaMemTrack(bool enable) {
+    _va_tracking = enable;
+}
+
+
+void vaMemSetOwner(const char *owner) {
+    if (!_va_tracking) {
+        return;
+    }
+
+    if (owner == NULL) {
+        _va_thread_owner = &_va_no_owner;
+        return;
+    }
+
+    pthread_mutex_lock(&_va_mutex);
+
+    _va_owner *current;
+
+    for (current = _va_no_owner.next; current != NULL && current->name != owner; current = current->next);
+
+    if (current == NULL) {
+        current = calloc(1, sizeof(_va_owner));
+        current->name = owner;
+        _va_last_owner->next = current;
+        _va_last_owner = current;
+    }
+
+    _va_thread_owner = current;
+    pthread_mutex_unlock(&_va_mutex);
+}
+
+
+void vaMemSetClassifier(const char *(*classify)(const char *tag)) {
+    _va_classify = classify;
+}
+
+
+void vaMemForEach(void (*fn)(const vaMemStat *stat, void *data), void *data) {
+    pthread_mutex_lock(&_va_mutex);
+
+    for (_va_owner *owner = &_va_no_owner; owner != NULL; owner = owner->next) {
+        for (_va_record *rec = owner->first; rec != NULL; rec = rec->next) {
+            fn(&rec->stat, data);
+        }
+    }
+
+    pthread_mutex_unlock(&_va_mutex);
+}
+
+
+void vaMemTotal(size_t *current, size_t *peak) {
+    pthread_mutex_lock(&_va_mutex);
+    (*current) = _va_total_current;
+    (*peak) = _va_total_peak;
+    pthread_mutex_unlock(&_va_mutex);
+}
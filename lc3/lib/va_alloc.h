@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Allocation functions used by va_template.h
+ * Every block carries a small header, so memory from these functions must be released using vaFree
+ * The tag describes what the memory is used for (va_template uses the array type name)
+ */
+void *vaMalloc(const char *tag, size_t sz);
+void *vaRealloc(const char *tag, void *ptr, size_t sz);
+void  vaFree(void *ptr);
+
+/*
+ * Statistics for a single (owner, category) combination
+ * Sizes are in bytes and do not include the allocation headers
+ */
+typedef struct vaMemStat {
+    const char *owner;      // NULL if the memory was allocated without an owner
+    const char *category;   // Tag, or its category if a classifier was set
+    size_t current;
+    size_t peak;
+    size_t allocs;
+    size_t reallocs;
+    size_t frees;
+} vaMemStat;
+
+/*
+ * Enable or disable memory accounting
+ * Only blocks allocated while enabled are accounted for, so enable this as early as possible
+ */
+void vaMemTrack(bool enable);
+
+/*
+ * Set the owner for allocations made by the calling thread, NULL for none
+ * The string is compared by address and must outlive the statistics
+ */
+void vaMemSetOwner(const char *owner);
+
+/*
+ * Set a function that maps tags to categories, so multiple tags can be combined
+ * The returned string must outlive the statistics
+ */
+void vaMemSetClassifier(const char *(*classify)(const char *tag));
+
+/*
+ * Calls fn for every statistic, grouped by owner in order of first use
+ */
+void vaMemForEach(void (*fn)(const vaMemStat *stat, void *data), void *data);
+
+/*
+ * Get current and peak totals over all owners and categories
+ */
+void vaMemTotal(size_t *current, size_t *peak);
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdlib.h> // IWYU pragma: keep
+#include "va_alloc.h"
 
 #ifndef VA_BASE_CAP
 #define VA_BASE_CAP (8)
@@ -14,7 +15,7 @@
 #define vaRequiredArgs(type) type *ptr; size_t sz, cap
 
 
-// Templates for resizeable arrays
+// Templates for resizeable arrays, memory should be released using vaFree
 #define vaTypedef(type, name) typedef struct name {\
     vaRequiredArgs(type);\
 } name
@@ -23,7 +24,7 @@
 #define vaAllocFunctionDefine(vaType, name) vaType name()
 #define vaAllocFunction(vaType, type, name, pre, post) vaType name() {\
     pre;\
-    vaType va = { .ptr = malloc(VA_BASE_CAP * sizeof(type)), .sz = 0, .cap = VA_BASE_CAP };\
+    vaType va = { .ptr = vaMalloc(#vaType, VA_BASE_CAP * sizeof(type)), .sz = 0, .cap = VA_BASE_CAP };\
     post;\
     return va;\
 }
@@ -32,7 +33,7 @@
 #define vaAllocCapacityFunctionDefine(vaType, name) vaType name(size_t cap)
 #define vaAllocCapacityFunction(vaType, type, name, pre, post) vaType name(size_t cap) {\
     pre;\
-    vaType va = { .ptr = malloc(cap * sizeof(type)), .sz = 0, .cap = cap };\
+    vaType va = { .ptr = vaMalloc(#vaType, cap * sizeof(type)), .sz = 0, .cap = cap };\
     post;\
     return va;\
 }
@@ -44,7 +45,7 @@
     pre;\
     if (va->sz >= va->cap) {\
         va->cap *= 2;\
-        va->ptr = realloc(va->ptr, va->cap * sizeof(type));\
+        va->ptr = vaRealloc(#vaType, va->ptr, va->cap * sizeof(type));\
     }\
     va->ptr[va->sz] = el;\
     va->sz++;\
@@ -53,6 +54,18 @@
 }
 
 
+// Grows capacity to at least cap elements, does nothing if there already is enough room
+#define vaReserveFunctionDefine(vaType, name) void name(vaType *va, size_t cap)
+#define vaReserveFunction(vaType, type, name, pre, post) void name(vaType *va, size_t cap) {\
+    pre;\
+    if (cap > va->cap) {\
+        va->cap = cap;\
+        va->ptr = vaRealloc(#vaType, va->ptr, va->cap * sizeof(type));\
+    }\
+    post;\
+}
+
+
 #define vaClearFunctionDefine(vaType, name) void name(vaType *va)
 #define vaClearFunction(vaType, name, pre, post) void name(vaType *va) {\
     pre;\
@@ -69,7 +82,7 @@
         foreach;\
         memset(&el, 0, 0);\
     }\
-    free(va.ptr);\
+    vaFree(va.ptr);\
     post;\
     return;\
 }